@@ -8,10 +8,17 @@ workspace "FAT12"
    filter "system:windows"
       buildoptions { "/EHsc", "/Zc:preprocessor", "/Zc:__cplusplus" }
 
+   -- Core counters and timers (Instrumentation.h); Dist builds compile them out
+   filter "configurations:Debug or configurations:Release"
+      defines { "FAT12_INSTRUMENTATION" }
+
+   filter {}
+
 OutputDir = "%{cfg.system}-%{cfg.architecture}/%{cfg.buildcfg}"
 
 group "FAT12-Core"
 	include "FAT12-Core/Build-Core.lua"
 group ""
 
-include "FAT12-App/Build-App.lua"
\ No newline at end of file
+include "FAT12-App/Build-App.lua"
+include "FAT12-Bench/Build-Bench.lua"
\ No newline at end of file
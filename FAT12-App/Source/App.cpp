@@ -1,10 +1,74 @@
 #include "Core/Core.h"
+#include "Core/ImagePool.h"
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
 #include <string>
 
+// Swallows whatever is written to it
+struct NullBuffer : std::streambuf
+{
+    int overflow(int c) override { return c; }
+};
+
+// Splits a command line on whitespace; double quotes group words and are removed
+static std::vector<std::string> splitCommand(const std::string& line)
+{
+    std::vector<std::string> arguments;
+    std::string current;
+    bool quoted = false, pending = false;
+    for (char c : line)
+    {
+        if (c == '"')
+        {
+            quoted = !quoted;
+            pending = true;
+        }
+        else if (!quoted && std::isspace(static_cast<unsigned char>(c)))
+        {
+            if (pending)
+                arguments.push_back(std::move(current));
+            current.clear();
+            pending = false;
+        }
+        else
+        {
+            current += c;
+            pending = true;
+        }
+    }
+    if (pending)
+        arguments.push_back(std::move(current));
+    return arguments;
+}
+
+static std::string jsonString(const std::string& value)
+{
+    std::string quoted = "\"";
+    for (char c : value)
+    {
+        if (c == '"' || c == '\\')
+            quoted += '\\';
+        if (static_cast<unsigned char>(c) < 0x20)
+        {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+            quoted += escaped;
+        }
+        else
+            quoted += c;
+    }
+    return quoted + "\"";
+}
+
 class FAT12Frontend
 {
 private:
     FAT12 fat12;
+    bool json; // One JSON object per line instead of tables and messages
+    NullBuffer discarded;
+    std::ostream quiet{ &discarded }; // Swallows Core's progress messages in JSON mode
 
     void displayHelp()
     {
@@ -13,65 +77,660 @@ private:
 
         std::cout << std::left << std::setw(20) << "| ?" << std::left << std::setw(40) << "| Show available commands" << "|\n";
         std::cout << std::left << std::setw(20) << "| ls" << std::left << std::setw(40) << "| LS()" << "|\n";
+        std::cout << std::left << std::setw(20) << "| ls \"dir_path\"" << std::left << std::setw(40) << "| LS(dir_path)" << "|\n";
         std::cout << std::left << std::setw(20) << "| ls-1" << std::left << std::setw(40) << "| LS-1()" << "|\n";
         std::cout << std::left << std::setw(20) << "| export \"file_path\"" << std::left << std::setw(40) << "| copyToSystem(file_path)" << "|\n";
+        std::cout << std::left << std::setw(20) << "| export -r dir host" << std::left << std::setw(40) << "| exportTree(dir_path, host_dir)" << "|\n";
         std::cout << std::left << std::setw(20) << "| import \"file_name\"" << std::left << std::setw(40) << "| copyFromSystem(file_name)" << "|\n";
+        std::cout << std::left << std::setw(20) << "| import -r host dir" << std::left << std::setw(40) << "| importTree(host_dir, dir_path)" << "|\n";
         std::cout << std::left << std::setw(20) << "| status" << std::left << std::setw(40) << "| analyzeDisk()" << "|\n";
+        std::cout << std::left << std::setw(20) << "| status -d" << std::left << std::setw(40) << "| analyzeDisk() with slack and per-dir use" << "|\n";
+        std::cout << std::left << std::setw(20) << "| defrag" << std::left << std::setw(40) << "| defragment()" << "|\n";
+        std::cout << std::left << std::setw(20) << "| check [-r]" << std::left << std::setw(40) << "| check(repair)" << "|\n";
+        std::cout << std::left << std::setw(20) << "| hash [-s] [dir]" << std::left << std::setw(40) << "| hashFiles(dir_path), -s adds SHA-256" << "|\n";
+        std::cout << std::left << std::setw(20) << "| peek \"path\" off n" << std::left << std::setw(40) << "| readAt(file_path, offset, length)" << "|\n";
+        std::cout << std::left << std::setw(20) << "| stats [reset|json]" << std::left << std::setw(40) << "| Core counters and timers" << "|\n";
+        std::cout << std::left << std::setw(20) << "| trace start" << std::left << std::setw(40) << "| Record timed operations" << "|\n";
+        std::cout << std::left << std::setw(20) << "| trace save \"file\"" << std::left << std::setw(40) << "| Write them as a Chrome trace and stop" << "|\n";
+        if (fat12.isOverlay())
+        {
+            std::cout << std::left << std::setw(20) << "| snapshot \"delta\"" << std::left << std::setw(40) << "| snapshotOverlay(delta_file)" << "|\n";
+            std::cout << std::left << std::setw(20) << "| commit" << std::left << std::setw(40) << "| commitOverlay()" << "|\n";
+            std::cout << std::left << std::setw(20) << "| discard" << std::left << std::setw(40) << "| discardOverlay()" << "|\n";
+        }
+    }
+
+    void displayHexDump(const std::vector<std::byte>& data, uint32_t offset)
+    {
+        for (size_t line = 0; line < data.size(); line += 16)
+        {
+            std::cout << std::right << std::hex << std::setfill('0') << std::setw(8) << (offset + line) << " ";
+            std::string ascii;
+            for (size_t i = line; i < line + 16; i++)
+            {
+                if (i < data.size())
+                {
+                    unsigned value = std::to_integer<unsigned>(data[i]);
+                    std::cout << " " << std::setw(2) << value;
+                    ascii += (value >= 0x20 && value < 0x7F) ? static_cast<char>(value) : '.';
+                }
+                else
+                    std::cout << "   ";
+            }
+            std::cout << std::dec << std::setfill(' ') << "  |" << ascii << "|\n";
+        }
+        std::cout << std::left << std::endl;
+    }
+
+    bool listEntries(const std::string& command, const std::string& path, bool recursive)
+    {
+        std::string line;
+        return fat12.forEachEntry(path, recursive, [&](const std::string& entry_path, const DirectoryEntry& entry)
+        {
+            line = "{\"command\":" + jsonString(command) + ",\"path\":" + jsonString(entry_path) +
+                ",\"type\":" + (entry.isDirectory() ? "\"dir\"" : "\"file\"") +
+                ",\"size\":" + std::to_string(entry.file_size) +
+                ",\"first_cluster\":" + std::to_string(entry.first_logical_cluster) + "}\n";
+            std::cout << line;
+        });
+    }
+
+    void displayUsage(bool deep)
+    {
+        DiskUsage usage = fat12.diskUsage();
+        std::cout << "{\"command\":\"status\",\"partition_size\":" << usage.partition_size
+            << ",\"reserved_size\":" << usage.reserved_size
+            << ",\"fat_size\":" << usage.fat_size
+            << ",\"root_directory_size\":" << usage.root_directory_size
+            << ",\"data_area_size\":" << usage.data_area_size
+            << ",\"used_space\":" << usage.used_space
+            << ",\"bad_space\":" << usage.bad_space
+            << ",\"reserved_cluster_space\":" << usage.reserved_cluster_space
+            << ",\"available_space\":" << usage.available_space << "}\n";
+        if (!deep)
+            return;
+
+        SpaceDetails details = fat12.spaceDetails();
+        std::cout << "{\"command\":\"status\",\"files\":" << details.files
+            << ",\"fragmented_files\":" << details.fragmented_files
+            << ",\"extents\":" << details.extents
+            << ",\"slack_space\":" << details.slack_space
+            << ",\"lost_clusters\":" << details.lost_clusters << "}\n";
+        for (const DirectoryUsage& directory : details.directories)
+        {
+            std::cout << "{\"command\":\"status\",\"directory\":" << jsonString(directory.path)
+                << ",\"files\":" << directory.files
+                << ",\"file_bytes\":" << directory.file_bytes
+                << ",\"allocated_bytes\":" << directory.allocated_bytes << "}\n";
+        }
+    }
+
+    void displayBytes(const std::string& path, uint32_t offset, const std::vector<std::byte>& data)
+    {
+        static const char digits[] = "0123456789abcdef";
+        std::string hex;
+        hex.reserve(data.size() * 2);
+        for (std::byte value : data)
+        {
+            hex += digits[std::to_integer<unsigned>(value) >> 4];
+            hex += digits[std::to_integer<unsigned>(value) & 0xF];
+        }
+        std::cout << "{\"command\":\"peek\",\"path\":" << jsonString(path) << ",\"offset\":" << offset
+            << ",\"length\":" << data.size() << ",\"hex\":\"" << hex << "\"}\n";
+    }
+
+    bool runCheck(bool repair)
+    {
+        CheckReport report = fat12.check(repair);
+        if (!json)
+        {
+            for (const std::string& problem : report.problems)
+                std::cout << problem << "\n";
+            std::cout << "Checked " << report.directories << " directories and " << report.files << " files: "
+                << report.problems.size() << " problems, " << report.repairs << " repaired\n" << std::endl;
+            return report.clean() || repair;
+        }
+
+        for (const std::string& problem : report.problems)
+            std::cout << "{\"command\":\"check\",\"problem\":" << jsonString(problem) << "}\n";
+        std::cout << "{\"command\":\"check\",\"directories\":" << report.directories
+            << ",\"files\":" << report.files
+            << ",\"cross_links\":" << report.cross_links
+            << ",\"cycles\":" << report.cycles
+            << ",\"broken_chains\":" << report.broken_chains
+            << ",\"size_mismatches\":" << report.size_mismatches
+            << ",\"lost_chains\":" << report.lost_chains
+            << ",\"lost_clusters\":" << report.lost_clusters
+            << ",\"fat_copy_mismatches\":" << report.fat_copy_mismatches
+            << ",\"repairs\":" << report.repairs << "}\n";
+        return report.clean() || repair;
+    }
+
+    bool runDefrag()
+    {
+        DefragReport report = fat12.defragment();
+        if (json)
+        {
+            std::cout << "{\"command\":\"defrag\",\"chains\":" << report.chains
+                << ",\"fragmented_before\":" << report.fragmented_before
+                << ",\"extents_before\":" << report.extents_before
+                << ",\"fragmented_after\":" << report.fragmented_after
+                << ",\"extents_after\":" << report.extents_after
+                << ",\"moved_chains\":" << report.moved_chains
+                << ",\"moved_clusters\":" << report.moved_clusters
+                << ",\"rounds\":" << report.rounds << "}\n";
+            return report.completed;
+        }
+        std::cout << "Fragmented chains: " << report.fragmented_before << " of " << report.chains << " (" << report.extents_before
+            << " extents) before, " << report.fragmented_after << " (" << report.extents_after << " extents) after\n";
+        std::cout << "Moved " << report.moved_chains << " chains, " << report.moved_clusters << " clusters in "
+            << report.rounds << " rounds\n" << std::endl;
+        return report.completed;
+    }
+
+    bool runOverlayCommand(const std::string& command, const std::string& snapshot_file)
+    {
+        size_t sectors = fat12.overlaySectors();
+        bool ok = command == "snapshot" ? fat12.snapshotOverlay(snapshot_file)
+            : command == "commit" ? fat12.commitOverlay() : fat12.discardOverlay();
+        if (!ok || json)
+            return ok;
+
+        if (command == "snapshot")
+            std::cout << "Snapshot written to " << snapshot_file << "\n" << std::endl;
+        else if (command == "commit")
+            std::cout << "Committed " << sectors << " changed sectors to the base image\n" << std::endl;
+        else
+            std::cout << "Discarded " << sectors << " changed sectors\n" << std::endl;
+        return true;
+    }
+
+    bool runHash(const std::vector<std::string>& arguments)
+    {
+        bool sha256 = false;
+        std::string directory = "/";
+        for (size_t index = 1; index < arguments.size(); index++)
+        {
+            if (arguments[index] == "-s")
+                sha256 = true;
+            else
+                directory = arguments[index];
+        }
+
+        std::vector<FileHash> hashes;
+        auto start = std::chrono::steady_clock::now();
+        bool ok = fat12.hashFiles(directory, sha256, 0, hashes);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        uint64_t bytes = 0;
+        for (const FileHash& hash : hashes)
+        {
+            bytes += hash.size;
+            if (json)
+                std::cout << "{\"command\":\"hash\",\"path\":" << jsonString(hash.path) << ",\"size\":" << hash.size
+                    << ",\"hash\":\"" << ContentHash::toHex(hash.hash) << "\""
+                    << (hash.has_sha256 ? ",\"sha256\":\"" + ContentHash::toHex(hash.sha256) + "\"" : "") << "}\n";
+            else
+                std::cout << ContentHash::toHex(hash.hash) << "  " << (hash.has_sha256 ? ContentHash::toHex(hash.sha256) + "  " : "")
+                    << std::right << std::setw(10) << hash.size << "  " << hash.path << "\n";
+        }
+
+        double gigabytes_per_second = seconds > 0 ? bytes / seconds / 1e9 : 0;
+        const char* kernel = ContentHash::kernelName(ContentHash::bestKernel());
+        if (json)
+            std::cout << "{\"command\":\"hash\",\"files\":" << hashes.size() << ",\"bytes\":" << bytes
+                << ",\"seconds\":" << seconds << ",\"gb_per_s\":" << gigabytes_per_second << ",\"kernel\":\"" << kernel << "\"}\n";
+        else
+            std::cout << std::left << "Hashed " << hashes.size() << " files, " << bytes << " bytes in " << std::fixed << std::setprecision(3)
+                << seconds * 1e3 << " ms (" << gigabytes_per_second << " GB/s, " << kernel << (sha256 ? " + SHA-256" : "") << ")\n" << std::endl;
+        return ok;
+    }
+
+    bool runStats(const std::string& option)
+    {
+        if (option == "reset")
+        {
+            Instrumentation::reset();
+            if (!json)
+                std::cout << "Counters reset\n" << std::endl;
+            return true;
+        }
+        if (!Instrumentation::compiled_in && !json)
+        {
+            std::cout << "Instrumentation is compiled out of this build\n" << std::endl;
+            return true;
+        }
+
+        Instrumentation::Snapshot stats = Instrumentation::snapshot();
+        if (json || option == "json")
+        {
+            Instrumentation::writeJson(stats, std::cout);
+            return true;
+        }
+        for (size_t index = 0; index < Instrumentation::counter_count; index++)
+            std::cout << std::left << std::setw(28) << Instrumentation::name(static_cast<Instrumentation::Counter>(index))
+                << std::right << std::setw(14) << stats.counters[index] << "\n";
+        std::cout << "\n" << std::left << std::setw(28) << "Timer" << std::right << std::setw(10) << "Calls"
+            << std::setw(14) << "Total ms" << std::setw(12) << "Mean us" << std::setw(12) << "Max us" << "\n";
+        for (size_t index = 0; index < Instrumentation::timer_count; index++)
+        {
+            const Instrumentation::TimerStats& timer = stats.timers[index];
+            if (timer.calls == 0)
+                continue;
+            std::cout << std::left << std::setw(28) << Instrumentation::name(static_cast<Instrumentation::Timer>(index))
+                << std::right << std::setw(10) << timer.calls << std::fixed << std::setprecision(3)
+                << std::setw(14) << timer.total_ns / 1e6 << std::setw(12) << timer.total_ns / 1e3 / timer.calls
+                << std::setw(12) << timer.max_ns / 1e3 << "\n";
+        }
+        std::cout << std::left << std::endl;
+        return true;
+    }
+
+    bool runTrace(const std::string& action, const std::string& trace_file)
+    {
+        if (action == "start")
+        {
+            Instrumentation::setTracing(true);
+            if (!json)
+                std::cout << "Tracing timed operations\n" << std::endl;
+            return true;
+        }
+        Instrumentation::setTracing(false);
+        if (!Instrumentation::writeTrace(trace_file))
+            return false;
+        if (!json)
+            std::cout << "Trace written to " << trace_file << "\n" << std::endl;
+        return true;
+    }
+
+    static MountOptions mountOptions(const std::string& overlay)
+    {
+        // Directories are read when a command first needs them
+        MountOptions options;
+        options.lazy_directories = true;
+        options.overlay = overlay;
+        // Imports and repairs commit metadata through the journal, so a crash mid-command is recovered on the next mount
+        options.journal = true;
+        return options;
     }
 
 public:
-    FAT12Frontend(const std::string& imageFilePath) : fat12("./" + imageFilePath + ".img")
-    { 
-        std::cout << "Type '?' for help.\n" << std::endl; 
+    FAT12Frontend(const std::string& imageFilePath, bool json = false, const std::string& overlay = "")
+        : fat12(imageFilePath, mountOptions(overlay)), json(json)
+    {
+    }
+
+    bool isMounted() const { return fat12.isMounted(); }
+
+    // Runs one command; in JSON mode every command ends with a line holding its result
+    bool execute(const std::vector<std::string>& arguments)
+    {
+        if (arguments.empty())
+            return true;
+
+        const std::string& command = arguments[0];
+        auto argument = [&](size_t index, const std::string& fallback) { return index < arguments.size() ? arguments[index] : fallback; };
+        bool recursive = arguments.size() > 1 && arguments[1] == "-r";
+        std::ostream& out = json ? quiet : std::cout;
+        bool ok = true;
+
+        if (command == "?" && !json)
+            displayHelp();
+        else if (command == "ls" || command == "ls-1")
+        {
+            if (json)
+                ok = listEntries(command, command == "ls" ? argument(1, "/") : "/", command == "ls");
+            else if (command == "ls")
+                ok = fat12.LS(argument(1, "/"));
+            else
+                fat12.LS1();
+        }
+        else if (command == "export" && recursive)
+            ok = fat12.exportTree(argument(2, "/"), argument(3, "."), 0, out);
+        else if (command == "export" && arguments.size() > 1)
+            ok = fat12.copyToSystem(arguments[1], argument(2, ""), out);
+        else if (command == "import" && recursive)
+            ok = fat12.importTree(argument(2, "."), argument(3, "/"), out);
+        else if (command == "import" && arguments.size() > 1)
+            ok = fat12.copyFromSystem(arguments[1], out);
+        else if (command == "peek" && arguments.size() > 1)
+        {
+            uint32_t offset = static_cast<uint32_t>(std::strtoul(argument(2, "0").c_str(), nullptr, 10));
+            uint32_t length = static_cast<uint32_t>(std::strtoul(argument(3, "64").c_str(), nullptr, 10));
+            std::vector<std::byte> data;
+            ok = fat12.readAt(arguments[1], offset, length, data);
+            if (ok && json)
+                displayBytes(arguments[1], offset, data);
+            else if (ok)
+                displayHexDump(data, offset);
+        }
+        else if (command == "defrag")
+            ok = runDefrag();
+        else if (command == "check")
+            ok = runCheck(argument(1, "") == "-r");
+        else if (command == "hash")
+            ok = runHash(arguments);
+        else if (command == "stats")
+            ok = runStats(argument(1, ""));
+        else if (command == "trace" && (argument(1, "") == "start" || (argument(1, "") == "save" && arguments.size() > 2)))
+            ok = runTrace(arguments[1], argument(2, ""));
+        else if ((command == "snapshot" && arguments.size() > 1) || command == "commit" || command == "discard")
+            ok = runOverlayCommand(command, argument(1, ""));
+        else if (command == "status")
+        {
+            bool deep = argument(1, "") == "-d";
+            if (json)
+                displayUsage(deep);
+            else
+                fat12.analyzeDisk(std::cout, deep);
+        }
+        else
+        {
+            ok = false;
+            if (!json)
+                std::cout << "Unknown command. Type '?' for help.\n";
+        }
+
+        if (json)
+            std::cout << "{\"command\":" << jsonString(command) << ",\"ok\":" << (ok ? "true" : "false") << "}" << std::endl;
+        return ok;
+    }
+
+    // Runs a command file, one command per line; blank lines and lines starting with '#' are skipped
+    bool runScript(std::istream& script)
+    {
+        bool ok = true;
+        std::string line;
+        while (std::getline(script, line))
+        {
+            size_t first = line.find_first_not_of(" \t\r");
+            if (first == std::string::npos || line[first] == '#')
+                continue;
+            ok = execute(splitCommand(line)) && ok;
+        }
+        return ok;
     }
 
     void run() 
     {
+        std::cout << "Type '?' for help.\n" << std::endl;
         std::string command;
         while (true) 
         {
             std::cout << "> ";
-            std::getline(std::cin, command);
+            if (!std::getline(std::cin, command))
+                return;
+            execute(splitCommand(command));
+        }
+    }
+};
 
-            if (command == "?") 
-                displayHelp();
-            else if (command == "ls") 
-                fat12.LS();
-            else if (command == "ls-1") 
-                fat12.LS1();
-            else if (command.find("export ") == 0)
-            {
-                std::string file_path = command.substr(7);
-                fat12.copyToSystem(file_path);
-            }
-            else if (command.find("import ") == 0)
+// Shell-style match supporting '*' and '?'
+static bool matchesPattern(const std::string& name, const std::string& pattern)
+{
+    size_t n = 0, p = 0, star = std::string::npos, star_match = 0;
+    while (n < name.size())
+    {
+        if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == name[n]))
+        {
+            n++;
+            p++;
+        }
+        else if (p < pattern.size() && pattern[p] == '*')
+        {
+            star = p++;
+            star_match = n;
+        }
+        else if (star != std::string::npos)
+        {
+            p = star + 1;
+            n = ++star_match;
+        }
+        else
+            return false;
+    }
+    while (p < pattern.size() && pattern[p] == '*')
+        p++;
+    return p == pattern.size();
+}
+
+// Files of one directory matching the last component of the pattern, sorted
+static std::vector<std::string> expandPattern(const std::string& pattern)
+{
+    std::filesystem::path pattern_path(pattern);
+    std::filesystem::path directory = pattern_path.has_parent_path() ? pattern_path.parent_path() : ".";
+    std::string name_pattern = pattern_path.filename().string();
+
+    std::vector<std::string> paths;
+    std::error_code error;
+    for (const auto& item : std::filesystem::directory_iterator(directory, error))
+    {
+        if (item.is_regular_file() && matchesPattern(item.path().filename().string(), name_pattern))
+            paths.push_back(item.path().string());
+    }
+    if (error)
+        std::cerr << "ERROR: Failed to read directory: " << directory.string() << std::endl;
+    std::sort(paths.begin(), paths.end());
+    return paths;
+}
+
+// FAT12-App --batch "<dir/*.img>" ls|status|export <dir_path> <host_dir>
+// Runs one command over every matching image in parallel; exports go to host_dir/<image name>
+static int runBatch(int argc, char** argv)
+{
+    if (argc < 4)
+    {
+        std::cerr << "ERROR: Usage: --batch \"<pattern>\" ls|status|export <dir_path> <host_dir>" << std::endl;
+        return 1;
+    }
+    std::string command = argv[3];
+    if (command != "ls" && command != "status" && !(command == "export" && argc >= 6))
+    {
+        std::cerr << "ERROR: Unknown batch command: " << command << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> images = expandPattern(argv[2]);
+    // Each image is visited once, so a budget of a few mounts per worker is enough
+    ImagePool::Options options;
+    options.mount.lazy_directories = true;
+    options.max_open = 2 * std::max(std::thread::hardware_concurrency(), 1u);
+    ImagePool pool(options);
+    std::mutex output_mutex;
+
+    size_t failed = pool.forEach(images, [&](const std::string& image, FAT12& fat12)
+    {
+        // Each image's output is printed in one piece
+        std::ostringstream output;
+        if (command == "ls")
+            fat12.LS("/", output);
+        else if (command == "status")
+            fat12.analyzeDisk(output);
+        else
+            fat12.exportTree(argv[4], (std::filesystem::path(argv[5]) / std::filesystem::path(image).stem()).string(), 1, output);
+
+        std::lock_guard lock(output_mutex);
+        std::cout << "== " << image << " ==\n" << output.str() << std::flush;
+    });
+
+    std::cout << "Images processed: " << images.size() - failed << " of " << images.size() << std::endl;
+    return failed == 0 ? 0 : 1;
+}
+
+// FAT12-App --index <index_file> "<dir/*.img>" [-s]
+// Hashes every file of every matching image in parallel, records them in the
+// dedup index (replacing earlier records of the same images) and lists contents
+// stored more than once anywhere in the index. Without -s, files whose hash and
+// size are unchanged keep the SHA-256 of an earlier -s run.
+static int runIndex(int argc, char** argv)
+{
+    if (argc < 4)
+    {
+        std::cerr << "ERROR: Usage: --index <index_file> \"<pattern>\" [-s]" << std::endl;
+        return 1;
+    }
+    std::string index_file = argv[2];
+    bool sha256 = argc > 4 && std::string(argv[4]) == "-s";
+
+    DedupIndex index;
+    if (!index.load(index_file))
+        return 1;
+
+    std::vector<std::string> images = expandPattern(argv[3]);
+    ImagePool::Options options;
+    options.mount.lazy_directories = true;
+    options.max_open = 2 * std::max(std::thread::hardware_concurrency(), 1u);
+    ImagePool pool(options);
+    std::mutex index_mutex;
+    uint64_t hashed_bytes = 0;
+    size_t hashed_files = 0;
+
+    // One thread per image; the pool already runs images side by side
+    auto start = std::chrono::steady_clock::now();
+    size_t failed = pool.forEach(images, [&](const std::string& image, FAT12& fat12)
+    {
+        std::vector<FileHash> hashes;
+        if (!fat12.hashFiles("/", sha256, 1, hashes))
+            std::cerr << "ERROR: Some files could not be hashed: " << image << std::endl;
+
+        // Absolute, so indexing from another directory replaces the same records
+        std::error_code error;
+        std::filesystem::path key = std::filesystem::absolute(image, error).lexically_normal();
+        std::lock_guard lock(index_mutex);
+        for (const FileHash& hash : hashes)
+            hashed_bytes += hash.size;
+        hashed_files += hashes.size();
+        index.update(error ? image : key.string(), hashes);
+    });
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (!index.save(index_file))
+        return 1;
+
+    std::vector<DedupIndex::DuplicateGroup> groups = index.duplicates();
+    uint64_t wasted_bytes = 0;
+    for (const DedupIndex::DuplicateGroup& group : groups)
+        wasted_bytes += group.wastedBytes();
+
+    // Largest savings first; the full list is in the index file
+    const size_t shown_groups = 20;
+    for (size_t position = 0; position < std::min(groups.size(), shown_groups); position++)
+    {
+        const DedupIndex::DuplicateGroup& group = groups[position];
+        std::cout << ContentHash::toHex(group.hash) << "  " << group.size << " bytes x" << group.locations.size()
+            << (group.verified ? " (SHA-256 verified)" : "") << "\n";
+        for (const DedupIndex::Location* location : group.locations)
+            std::cout << "    " << location->image << ":" << location->path << "\n";
+    }
+    if (groups.size() > shown_groups)
+        std::cout << "... and " << groups.size() - shown_groups << " more duplicate groups\n";
+
+    std::cout << std::fixed << std::setprecision(3) << "Hashed " << hashed_files << " files, " << hashed_bytes << " bytes from "
+        << images.size() - failed << " of " << images.size() << " images in " << seconds * 1e3 << " ms ("
+        << (seconds > 0 ? hashed_bytes / seconds / 1e9 : 0) << " GB/s)\n";
+    std::cout << "Index: " << index.fileCount() << " files, " << index.contentCount() << " distinct contents, "
+        << groups.size() << " duplicated, " << wasted_bytes << " bytes in extra copies" << std::endl;
+    return failed == 0 ? 0 : 1;
+}
+
+// FAT12-App --build <host_dir> <image.img> [format]
+// Formats a fresh image (1.44 MB unless another standard format is named) holding
+// the whole host tree, written in one sequential pass
+static int runBuild(int argc, char** argv)
+{
+    if (argc < 4)
+    {
+        std::cerr << "ERROR: Usage: --build <host_dir> <image.img> [format]" << std::endl;
+        return 1;
+    }
+    int format = argc > 4 ? findStandardFormat(argv[4]) : static_cast<int>(format_1440k);
+    if (format < 0)
+    {
+        std::cerr << "ERROR: Unknown format: " << argv[4] << std::endl;
+        return 1;
+    }
+
+    ImageBuilder builder;
+    ImageBuilder::Report report;
+    if (!builder.build(argv[2], argv[3], standard_formats[format].boot_sector, report))
+        return 1;
+    std::cout << "Built " << argv[3] << " (" << standard_formats[format].name << "): " << report.files << " files, "
+        << report.directories << " directories, " << report.file_bytes << " bytes" << std::endl;
+    return 0;
+}
+
+// FAT12-App <image.img> [--overlay <delta>] [--trace <file>] <command> [arguments] [--json]
+// FAT12-App <image.img> [--overlay <delta>] [--trace <file>] --script <file> [--json]
+// With --overlay the image is only read and every change goes to the delta file;
+// --trace writes every timed operation of the run, mount and unmount included
+static int runCommandLine(int argc, char** argv)
+{
+    std::vector<std::string> arguments;
+    bool json = false;
+    std::string overlay, trace_file;
+    for (int i = 2; i < argc; i++)
+    {
+        if (std::string(argv[i]) == "--json")
+            json = true;
+        else if (std::string(argv[i]) == "--overlay" && i + 1 < argc)
+            overlay = argv[++i];
+        else if (std::string(argv[i]) == "--trace" && i + 1 < argc)
+            trace_file = argv[++i];
+        else
+            arguments.push_back(argv[i]);
+    }
+
+    Instrumentation::setTracing(!trace_file.empty());
+    int result = 0;
+    {
+        FAT12Frontend frontend(argv[1], json, overlay);
+        if (!frontend.isMounted())
+            result = 1;
+        else if (arguments.size() == 2 && arguments[0] == "--script")
+        {
+            std::ifstream script(arguments[1]);
+            if (!script)
             {
-                std::string file_name = command.substr(7);
-                fat12.copyFromSystem(file_name);
+                std::cerr << "ERROR: Failed to open script: " << arguments[1] << std::endl;
+                result = 1;
             }
-            else if (command == "status") 
-                fat12.analyzeDisk();
-            else 
-                std::cout << "Unknown command. Type '?' for help.\n";
+            else
+                result = frontend.runScript(script) ? 0 : 1;
         }
+        else
+            result = frontend.execute(arguments) ? 0 : 1;
     }
-};
+    if (!trace_file.empty() && !Instrumentation::writeTrace(trace_file))
+        result = 1;
+    return result;
+}
 
-int main()
+int main(int argc, char** argv)
 {
+    if (argc > 1 && std::string(argv[1]) == "--batch")
+        return runBatch(argc, argv);
+    if (argc > 1 && std::string(argv[1]) == "--build")
+        return runBuild(argc, argv);
+    if (argc > 1 && std::string(argv[1]) == "--index")
+        return runIndex(argc, argv);
+    if (argc > 2)
+        return runCommandLine(argc, argv);
+
     while (true)
     {
         std::cout << "Please enter Disk Image Name: " << std::endl;
         std::string diskImagePath;
-        std::getline(std::cin, diskImagePath);
+        if (!std::getline(std::cin, diskImagePath))
+            break;
 
         if (std::filesystem::exists("./" +diskImagePath + ".img"))
         {
-            FAT12Frontend fat12Frontend(diskImagePath);
+            // run() only returns once input ends
+            FAT12Frontend fat12Frontend("./" + diskImagePath + ".img");
             fat12Frontend.run();
+            break;
         }
         else
             std::cout << "\nERROR: Disk Image Not Found!\n" << std::endl;
     }
 	return 0;
-}
\ No newline at end of file
+}
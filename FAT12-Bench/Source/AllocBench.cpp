@@ -0,0 +1,59 @@
+#include "Bench.h"
+#include "Core/Core.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<uint64_t> allocation_count{ 0 };
+static std::atomic<uint64_t> allocated_bytes{ 0 };
+
+void *operator new(size_t size)
+{
+	allocation_count.fetch_add(1, std::memory_order_relaxed);
+	allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+	if (void *memory = std::malloc(size ? size : 1))
+		return memory;
+	throw std::bad_alloc();
+}
+
+void operator delete(void *memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept
+{
+	std::free(memory);
+}
+
+// Heap allocations made by a mount and by listing every directory
+void runAllocBench(const BenchContext &context)
+{
+	const char *images[] = { "fat12.img", "fat12subdir.img" };
+
+	for (const char *image : images)
+	{
+		std::string path = context.image_directory + image;
+
+		uint64_t count_before = allocation_count.load();
+		uint64_t bytes_before = allocated_bytes.load();
+		{
+			FAT12 fat12(path);
+			uint64_t mount_count = allocation_count.load() - count_before;
+			uint64_t mount_bytes = allocated_bytes.load() - bytes_before;
+
+			// Discard the listing itself, only its allocations matter
+			NullBuffer discarded;
+			std::streambuf *previous = std::cout.rdbuf(&discarded);
+			uint64_t ls_count_before = allocation_count.load();
+			fat12.LS();
+			uint64_t ls_count = allocation_count.load() - ls_count_before;
+			std::cout.rdbuf(previous);
+
+			report(std::string("alloc/mount/count/") + image, static_cast<double>(mount_count), "allocs");
+			report(std::string("alloc/mount/bytes/") + image, static_cast<double>(mount_bytes), "bytes");
+			report(std::string("alloc/ls/count/") + image, static_cast<double>(ls_count), "allocs");
+		}
+	}
+}
@@ -0,0 +1,117 @@
+#include "Bench.h"
+#include "ImageGenerator.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <random>
+
+struct Benchmark
+{
+	const char *name;
+	void (*run)(const BenchContext &context);
+};
+
+static const Benchmark benchmarks[] =
+{
+	{ "mount", runMountBench },
+	{ "alloc", runAllocBench },
+	{ "fatcodec", runFatCodecBench },
+	{ "import", runImportBench },
+	{ "export", runExportBench },
+	{ "peek", runPeekBench },
+	{ "tree", runTreeBench },
+	{ "sync", runSyncBench },
+	{ "concurrency", runConcurrencyBench },
+	{ "pool", runPoolBench },
+	{ "check", runCheckBench },
+	{ "defrag", runDefragBench },
+	{ "journal", runJournalBench },
+	{ "overlay", runOverlayBench },
+	{ "layout", runLayoutBench },
+	{ "synthetic", runSyntheticBench },
+	{ "build", runBuildBench },
+	{ "instrumentation", runInstrumentationBench },
+	{ "hash", runHashBench },
+};
+
+std::vector<std::filesystem::path> writeRandomFiles(const std::filesystem::path &directory, size_t count,
+	size_t min_size, size_t max_size, uint32_t seed)
+{
+	std::mt19937 generator(seed);
+	std::uniform_int_distribution<size_t> size_distribution(min_size, max_size);
+	std::vector<std::filesystem::path> files;
+	std::vector<char> contents;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		contents.resize(size_distribution(generator));
+		for (char &value : contents)
+			value = static_cast<char>(generator());
+
+		char name[32];	// Room for any size_t
+		std::snprintf(name, sizeof(name), "F%03zu.BIN", i);
+		files.push_back(directory / name);
+		std::ofstream(files.back(), std::ios::binary).write(contents.data(), contents.size());
+	}
+	return files;
+}
+
+// FAT12-Bench --generate <image> [key=value...] writes one synthetic image
+static int generate(int argc, char **argv)
+{
+	ImageSpec spec;
+	for (int i = 3; i < argc; i++)
+	{
+		if (!parseImageSpec(argv[i], spec))
+		{
+			std::cerr << "ERROR: Unknown setting: " << argv[i] << std::endl;
+			return 1;
+		}
+	}
+
+	GeneratedImage generated;
+	if (!generateImage(argv[2], spec, generated))
+		return 1;
+	std::cout << argv[2] << ": " << generated.files << " files (" << generated.fragmented_files << " fragmented), "
+		<< generated.directories.size() - 1 << " directories, " << generated.file_bytes << " bytes" << std::endl;
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	BenchContext context;
+	context.image_directory = "../FAT12-App/";
+
+	// Usage: FAT12-Bench [--images <dir>] [--json] [benchmark...]
+	//        FAT12-Bench --generate <image> [format=1.44MB] [seed=1] [files=100] [min=0] [max=16384]
+	//                    [dist=log|uniform] [depth=0] [fanout=2] [frag=0]
+	if (argc > 2 && std::strcmp(argv[1], "--generate") == 0)
+		return generate(argc, argv);
+
+	std::vector<const char*> names;
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::strcmp(argv[i], "--images") == 0 && i + 1 < argc)
+			context.image_directory = std::string(argv[++i]) + "/";
+		else if (std::strcmp(argv[i], "--json") == 0)
+			json_report = true;
+		else
+			names.push_back(argv[i]);
+	}
+
+	for (const Benchmark &benchmark : benchmarks)
+	{
+		bool selected = names.empty();
+		for (const char *name : names)
+			selected |= (std::strcmp(name, benchmark.name) == 0);
+
+		if (selected)
+		{
+			if (!json_report)
+				std::cout << "# " << benchmark.name << std::endl;
+			benchmark.run(context);
+		}
+	}
+	return 0;
+}
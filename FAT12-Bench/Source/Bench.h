@@ -0,0 +1,142 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+struct BenchContext
+{
+	std::string image_directory;	// Directory holding fat12.img and fat12subdir.img
+};
+
+// Runs function `iterations` times and returns the mean time per iteration in nanoseconds
+template <typename Function>
+double measure(size_t iterations, Function &&function)
+{
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i{ 0 }; i < iterations; i++)
+		function();
+	auto elapsed = std::chrono::steady_clock::now() - start;
+	return std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+}
+
+// Per-call latencies in nanoseconds
+struct Latency
+{
+	double mean = 0;
+	double p50 = 0;
+	double p99 = 0;
+};
+
+inline Latency summarize(std::vector<double> samples)
+{
+	Latency latency;
+	if (samples.empty())
+		return latency;
+	std::sort(samples.begin(), samples.end());
+	for (double sample : samples)
+		latency.mean += sample / samples.size();
+	latency.p50 = samples[(samples.size() - 1) * 50 / 100];
+	latency.p99 = samples[(samples.size() - 1) * 99 / 100];
+	return latency;
+}
+
+// Runs function `iterations` times, timing each call on its own
+template <typename Function>
+Latency measureLatency(size_t iterations, Function &&function)
+{
+	std::vector<double> samples(iterations);
+	for (double &sample : samples)
+	{
+		auto start = std::chrono::steady_clock::now();
+		function();
+		sample = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+	}
+	return summarize(std::move(samples));
+}
+
+// Swallows output without allocating
+struct NullBuffer : std::streambuf
+{
+	int overflow(int c) override { return c; }
+};
+
+// Silences std::cout and std::cerr for its lifetime
+class ScopedSilence
+{
+public:
+	ScopedSilence() : previous_out(std::cout.rdbuf(&discarded)), previous_err(std::cerr.rdbuf(&discarded)) {}
+	~ScopedSilence()
+	{
+		std::cout.rdbuf(previous_out);
+		std::cerr.rdbuf(previous_err);
+	}
+
+private:
+	NullBuffer discarded;
+	std::streambuf *previous_out;
+	std::streambuf *previous_err;
+};
+
+// Fresh, empty directory under the system temp directory
+inline std::filesystem::path makeScratchDirectory(const std::string &name)
+{
+	std::filesystem::path directory = std::filesystem::temp_directory_path() / ("fat12-bench-" + name);
+	std::filesystem::remove_all(directory);
+	std::filesystem::create_directories(directory);
+	return directory;
+}
+
+// Writes count files named F000.BIN... with sizes in [min_size, max_size]
+std::vector<std::filesystem::path> writeRandomFiles(const std::filesystem::path &directory, size_t count,
+	size_t min_size, size_t max_size, uint32_t seed);
+
+// Turns a copy of fat12.img into one whose free root slots hold 200 one-cluster
+// directories full of empty files
+void writeWideImage(const std::filesystem::path &image);
+
+inline bool json_report = false;	// Set by --json: one JSON object per result instead of aligned text
+
+inline void report(const std::string &name, double value, const std::string &unit)
+{
+	if (json_report)
+	{
+		std::cout << "{\"name\":\"" << name << "\",\"value\":" << std::fixed << std::setprecision(3) << value
+			<< ",\"unit\":\"" << unit << "\"}" << std::endl;
+		return;
+	}
+	std::cout << std::left << std::setw(48) << name << std::right << std::setw(14)
+		<< std::fixed << std::setprecision(2) << value << " " << unit << std::endl;
+}
+
+// Throughput from the mean latency and the work one call does, then p50 and p99
+inline void reportLatency(const std::string &name, const Latency &latency, double work_per_call, const std::string &work_unit)
+{
+	report(name + "/throughput", work_per_call / (latency.mean / 1e9), work_unit + "/s");
+	report(name + "/p50", latency.p50 / 1e3, "us");
+	report(name + "/p99", latency.p99 / 1e3, "us");
+}
+
+void runMountBench(const BenchContext &context);
+void runAllocBench(const BenchContext &context);
+void runFatCodecBench(const BenchContext &context);
+void runImportBench(const BenchContext &context);
+void runExportBench(const BenchContext &context);
+void runPeekBench(const BenchContext &context);
+void runTreeBench(const BenchContext &context);
+void runSyncBench(const BenchContext &context);
+void runConcurrencyBench(const BenchContext &context);
+void runPoolBench(const BenchContext &context);
+void runCheckBench(const BenchContext &context);
+void runDefragBench(const BenchContext &context);
+void runJournalBench(const BenchContext &context);
+void runOverlayBench(const BenchContext &context);
+void runLayoutBench(const BenchContext &context);
+void runSyntheticBench(const BenchContext &context);
+void runBuildBench(const BenchContext &context);
+void runInstrumentationBench(const BenchContext &context);
+void runHashBench(const BenchContext &context);
@@ -0,0 +1,50 @@
+#include "Bench.h"
+#include "Core/Core.h"
+
+static const size_t build_iterations = 20;
+
+// Provisioning one 1.44 MB floppy from a host tree. The first two start from a
+// blank image copy, filled one copyFromSystem per file (root files only, as that
+// is all it can reach) or by one recursive import; the builder formats and
+// writes the whole tree in a single pass.
+void runBuildBench(const BenchContext &)
+{
+	std::filesystem::path scratch = makeScratchDirectory("build");
+	std::filesystem::path tree = scratch / "tree", blank_tree = scratch / "blank";
+	std::filesystem::create_directories(tree / "DRIVERS");
+	std::filesystem::create_directories(blank_tree);
+	std::vector<std::filesystem::path> root_files = writeRandomFiles(tree, 60, 500, 12000, 23);
+	writeRandomFiles(tree / "DRIVERS", 30, 500, 12000, 24);
+	const BootSector &boot_sector = standard_formats[format_1440k].boot_sector;
+	std::filesystem::path image = scratch / "out.img", blank = scratch / "blank.img";
+
+	ImageBuilder builder;
+	ImageBuilder::Report built;
+	builder.build(blank_tree.string(), blank.string(), boot_sector, built);
+
+	double per_file_us = 0, import_us = 0, build_us = 0;
+	{
+		ScopedSilence silence;
+		per_file_us = measure(build_iterations, [&]
+		{
+			std::filesystem::copy_file(blank, image, std::filesystem::copy_options::overwrite_existing);
+			FAT12 fat12(image.string());
+			for (const std::filesystem::path &file : root_files)
+				fat12.copyFromSystem(file.string());
+		}) / 1e3;
+		import_us = measure(build_iterations, [&]
+		{
+			std::filesystem::copy_file(blank, image, std::filesystem::copy_options::overwrite_existing);
+			FAT12 fat12(image.string());
+			fat12.importTree(tree.string(), "/");
+		}) / 1e3;
+		build_us = measure(build_iterations, [&] { builder.build(tree.string(), image.string(), boot_sector, built); }) / 1e3;
+	}
+
+	report("build/per-file-copy/60-root-files", per_file_us, "us/image");
+	report("build/import-tree/90-files", import_us, "us/image");
+	report("build/single-pass/90-files", build_us, "us/image");
+	report("build/single-pass/rate", 60e6 / build_us, "images/min");
+
+	std::filesystem::remove_all(scratch);
+}
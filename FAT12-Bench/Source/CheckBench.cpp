@@ -0,0 +1,58 @@
+#include "Bench.h"
+#include "Core/ImagePool.h"
+
+#include <atomic>
+#include <system_error>
+
+// Screening throughput of check(): one image with many directories on 1..8
+// threads, then an archive of images checked one per worker through a pool
+void runCheckBench(const BenchContext &context)
+{
+	std::filesystem::path scratch = makeScratchDirectory("check");
+	std::filesystem::path wide_image = scratch / "wide.img";
+	std::filesystem::copy_file(context.image_directory + "fat12.img", wide_image);
+	writeWideImage(wide_image);
+
+	{
+		FAT12 fat12(wide_image.string());
+		for (size_t threads : { 1, 2, 4, 8 })
+		{
+			double check_ns = measure(200, [&] { fat12.check(false, threads); });
+			report("check/wide.img/threads-" + std::to_string(threads), check_ns / 1000.0, "us");
+		}
+		if (!fat12.check().clean())
+			std::cerr << "ERROR: Wide image reported problems" << std::endl;
+	}
+
+	const size_t image_count = 1000;
+	std::vector<std::string> images;
+	for (size_t i = 0; i < image_count; i++)
+	{
+		std::filesystem::path image = scratch / ("IMG" + std::to_string(i) + ".img");
+		std::error_code error;
+		std::filesystem::create_hard_link(wide_image, image, error);
+		if (error)
+			std::filesystem::copy_file(wide_image, image);
+		images.push_back(image.string());
+	}
+
+	for (size_t threads : { size_t{ 1 }, size_t{ 0 } })
+	{
+		ImagePool::Options options;
+		options.max_open = 16;
+		options.mount.lazy_directories = true;
+		ImagePool pool(options);
+		std::atomic<size_t> dirty{ 0 };
+		double archive_ns = measure(1, [&]
+		{
+			// One worker per image, so each check runs single-threaded
+			pool.forEach(images, [&](const std::string &, FAT12 &fat12) { dirty += !fat12.check(false, 1).clean(); }, threads);
+		});
+
+		report(std::string("check/archive/") + (threads == 1 ? "1-thread" : "all-threads"), image_count / (archive_ns / 1e9), "images/s");
+		if (dirty != 0)
+			std::cerr << "ERROR: " << dirty << " archive images reported problems" << std::endl;
+	}
+
+	std::filesystem::remove_all(scratch);
+}
@@ -0,0 +1,112 @@
+#include "Bench.h"
+#include "Core/Core.h"
+
+#include <atomic>
+#include <fstream>
+#include <iterator>
+#include <thread>
+
+static std::vector<char> readHostFile(const std::filesystem::path &path)
+{
+	std::ifstream file(path, std::ios::binary);
+	return std::vector<char>(std::istreambuf_iterator<char>(file), {});
+}
+
+// N exporting threads share one mounted image while a writer keeps importing
+// into it. Reports export throughput per reader count and checks every
+// exported file against its source.
+void runConcurrencyBench(const BenchContext &context)
+{
+	std::filesystem::path scratch = makeScratchDirectory("concurrency");
+	std::filesystem::path sources = scratch / "src";
+	std::filesystem::path writer_sources = scratch / "writer";
+	std::filesystem::create_directories(sources);
+	std::filesystem::create_directories(writer_sources);
+	std::filesystem::path image = scratch / "shared.img";
+
+	std::vector<std::filesystem::path> files = writeRandomFiles(sources, 100, 1, 12000, 11);
+	std::vector<std::filesystem::path> writer_files = writeRandomFiles(writer_sources, 60, 1, 4000, 12);
+	for (size_t i = 0; i < writer_files.size(); i++)
+	{
+		// Distinct names so the writer never collides with the exported files
+		std::filesystem::path renamed = writer_sources / ("W" + std::to_string(i) + ".BIN");
+		std::filesystem::rename(writer_files[i], renamed);
+		writer_files[i] = renamed;
+	}
+
+	const size_t rounds_per_reader = 20;
+	const unsigned reader_counts[] = { 1, 2, 4, 8 };
+	double single_reader_throughput = 0.0;
+
+	for (unsigned readers : reader_counts)
+	{
+		std::vector<std::filesystem::path> outputs;
+		for (unsigned reader = 0; reader < readers; reader++)
+		{
+			outputs.push_back(scratch / ("out" + std::to_string(reader)));
+			std::filesystem::create_directories(outputs.back());
+		}
+
+		std::filesystem::copy_file(context.image_directory + "fat12.img", image, std::filesystem::copy_options::overwrite_existing);
+		double seconds = 0.0;
+		{
+			FAT12 fat12(image.string());
+			ScopedSilence silence;
+			for (const std::filesystem::path &file : files)
+				fat12.copyFromSystem(file.string());
+
+			std::atomic<bool> readers_done{ false };
+			std::thread writer([&]
+			{
+				for (size_t i = 0; i < writer_files.size() && !readers_done; i++)
+					fat12.copyFromSystem(writer_files[i].string());
+			});
+
+			auto start = std::chrono::steady_clock::now();
+			std::vector<std::thread> threads;
+			for (unsigned reader = 0; reader < readers; reader++)
+			{
+				threads.emplace_back([&, reader]
+				{
+					for (size_t round = 0; round < rounds_per_reader; round++)
+					{
+						for (const std::filesystem::path &file : files)
+							fat12.copyToSystem(file.filename().string(), (outputs[reader] / file.filename()).string());
+					}
+				});
+			}
+			for (std::thread &thread : threads)
+				thread.join();
+			seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			readers_done = true;
+			writer.join();
+		}
+
+		uint64_t exported_bytes = 0;
+		size_t mismatches = 0;
+		for (const std::filesystem::path &output : outputs)
+		{
+			for (const std::filesystem::path &file : files)
+			{
+				std::vector<char> exported = readHostFile(output / file.filename());
+				exported_bytes += exported.size();
+				if (exported != readHostFile(file))
+					mismatches++;
+			}
+			std::filesystem::remove_all(output);
+		}
+
+		double throughput = exported_bytes * rounds_per_reader / seconds / 1e6;
+		if (readers == 1)
+			single_reader_throughput = throughput;
+
+		std::string name = "concurrency/readers-" + std::to_string(readers);
+		report(name + "/throughput", throughput, "MB/s");
+		report(name + "/scaling", throughput / single_reader_throughput, "x");
+		report(name + "/mismatches", static_cast<double>(mismatches), "files");
+		if (mismatches > 0)
+			std::cerr << "ERROR: Concurrent exports differ from their sources." << std::endl;
+	}
+
+	std::filesystem::remove_all(scratch);
+}
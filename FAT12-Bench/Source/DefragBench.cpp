@@ -0,0 +1,99 @@
+#include "Bench.h"
+#include "Core/Core.h"
+
+#include <cstdio>
+#include <fstream>
+#include <random>
+
+// Copy of fat12.img holding files whose clusters are interleaved, so every
+// cluster of every file is an extent of its own
+static void writeInterleavedImage(const std::filesystem::path &image, size_t file_count, size_t clusters_per_file)
+{
+	std::fstream file(image, std::ios::in | std::ios::out | std::ios::binary);
+	const size_t fat_offset = 512, fat_bytes = 9 * 512, root_offset = 19 * 512, first_cluster = 100;
+
+	std::vector<std::byte> packed(fat_bytes);
+	file.seekg(fat_offset);
+	file.read(reinterpret_cast<char*>(packed.data()), packed.size());
+	std::vector<uint16_t> fat(fat_bytes * 2 / 3);
+	FatCodec::decode(packed, fat);
+
+	std::mt19937 generator(21);
+	std::vector<char> cluster(512);
+	size_t slot = 0;
+	for (size_t index = 0; index < file_count; index++)
+	{
+		for (size_t part = 0; part < clusters_per_file; part++)
+		{
+			size_t current = first_cluster + index + part * file_count;
+			fat[current] = static_cast<uint16_t>(part + 1 < clusters_per_file ? current + file_count : 0xFFF);
+			for (char &value : cluster)
+				value = static_cast<char>(generator());
+			file.seekp(StandardLayout<format_1440k>::clusterOffset(static_cast<uint32_t>(current)));
+			file.write(cluster.data(), cluster.size());
+		}
+
+		DirectoryEntry entry{};
+		for (;; slot++)
+		{
+			file.seekg(root_offset + slot * sizeof(DirectoryEntry));
+			file.read(reinterpret_cast<char*>(&entry), sizeof(entry));
+			if (entry.isFree())
+				break;
+		}
+		char name[9];
+		std::snprintf(name, sizeof(name), "FRAG%03zu", index);
+		entry = DirectoryEntry{};
+		entry.setName(name, "BIN");
+		entry.attributes = 0x20;
+		entry.first_logical_cluster = static_cast<uint16_t>(first_cluster + index);
+		entry.file_size = static_cast<uint32_t>(clusters_per_file * 512);
+		file.seekp(root_offset + slot * sizeof(DirectoryEntry));
+		file.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+	}
+
+	FatCodec::encode(fat, packed);
+	for (size_t copy = 0; copy < 2; copy++)
+	{
+		file.seekp(fat_offset + copy * fat_bytes);
+		file.write(reinterpret_cast<const char*>(packed.data()), packed.size());
+	}
+}
+
+// Export throughput of a badly fragmented image before and after defragment(),
+// and the time the defragmentation itself takes
+void runDefragBench(const BenchContext &context)
+{
+	const size_t file_count = 20, clusters_per_file = 60, iterations = 20;
+	std::filesystem::path scratch = makeScratchDirectory("defrag");
+	std::filesystem::path image = scratch / "fragmented.img";
+	std::filesystem::copy_file(context.image_directory + "fat12.img", image);
+	writeInterleavedImage(image, file_count, clusters_per_file);
+
+	const double export_mib = static_cast<double>(file_count * clusters_per_file * 512) / (1024.0 * 1024.0);
+	FAT12 fat12(image.string());
+	auto exportSeconds = [&]
+	{
+		ScopedSilence silence;
+		return measure(iterations, [&] { fat12.exportTree("/", (scratch / "out").string(), 1); }) / 1e9;
+	};
+
+	double before_seconds = exportSeconds();
+	auto start = std::chrono::steady_clock::now();
+	DefragReport defrag = fat12.defragment();
+	double defrag_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	double after_seconds = exportSeconds();
+
+	report("defrag/extents-before", defrag.extents_before, "extents");
+	report("defrag/extents-after", defrag.extents_after, "extents");
+	report("defrag/moved", defrag.moved_clusters, "clusters");
+	report("defrag/time", defrag_ms, "ms");
+	report("defrag/export-before", export_mib / before_seconds, "MiB/s");
+	report("defrag/export-after", export_mib / after_seconds, "MiB/s");
+	if (!defrag.completed)
+		std::cerr << "ERROR: Defragmenting did not complete" << std::endl;
+	if (!fat12.check().clean())
+		std::cerr << "ERROR: Defragmented image fails the consistency check" << std::endl;
+
+	std::filesystem::remove_all(scratch);
+}
@@ -0,0 +1,95 @@
+#include "Bench.h"
+#include "Core/Core.h"
+
+#include <fstream>
+#include <iterator>
+
+static std::vector<char> readHostFile(const std::filesystem::path &path)
+{
+	std::ifstream file(path, std::ios::binary);
+	return std::vector<char>(std::istreambuf_iterator<char>(file), {});
+}
+
+// Exports every file of a filled image, one call per file and then as one
+// parallel tree export per thread count, and checks each copy byte for byte
+void runExportBench(const BenchContext &context)
+{
+	std::filesystem::path scratch = makeScratchDirectory("export");
+	std::filesystem::path sources = scratch / "src";
+	std::filesystem::path exported = scratch / "out";
+	std::filesystem::create_directories(sources);
+	std::filesystem::create_directories(exported);
+	std::filesystem::path image = scratch / "full.img";
+	std::filesystem::copy_file(context.image_directory + "fat12.img", image);
+
+	// Random sizes exercise partial last clusters and multi-cluster runs
+	std::vector<std::filesystem::path> files = writeRandomFiles(sources, 200, 1, 12000, 5);
+
+	FAT12 fat12(image.string());
+	{
+		ScopedSilence silence;
+		for (const std::filesystem::path &file : files)
+			fat12.copyFromSystem(file.string());
+	}
+
+	// copyToSystem writes into the working directory
+	std::filesystem::path previous_directory = std::filesystem::current_path();
+	std::filesystem::current_path(exported);
+	const size_t iterations = 20;
+	double export_seconds = 0.0;
+	for (size_t i = 0; i < iterations; i++)
+	{
+		ScopedSilence silence;
+		auto start = std::chrono::steady_clock::now();
+		for (const std::filesystem::path &file : files)
+			fat12.copyToSystem(file.filename().string());
+		export_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+	std::filesystem::current_path(previous_directory);
+
+	size_t exported_files = 0, mismatches = 0;
+	uint64_t exported_bytes = 0;
+	for (const std::filesystem::path &file : files)
+	{
+		std::filesystem::path copy = exported / file.filename();
+		if (!std::filesystem::exists(copy))
+			continue;	// Did not fit in the image
+		exported_files++;
+		exported_bytes += std::filesystem::file_size(copy);
+		if (readHostFile(copy) != readHostFile(file))
+			mismatches++;
+	}
+
+	report("export/all/files", static_cast<double>(exported_files), "files");
+	report("export/all/throughput", exported_bytes * iterations / export_seconds / 1e6, "MB/s");
+	report("export/all/per-file", export_seconds * 1e6 / (iterations * exported_files), "us");
+	report("export/all/mismatches", static_cast<double>(mismatches), "files");
+
+	const size_t thread_counts[] = { 1, 2, 4, 8 };
+	size_t tree_mismatches = 0;
+	for (size_t threads : thread_counts)
+	{
+		std::filesystem::path tree = scratch / ("tree" + std::to_string(threads));
+		double tree_seconds = 0.0;
+		for (size_t i = 0; i < iterations; i++)
+		{
+			ScopedSilence silence;
+			auto start = std::chrono::steady_clock::now();
+			fat12.exportTree("/", tree.string(), threads);
+			tree_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		}
+
+		for (const std::filesystem::path &file : files)
+		{
+			std::filesystem::path copy = exported / file.filename();
+			if (std::filesystem::exists(copy) && readHostFile(tree / file.filename()) != readHostFile(file))
+				tree_mismatches++;
+		}
+		report("export/tree/threads-" + std::to_string(threads), exported_bytes * iterations / tree_seconds / 1e6, "MB/s");
+	}
+	report("export/tree/mismatches", static_cast<double>(tree_mismatches), "files");
+	if (mismatches + tree_mismatches > 0)
+		std::cerr << "ERROR: Exported files differ from their sources." << std::endl;
+
+	std::filesystem::remove_all(scratch);
+}
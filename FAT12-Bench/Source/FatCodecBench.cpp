@@ -0,0 +1,83 @@
+#include "Bench.h"
+#include "Core/FatCodec.h"
+
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using FatCodec::Kernel;
+
+static const Kernel kernels[] = { Kernel::Reference, Kernel::Scalar, Kernel::SSSE3, Kernel::AVX2 };
+
+// Every kernel must decode and encode exactly like the reference loop,
+// including odd entry counts and buffers without slack bytes
+static bool verifyKernel(Kernel kernel)
+{
+	std::mt19937 generator(12);
+	for (size_t count = 0; count < 200; count++)
+	{
+		std::vector<std::byte> packed(FatCodec::packedSize(count));
+		for (std::byte &value : packed)
+			value = static_cast<std::byte>(generator());
+
+		std::vector<uint16_t> expected(count), decoded(count);
+		FatCodec::decode(packed, expected, Kernel::Reference);
+		FatCodec::decode(packed, decoded, kernel);
+		if (decoded != expected)
+			return false;
+
+		// Round trip must restore the exact bytes, including a preserved trailing nibble
+		std::vector<std::byte> encoded(packed.size(), std::byte{ 0 });
+		if (count % 2 == 1)
+			encoded.back() = packed.back() & std::byte{ 0xF0 };
+		FatCodec::encode(decoded, encoded, kernel);
+		if (encoded != packed)
+			return false;
+
+		// Values wider than 12 bits are truncated like the reference
+		std::vector<uint16_t> wide(count);
+		for (uint16_t &value : wide)
+			value = static_cast<uint16_t>(generator());
+		std::vector<std::byte> wide_expected(packed.size()), wide_encoded(packed.size());
+		FatCodec::encode(wide, wide_expected, Kernel::Reference);
+		FatCodec::encode(wide, wide_encoded, kernel);
+		if (wide_encoded != wide_expected)
+			return false;
+	}
+	return true;
+}
+
+// Decode/encode throughput of each kernel over a 1.44 MB floppy FAT (9 sectors)
+void runFatCodecBench(const BenchContext &)
+{
+	const size_t entry_count = 9 * 512 * 2 / 3;
+	const size_t iterations = 20000;
+
+	std::mt19937 generator(7);
+	std::vector<std::byte> packed(FatCodec::packedSize(entry_count));
+	for (std::byte &value : packed)
+		value = static_cast<std::byte>(generator());
+	std::vector<uint16_t> entries(entry_count);
+
+	for (Kernel kernel : kernels)
+	{
+		std::string name = FatCodec::kernelName(kernel);
+		if (!FatCodec::isSupported(kernel))
+		{
+			std::cout << "fatcodec/" << name << " unsupported on this CPU" << std::endl;
+			continue;
+		}
+		if (!verifyKernel(kernel))
+		{
+			std::cerr << "ERROR: FAT codec kernel " << name << " disagrees with the reference." << std::endl;
+			std::exit(1);
+		}
+
+		double decode_ns = measure(iterations, [&] { FatCodec::decode(packed, entries, kernel); });
+		double encode_ns = measure(iterations, [&] { FatCodec::encode(entries, packed, kernel); });
+
+		report("fatcodec/decode/" + name, entry_count / decode_ns * 1000.0, "M entries/s");
+		report("fatcodec/encode/" + name, entry_count / encode_ns * 1000.0, "M entries/s");
+	}
+	std::cout << "fatcodec/selected " << FatCodec::kernelName(FatCodec::bestKernel()) << std::endl;
+}
@@ -0,0 +1,106 @@
+#include "Bench.h"
+#include "ImageGenerator.h"
+#include "Core/Core.h"
+
+#include <cstdlib>
+#include <random>
+#include <thread>
+
+using ContentHash::Kernel;
+
+static const Kernel kernels[] = { Kernel::Scalar, Kernel::AVX2 };
+
+// Every kernel must match the scalar one, one shot or fed in uneven pieces,
+// across the stripe and block boundaries
+static bool verifyKernel(Kernel kernel)
+{
+	std::mt19937 generator(31);
+	std::vector<std::byte> data(5000);
+	for (std::byte &value : data)
+		value = static_cast<std::byte>(generator());
+
+	for (size_t length = 0; length <= data.size(); length += 1 + length / 8)
+	{
+		std::span<const std::byte> input = std::span(data).first(length);
+		uint64_t expected = ContentHash::hash64(input, Kernel::Scalar);
+		ContentHash::Hasher64 hasher(kernel);
+		for (size_t offset = 0; offset < length;)
+		{
+			size_t piece = std::min<size_t>(length - offset, 1 + generator() % 1500);
+			hasher.update(input.subspan(offset, piece));
+			offset += piece;
+		}
+		if (ContentHash::hash64(input, kernel) != expected || hasher.finish() != expected)
+			return false;
+	}
+	return true;
+}
+
+// hash64 and SHA-256 over a buffer in cache, then hashFiles over a generated
+// 2.88 MB image on one thread and on every hardware thread
+void runHashBench(const BenchContext &)
+{
+	std::mt19937 generator(5);
+	std::vector<std::byte> buffer(1 << 20);
+	for (std::byte &value : buffer)
+		value = static_cast<std::byte>(generator());
+
+	for (Kernel kernel : kernels)
+	{
+		std::string name = ContentHash::kernelName(kernel);
+		if (!ContentHash::isSupported(kernel))
+		{
+			std::cout << "hash/" << name << " unsupported on this CPU" << std::endl;
+			continue;
+		}
+		if (!verifyKernel(kernel))
+		{
+			std::cerr << "ERROR: Hash kernel " << name << " disagrees with the scalar kernel." << std::endl;
+			std::exit(1);
+		}
+
+		uint64_t sink = 0;
+		double large_ns = measure(500, [&] { sink += ContentHash::hash64(buffer, kernel); });
+		double small_ns = measure(200000, [&] { sink += ContentHash::hash64(std::span(buffer).first(4096), kernel); });
+		report("hash/hash64/" + name + "/1MiB", buffer.size() / large_ns, "GB/s");
+		report("hash/hash64/" + name + "/4KiB", 4096 / small_ns, "GB/s");
+		if (sink == 0)
+			std::cerr << "ERROR: Nothing hashed" << std::endl;
+	}
+
+	double sha_ns = measure(20, [&]
+	{
+		ContentHash::Sha256 digest;
+		digest.update(buffer);
+		digest.finish();
+	});
+	report("hash/sha256/1MiB", buffer.size() / sha_ns, "GB/s");
+
+	std::filesystem::path scratch = makeScratchDirectory("hash");
+	std::filesystem::path image = scratch / "hash.img";
+	ImageSpec spec;
+	spec.format = format_2880k;
+	spec.file_count = 200;
+	spec.max_file_size = 64 * 1024;
+	spec.directory_depth = 2;
+	GeneratedImage generated;
+	if (generateImage(image, spec, generated))
+	{
+		FAT12 fat12(image.string());
+		std::vector<FileHash> hashes;
+		size_t all_threads = std::max(std::thread::hardware_concurrency(), 1u);
+		fat12.hashFiles("/", false, 1, hashes);
+
+		for (size_t threads : { size_t{ 1 }, all_threads })
+		{
+			std::string suffix = std::to_string(generated.files) + "-files/" + std::to_string(threads) + "-threads";
+			double fast_ns = measure(50, [&] { fat12.hashFiles("/", false, threads, hashes); });
+			double sha_files_ns = measure(10, [&] { fat12.hashFiles("/", true, threads, hashes); });
+			report("hash/files/hash64/" + suffix, generated.file_bytes / fast_ns, "GB/s");
+			report("hash/files/sha256/" + suffix, generated.file_bytes / sha_files_ns, "GB/s");
+			if (threads == all_threads)
+				break;
+		}
+	}
+	std::filesystem::remove_all(scratch);
+}
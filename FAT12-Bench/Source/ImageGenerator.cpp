@@ -0,0 +1,259 @@
+#include "ImageGenerator.h"
+#include "Core/FatCodec.h"
+#include "Core/ImageBuilder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+
+static const uint16_t entry_date = ((2020 - 1980) << 9) | (1 << 5) | 1;
+
+static DirectoryEntry makeEntry(const std::string &name, const std::string &ext, uint8_t attributes, uint16_t first_cluster, uint32_t size)
+{
+	DirectoryEntry entry{};
+	entry.setName(name, ext);
+	entry.attributes = attributes;
+	entry.creation_date = entry_date;
+	entry.last_access_date = entry_date;
+	entry.last_write_date = entry_date;
+	entry.first_logical_cluster = first_cluster;
+	entry.file_size = size;
+	return entry;
+}
+
+struct PlannedFile
+{
+	size_t directory;
+	std::string name;
+	std::string ext;
+	uint32_t size;
+};
+
+bool generateImage(const std::filesystem::path &image, const ImageSpec &spec, GeneratedImage &generated)
+{
+	const BootSector &boot_sector = standard_formats[spec.format].boot_sector;
+	const Layout &layout = standard_formats[spec.format].layout;
+	std::mt19937 generator(spec.seed);
+	generated = {};
+	if (spec.min_file_size > spec.max_file_size)
+	{
+		std::cerr << "ERROR: Minimum file size is above the maximum" << std::endl;
+		return false;
+	}
+
+	// Directory tree, breadth-first
+	struct PlannedDirectory
+	{
+		size_t parent;
+		size_t depth;
+		size_t children = 0;
+		size_t files = 0;
+		uint16_t first_cluster = 0;
+	};
+	std::vector<PlannedDirectory> directories{ { 0, 0 } };
+	generated.directories.push_back({ "/", 0, {} });
+	for (size_t index = 0; index < directories.size(); index++)
+	{
+		if (directories[index].depth == spec.directory_depth)
+			continue;
+		for (size_t child = 0; child < spec.directories_per_level; child++)
+		{
+			char name[9];
+			std::snprintf(name, sizeof(name), "D%02u", static_cast<unsigned>(child % 10000000));
+			directories.push_back({ index, directories[index].depth + 1 });
+			directories[index].children++;
+			std::string parent_path = index == 0 ? "" : generated.directories[index].path;
+			generated.directories.push_back({ parent_path + "/" + name, 0, {} });
+		}
+	}
+	if (directories[0].children > layout.root_entries)
+	{
+		std::cerr << "ERROR: Too many directories for the root of this format" << std::endl;
+		return false;
+	}
+
+	// Files spread over every directory; the root only takes what it has slots for
+	static const char *const extensions[] = { "BIN", "TXT", "DAT", "LOG" };
+	std::uniform_int_distribution<size_t> pick_directory(0, directories.size() - 1);
+	std::uniform_real_distribution<double> unit(0.0, 1.0);
+	std::vector<PlannedFile> files;
+	for (size_t index = 0; index < spec.file_count; index++)
+	{
+		size_t directory = pick_directory(generator);
+		if (directory == 0 && directories[0].children + directories[0].files >= layout.root_entries)
+		{
+			if (directories.size() == 1)
+			{
+				std::cerr << "ERROR: Too many files for the root of this format" << std::endl;
+				return false;
+			}
+			directory = 1 + index % (directories.size() - 1);
+		}
+		directories[directory].files++;
+
+		double position = unit(generator);
+		uint32_t size = spec.min_file_size;
+		if (spec.distribution == ImageSpec::SizeDistribution::LogUniform)
+			size = static_cast<uint32_t>(std::exp(std::log(spec.min_file_size + 1.0) + position *
+				(std::log(spec.max_file_size + 1.0) - std::log(spec.min_file_size + 1.0))) - 1.0);
+		else
+			size = spec.min_file_size + static_cast<uint32_t>(position * (spec.max_file_size - spec.min_file_size));
+
+		// Bounded to seven digits so the name always fits 8.3
+		char name[9];
+		std::snprintf(name, sizeof(name), "F%04u", static_cast<unsigned>(index % 10000000));
+		files.push_back({ directory, name, extensions[index % std::size(extensions)], std::min(size, spec.max_file_size) });
+	}
+
+	std::vector<std::byte> bytes(layout.volume_size);
+	std::vector<uint16_t> fat(layout.fat_entries, 0);
+	fat[0] = 0xF00 | boot_sector.media;
+	fat[1] = 0xFFF;
+	uint32_t next_cluster = 2;
+	const uint32_t end_cluster = layout.fat_entries;
+
+	// Directory tables come first, each in one run
+	for (size_t index = 1; index < directories.size(); index++)
+	{
+		size_t entry_count = 2 + directories[index].children + directories[index].files;
+		uint32_t clusters = static_cast<uint32_t>((entry_count * sizeof(DirectoryEntry) + layout.cluster_size - 1) / layout.cluster_size);
+		if (next_cluster + clusters > end_cluster)
+		{
+			std::cerr << "ERROR: Directories do not fit this format" << std::endl;
+			return false;
+		}
+		directories[index].first_cluster = static_cast<uint16_t>(next_cluster);
+		for (uint32_t cluster = next_cluster; cluster < next_cluster + clusters; cluster++)
+			fat[cluster] = static_cast<uint16_t>(cluster + 1 < next_cluster + clusters ? cluster + 1 : 0xFFF);
+		generated.directories[index].first_cluster = static_cast<uint16_t>(next_cluster);
+		generated.directories[index].entries.resize(clusters * layout.cluster_size / sizeof(DirectoryEntry));
+		next_cluster += clusters;
+	}
+	generated.directories[0].entries.resize(layout.root_entries);
+
+	// Slots used so far in each table
+	std::vector<size_t> used_slots(directories.size(), 2);
+	used_slots[0] = 0;
+	for (size_t index = 1; index < directories.size(); index++)
+	{
+		PlannedDirectory &directory = directories[index];
+		uint16_t parent_cluster = directories[directory.parent].first_cluster;
+		std::vector<DirectoryEntry> &entries = generated.directories[index].entries;
+		entries[0] = makeEntry(".", "", 0x10, directory.first_cluster, 0);
+		entries[1] = makeEntry("..", "", 0x10, parent_cluster, 0);
+		std::string name = generated.directories[index].path.substr(generated.directories[index].path.rfind('/') + 1);
+		generated.directories[directory.parent].entries[used_slots[directory.parent]++] = makeEntry(name, "", 0x10, directory.first_cluster, 0);
+	}
+
+	// File chains: contiguous, or for fragmented files pieces with free gaps in between
+	std::vector<std::byte> cluster_bytes(layout.cluster_size);
+	for (const PlannedFile &file : files)
+	{
+		uint32_t clusters = static_cast<uint32_t>((static_cast<uint64_t>(file.size) + layout.cluster_size - 1) / layout.cluster_size);
+		bool fragmented = clusters >= 2 && unit(generator) < spec.fragmentation;
+		uint16_t first_cluster = clusters == 0 ? 0 : static_cast<uint16_t>(next_cluster);
+		uint32_t previous = 0, piece_left = fragmented ? 1 + generator() % std::max<uint32_t>(clusters / 3, 1) : clusters;
+		uint32_t remaining_bytes = file.size;
+		for (uint32_t part = 0; part < clusters; part++)
+		{
+			if (piece_left == 0)
+			{
+				next_cluster += 1 + generator() % 3;
+				piece_left = 1 + generator() % std::max<uint32_t>(clusters / 3, 1);
+			}
+			if (next_cluster >= end_cluster)
+			{
+				std::cerr << "ERROR: Files do not fit this format" << std::endl;
+				return false;
+			}
+			if (previous != 0)
+				fat[previous] = static_cast<uint16_t>(next_cluster);
+			fat[next_cluster] = 0xFFF;
+
+			uint32_t count = std::min<uint32_t>(remaining_bytes, layout.cluster_size);
+			std::fill(cluster_bytes.begin(), cluster_bytes.end(), std::byte{ 0 });
+			for (uint32_t offset = 0; offset < count; offset++)
+				cluster_bytes[offset] = static_cast<std::byte>(generator());
+			std::copy(cluster_bytes.begin(), cluster_bytes.end(), bytes.begin() + layout.clusterOffset(next_cluster));
+			remaining_bytes -= count;
+
+			previous = next_cluster++;
+			piece_left--;
+			generated.used_clusters++;
+		}
+
+		generated.directories[file.directory].entries[used_slots[file.directory]++] =
+			makeEntry(file.name, file.ext, 0x20, first_cluster, file.size);
+		if (first_cluster != 0)
+			generated.chains.push_back(first_cluster);
+		generated.files++;
+		generated.fragmented_files += fragmented;
+		generated.file_bytes += file.size;
+	}
+	for (size_t index = 1; index < directories.size(); index++)
+		generated.used_clusters += static_cast<uint32_t>(generated.directories[index].entries.size() * sizeof(DirectoryEntry) / layout.cluster_size);
+
+	ImageBuilder::writeBootSector(boot_sector, std::span(bytes).first(layout.sector_size));
+
+	std::vector<std::byte> packed(layout.fat_size, std::byte{ 0 });
+	FatCodec::encode(fat, packed);
+	for (uint32_t copy = 0; copy < layout.fat_count; copy++)
+		std::copy(packed.begin(), packed.end(), bytes.begin() + layout.fatCopyOffset(copy));
+
+	std::memcpy(bytes.data() + layout.root_offset, generated.directories[0].entries.data(), layout.rootSize());
+	for (size_t index = 1; index < directories.size(); index++)
+	{
+		const std::vector<DirectoryEntry> &entries = generated.directories[index].entries;
+		std::memcpy(bytes.data() + layout.clusterOffset(directories[index].first_cluster), entries.data(), entries.size() * sizeof(DirectoryEntry));
+	}
+
+	std::ofstream output(image, std::ios::binary | std::ios::trunc);
+	output.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+	if (!output)
+	{
+		std::cerr << "ERROR: Failed to write " << image.string() << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool parseImageSpec(const std::string &setting, ImageSpec &spec)
+{
+	size_t separator = setting.find('=');
+	if (separator == std::string::npos)
+		return false;
+	std::string key = setting.substr(0, separator), value = setting.substr(separator + 1);
+	auto number = [&] { return std::strtoull(value.c_str(), nullptr, 10); };
+
+	if (key == "format")
+	{
+		int format = findStandardFormat(value);
+		if (format < 0)
+			return false;
+		spec.format = static_cast<StandardFormatId>(format);
+		return true;
+	}
+	if (key == "seed")
+		spec.seed = static_cast<uint32_t>(number());
+	else if (key == "files")
+		spec.file_count = number();
+	else if (key == "min")
+		spec.min_file_size = static_cast<uint32_t>(number());
+	else if (key == "max")
+		spec.max_file_size = static_cast<uint32_t>(number());
+	else if (key == "dist" && (value == "uniform" || value == "log"))
+		spec.distribution = value == "uniform" ? ImageSpec::SizeDistribution::Uniform : ImageSpec::SizeDistribution::LogUniform;
+	else if (key == "depth")
+		spec.directory_depth = number();
+	else if (key == "fanout")
+		spec.directories_per_level = number();
+	else if (key == "frag")
+		spec.fragmentation = std::strtod(value.c_str(), nullptr);
+	else
+		return false;
+	return true;
+}
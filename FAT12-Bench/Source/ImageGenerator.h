@@ -0,0 +1,53 @@
+#pragma once
+
+#include "Core/DirectoryEntry.h"
+#include "Core/Layout.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Parameters of a synthetic image; the same spec always yields the same bytes
+struct ImageSpec
+{
+	enum class SizeDistribution
+	{
+		Uniform,	// Every size in [min_file_size, max_file_size] equally likely
+		LogUniform	// Small files far more common than large ones
+	};
+
+	StandardFormatId format = format_1440k;
+	uint32_t seed = 1;
+	size_t file_count = 100;
+	uint32_t min_file_size = 0;
+	uint32_t max_file_size = 16 * 1024;
+	SizeDistribution distribution = SizeDistribution::LogUniform;
+	size_t directory_depth = 0;	// Levels of subdirectories below the root
+	size_t directories_per_level = 2;	// Subdirectories in each directory above the last level
+	double fragmentation = 0.0;	// Share of files split into scattered pieces, 0 to 1
+};
+
+struct GeneratedDirectory
+{
+	std::string path;
+	uint16_t first_cluster;	// 0 for the root
+	std::vector<DirectoryEntry> entries;	// The whole table, as written
+};
+
+struct GeneratedImage
+{
+	size_t files = 0;
+	size_t fragmented_files = 0;
+	uint64_t file_bytes = 0;
+	uint32_t used_clusters = 0;
+	std::vector<GeneratedDirectory> directories;	// Breadth-first, root first
+	std::vector<uint16_t> chains;	// First cluster of every non-empty file
+};
+
+// Writes a freshly formatted image holding the files the spec describes.
+// Fails if they do not fit the format.
+bool generateImage(const std::filesystem::path &image, const ImageSpec &spec, GeneratedImage &generated);
+
+// Applies one "key=value" setting: format, seed, files, min, max, dist, depth, fanout, frag
+bool parseImageSpec(const std::string &setting, ImageSpec &spec);
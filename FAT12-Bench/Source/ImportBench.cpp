@@ -0,0 +1,133 @@
+#include "Bench.h"
+#include "Core/Core.h"
+
+static const size_t fill_file_count = 200;
+static const size_t fill_file_size = 7000;
+
+// Allocates chains for a full image the way findFreeCluster used to: one
+// rescan from cluster 2 per cluster, plus a full count per file
+static void fillWithLinearScan(std::vector<uint16_t> &fat, uint32_t clusters_per_file)
+{
+	for (size_t file = 0; file < fill_file_count; file++)
+	{
+		uint32_t free_clusters = 0;
+		for (size_t cluster = 2; cluster < fat.size(); cluster++)
+			free_clusters += (fat[cluster] == 0);
+		if (free_clusters < clusters_per_file)
+			return;
+
+		uint16_t previous = 0;
+		for (uint32_t i = 0; i < clusters_per_file; i++)
+		{
+			uint16_t cluster = 2;
+			while (fat[cluster] != 0)
+				cluster++;
+			fat[cluster] = 0xFFF;
+			if (previous != 0)
+				fat[previous] = cluster;
+			previous = cluster;
+		}
+	}
+}
+
+static void fillWithBitmap(std::vector<uint16_t> &fat, uint32_t clusters_per_file)
+{
+	ClusterAllocator allocator;
+	allocator.reset(fat);
+	std::vector<ClusterAllocator::Extent> extents;
+	for (size_t file = 0; file < fill_file_count; file++)
+	{
+		if (!allocator.allocate(clusters_per_file, extents))
+			return;
+		for (const ClusterAllocator::Extent &extent : extents)
+		{
+			for (uint16_t cluster = extent.first; cluster < extent.first + extent.count; cluster++)
+				fat[cluster] = (cluster + 1 < extent.first + extent.count) ? cluster + 1 : 0xFFF;
+		}
+	}
+}
+
+// Fills a copy of fat12.img with many files through copyFromSystem, and
+// times the allocator on its own for the same workload
+void runImportBench(const BenchContext &context)
+{
+	std::filesystem::path scratch = makeScratchDirectory("import");
+	std::filesystem::path image = scratch / "fill.img";
+	std::filesystem::copy_file(context.image_directory + "fat12.img", image);
+
+	std::vector<std::string> sources;
+	for (const std::filesystem::path &file : writeRandomFiles(scratch, fill_file_count, fill_file_size, fill_file_size, 3))
+		sources.push_back(file.string());
+
+	double import_ms = 0.0;
+	{
+		FAT12 fat12(image.string());
+		ScopedSilence silence;
+		auto start = std::chrono::steady_clock::now();
+		for (const std::string &source : sources)
+			fat12.copyFromSystem(source);
+		import_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+	report("import/fill/total", import_ms, "ms");
+	report("import/fill/per-file", import_ms * 1000.0 / fill_file_count, "us");
+
+	// Allocator alone, on an empty 1.44 MB FAT
+	const uint32_t clusters_per_file = static_cast<uint32_t>((fill_file_size + 511) / 512);
+	const size_t iterations = 50;
+	std::vector<uint16_t> empty_fat(standard_formats[format_1440k].layout.fat_entries, 0);
+	empty_fat[0] = 0xF00 | standard_formats[format_1440k].boot_sector.media;
+	empty_fat[1] = 0xFFF;
+
+	double linear_ns = measure(iterations, [&] { std::vector<uint16_t> fat = empty_fat; fillWithLinearScan(fat, clusters_per_file); });
+	double bitmap_ns = measure(iterations, [&] { std::vector<uint16_t> fat = empty_fat; fillWithBitmap(fat, clusters_per_file); });
+	report("import/allocator/linear-scan", linear_ns / 1000.0, "us per fill");
+	report("import/allocator/bitmap", bitmap_ns / 1000.0, "us per fill");
+
+	// Streaming throughput for one large file into a fresh image
+	const size_t large_file_size = 1300 * 1000;
+	std::filesystem::path large_source = scratch / "large";
+	std::filesystem::create_directory(large_source);
+	large_source = writeRandomFiles(large_source, 1, large_file_size, large_file_size, 4).front();
+
+	const size_t large_iterations = 20;
+	double large_seconds = 0.0;
+	for (size_t i = 0; i < large_iterations; i++)
+	{
+		std::filesystem::copy_file(context.image_directory + "fat12.img", image, std::filesystem::copy_options::overwrite_existing);
+		FAT12 fat12(image.string());
+		ScopedSilence silence;
+		auto start = std::chrono::steady_clock::now();
+		fat12.copyFromSystem(large_source.string());
+		large_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+	report("import/stream/throughput", large_file_size * large_iterations / large_seconds / 1e6, "MB/s");
+
+	// The same small files again, one call per file against one batch transaction
+	const size_t batch_iterations = 20;
+	double per_file_ms = 0.0, batch_ms = 0.0;
+	for (size_t i = 0; i < batch_iterations; i++)
+	{
+		std::filesystem::copy_file(context.image_directory + "fat12.img", image, std::filesystem::copy_options::overwrite_existing);
+		{
+			FAT12 fat12(image.string());
+			ScopedSilence silence;
+			auto start = std::chrono::steady_clock::now();
+			for (const std::string &source : sources)
+				fat12.copyFromSystem(source);
+			per_file_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+
+		std::filesystem::copy_file(context.image_directory + "fat12.img", image, std::filesystem::copy_options::overwrite_existing);
+		{
+			FAT12 fat12(image.string());
+			ScopedSilence silence;
+			auto start = std::chrono::steady_clock::now();
+			fat12.importBatch(sources, "/");
+			batch_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+	}
+	report("import/batch/per-file-calls", per_file_ms / batch_iterations, "ms");
+	report("import/batch/one-transaction", batch_ms / batch_iterations, "ms");
+
+	std::filesystem::remove_all(scratch);
+}
@@ -0,0 +1,34 @@
+#include "Bench.h"
+#include "Core/Core.h"
+
+// Cost of one counter event and one timed scope on the calling thread. Builds
+// without FAT12_INSTRUMENTATION report the empty loop.
+void runInstrumentationBench(const BenchContext &)
+{
+	const size_t iterations = 10'000'000;
+	report("instrumentation/compiled-in", Instrumentation::compiled_in ? 1.0 : 0.0, "");
+
+	uint64_t sink = 0;
+	report("instrumentation/count", measure(iterations, [&]
+	{
+		FAT12_COUNT(clusters_walked, 1);
+		sink++;
+	}), "ns/event");
+	report("instrumentation/scoped-timer", measure(iterations / 10, [&]
+	{
+		FAT12_TIME(sync);
+		sink++;
+	}), "ns/scope");
+
+	Instrumentation::setTracing(true);
+	report("instrumentation/scoped-timer-traced", measure(iterations / 100, [&]
+	{
+		FAT12_TIME(sync);
+		sink++;
+	}), "ns/scope");
+	Instrumentation::setTracing(false);
+
+	Instrumentation::reset();
+	if (sink == 0)
+		std::cerr << "ERROR: Nothing measured" << std::endl;
+}
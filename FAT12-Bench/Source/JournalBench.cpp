@@ -0,0 +1,66 @@
+#include "Bench.h"
+#include "Core/Core.h"
+
+static const size_t journal_file_count = 50;
+
+// Cost of making each import crash safe: no protection at all, a synced copy of
+// the whole image before every import (the approach the journal replaces), and
+// the metadata journal, per import and with one transaction for the whole batch
+void runJournalBench(const BenchContext &context)
+{
+	std::filesystem::path scratch = makeScratchDirectory("journal");
+	std::filesystem::path image = scratch / "journal.img";
+	std::filesystem::path backup = scratch / "journal.img.backup";
+
+	std::vector<std::string> sources;
+	for (const std::filesystem::path &file : writeRandomFiles(scratch, journal_file_count, 100, 3000, 19))
+		sources.push_back(file.string());
+
+	// Copies the image aside and syncs the copy before every import, then syncs the image
+	auto copyBeforeWrite = [&](FAT12 &fat12, const std::string &source)
+	{
+		std::filesystem::copy_file(image, backup, std::filesystem::copy_options::overwrite_existing);
+		File backup_file;
+		backup_file.open(backup.string(), File::Mode::ReadWrite);
+		backup_file.sync();
+		fat12.copyFromSystem(source);
+		File image_file;
+		image_file.open(image.string(), File::Mode::ReadWrite);
+		image_file.sync();
+	};
+
+	enum class Mode { Unprotected, CopyBeforeWrite, Journal, JournalBatch };
+	const std::pair<const char*, Mode> modes[] =
+	{
+		{ "unprotected", Mode::Unprotected },
+		{ "copy-before-write", Mode::CopyBeforeWrite },
+		{ "journal", Mode::Journal },
+		{ "journal-batch", Mode::JournalBatch },
+	};
+	for (const auto &[name, mode] : modes)
+	{
+		std::filesystem::copy_file(context.image_directory + "fat12.img", image, std::filesystem::copy_options::overwrite_existing);
+		MountOptions options;
+		options.journal = mode == Mode::Journal || mode == Mode::JournalBatch;
+		options.deferred_sync = mode == Mode::JournalBatch;
+
+		double import_us = 0;
+		{
+			FAT12 fat12(image.string(), options);
+			ScopedSilence silence;
+			auto start = std::chrono::steady_clock::now();
+			for (const std::string &source : sources)
+			{
+				if (mode == Mode::CopyBeforeWrite)
+					copyBeforeWrite(fat12, source);
+				else
+					fat12.copyFromSystem(source);
+			}
+			fat12.sync();
+			import_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / sources.size();
+		}
+		report(std::string("journal/") + name, import_us, "us/import");
+	}
+
+	std::filesystem::remove_all(scratch);
+}
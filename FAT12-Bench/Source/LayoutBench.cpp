@@ -0,0 +1,48 @@
+#include "Bench.h"
+#include "Core/Core.h"
+
+#include <random>
+
+// Cluster-to-offset translation with the layout folded to constants (a standard
+// format known at compile time) versus a layout derived at runtime, and the
+// cost of deriving a layout versus looking a standard format up
+void runLayoutBench(const BenchContext &)
+{
+	const size_t cluster_count = 1 << 20, iterations = 20;
+	std::mt19937 generator(21);
+	std::vector<uint32_t> clusters(cluster_count);
+	for (uint32_t &cluster : clusters)
+		cluster = 2 + generator() % standard_formats[format_1440k].layout.cluster_count;
+
+	// Read through a volatile pointer so the compiler cannot fold the runtime layout either
+	Layout derived = Layout::derive(standard_formats[format_1440k].boot_sector);
+	Layout *volatile runtime_layout = &derived;
+
+	uint64_t checksum = 0;
+	double fixed_ns = measure(iterations, [&]
+	{
+		for (uint32_t cluster : clusters)
+			checksum += StandardLayout<format_1440k>::clusterOffset(cluster);
+	});
+	double runtime_ns = measure(iterations, [&]
+	{
+		const Layout &layout = *runtime_layout;
+		for (uint32_t cluster : clusters)
+			checksum += layout.clusterOffset(cluster);
+	});
+	report("layout/offset/constant", fixed_ns / cluster_count, "ns/cluster");
+	report("layout/offset/runtime", runtime_ns / cluster_count, "ns/cluster");
+
+	// A hard-disk style geometry no table entry matches, next to a standard one
+	BootSector hard_disk{ 512, 16, 1, 2, 512, 32768, 7 };
+	BootSector floppy = standard_formats[format_1440k].boot_sector;
+	BootSector *volatile boot_sectors[] = { &floppy, &hard_disk };
+	const size_t layout_iterations = 1000000;
+	double standard_ns = measure(layout_iterations, [&] { checksum += layoutFor(*boot_sectors[0]).data_offset; });
+	double generic_ns = measure(layout_iterations, [&] { checksum += layoutFor(*boot_sectors[1]).data_offset; });
+	report("layout/derive/standard", standard_ns, "ns");
+	report("layout/derive/generic", generic_ns, "ns");
+
+	if (checksum == 0)
+		std::cerr << "ERROR: Layout bench produced no offsets" << std::endl;
+}
@@ -0,0 +1,124 @@
+#include "Bench.h"
+#include "Core/Core.h"
+
+#include <cstdio>
+#include <fstream>
+
+static const size_t wide_directories = 200;
+
+static DirectoryEntry makeEntry(const std::string &name, uint8_t attributes, uint16_t first_cluster)
+{
+	DirectoryEntry entry{};
+	entry.setName(name, attributes == 0x10 ? "" : "TXT");
+	entry.attributes = attributes;
+	entry.first_logical_cluster = first_cluster;
+	return entry;
+}
+
+void writeWideImage(const std::filesystem::path &image)
+{
+	std::fstream file(image, std::ios::in | std::ios::out | std::ios::binary);
+	const size_t fat_offset = 512, fat_bytes = 9 * 512, root_offset = 19 * 512, first_cluster = 100;
+
+	std::vector<std::byte> packed(fat_bytes);
+	file.seekg(fat_offset);
+	file.read(reinterpret_cast<char*>(packed.data()), packed.size());
+	std::vector<uint16_t> fat(fat_bytes * 2 / 3);
+	FatCodec::decode(packed, fat);
+
+	size_t directory = 0;
+	for (size_t slot = 0; slot < 224 && directory < wide_directories; slot++)
+	{
+		DirectoryEntry entry{};
+		file.seekg(root_offset + slot * sizeof(DirectoryEntry));
+		file.read(reinterpret_cast<char*>(&entry), sizeof(entry));
+		if (!entry.isFree())
+			continue;
+
+		char name[9];
+		std::snprintf(name, sizeof(name), "DIR%03zu", directory);
+		uint16_t cluster = static_cast<uint16_t>(first_cluster + directory);
+		entry = makeEntry(name, 0x10, cluster);
+		file.seekp(root_offset + slot * sizeof(DirectoryEntry));
+		file.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+
+		std::vector<DirectoryEntry> table(16);
+		table[0] = makeEntry(".", 0x10, cluster);
+		table[1] = makeEntry("..", 0x10, 0);
+		for (size_t i = 2; i < table.size(); i++)
+		{
+			std::snprintf(name, sizeof(name), "FILE%02zu", i);
+			table[i] = makeEntry(name, 0x20, 0);
+		}
+		file.seekp(StandardLayout<format_1440k>::clusterOffset(cluster));
+		file.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(DirectoryEntry));
+		fat[cluster] = 0xFFF;
+		directory++;
+	}
+
+	FatCodec::encode(fat, packed);
+	for (size_t copy = 0; copy < 2; copy++)
+	{
+		file.seekp(fat_offset + copy * fat_bytes);
+		file.write(reinterpret_cast<const char*>(packed.data()), packed.size());
+	}
+}
+
+// Mount latency of each block-device backend on the checked-in images, and
+// eager against lazy directory loading: the mount alone, then the mount plus
+// the first read of a file in a subdirectory. Also times status on the wide image.
+void runMountBench(const BenchContext &context)
+{
+	const size_t iterations = 2000;
+	const char *images[] = { "fat12.img", "fat12subdir.img" };
+
+	for (const char *image : images)
+	{
+		std::string path = context.image_directory + image;
+		if (!std::filesystem::exists(path))
+		{
+			std::cerr << "ERROR: Missing benchmark image: " << path << std::endl;
+			continue;
+		}
+
+		MountOptions mapped;
+		mapped.backend = BlockDevice::Backend::Mapped;
+		MountOptions stream;
+		stream.backend = BlockDevice::Backend::Stream;
+
+		double mapped_ns = measure(iterations, [&] { FAT12 fat12(path, mapped); });
+		double stream_ns = measure(iterations, [&] { FAT12 fat12(path, stream); });
+
+		report(std::string("mount/mapped/") + image, mapped_ns / 1000.0, "us");
+		report(std::string("mount/stream/") + image, stream_ns / 1000.0, "us");
+	}
+
+	std::filesystem::path scratch = makeScratchDirectory("mount");
+	std::filesystem::path wide_image = scratch / "wide.img";
+	std::filesystem::copy_file(context.image_directory + "fat12.img", wide_image);
+	writeWideImage(wide_image);
+
+	MountOptions eager, lazy;
+	lazy.lazy_directories = true;
+	const std::string wide_path = wide_image.string();
+	const std::string file_path = "/DIR123/FILE07.TXT";
+	std::vector<std::byte> data;
+
+	for (const auto &[mode, options] : { std::pair{ "eager", eager }, std::pair{ "lazy", lazy } })
+	{
+		double mount_ns = measure(iterations, [&] { FAT12 fat12(wide_path, options); });
+		double first_command_ns = measure(iterations, [&] { FAT12 fat12(wide_path, options); fat12.readAt(file_path, 0, 1, data); });
+
+		report(std::string("mount/") + mode + "/wide.img", mount_ns / 1000.0, "us");
+		report(std::string("mount/") + mode + "/wide.img+first-command", first_command_ns / 1000.0, "us");
+	}
+
+	// status reads the cluster counts; the deep pass walks every directory and chain
+	FAT12 mounted(wide_path, eager);
+	double usage_ns = measure(iterations, [&] { mounted.diskUsage(); });
+	double details_ns = measure(iterations / 10, [&] { mounted.spaceDetails(); });
+	report("status/counted/wide.img", usage_ns / 1000.0, "us");
+	report("status/deep/wide.img", details_ns / 1000.0, "us");
+
+	std::filesystem::remove_all(scratch);
+}
@@ -0,0 +1,65 @@
+#include "Bench.h"
+#include "Core/Core.h"
+
+static const size_t overlay_session_count = 200;
+
+// Per-job cost of writing to a shared base image: copying the whole image for
+// every job versus an overlay session whose delta only holds the changed
+// sectors. Each job imports one small file; snapshots branch a session off.
+void runOverlayBench(const BenchContext &context)
+{
+	std::filesystem::path scratch = makeScratchDirectory("overlay");
+	std::filesystem::path base = scratch / "base.img";
+	std::filesystem::copy_file(context.image_directory + "fat12.img", base);
+	std::string source = writeRandomFiles(scratch, 1, 2000, 2000, 20).front().string();
+
+	auto sessionPath = [&](const char *prefix, size_t session)
+	{
+		return (scratch / (prefix + std::to_string(session))).string();
+	};
+	auto totalSize = [&](const char *prefix)
+	{
+		uint64_t bytes = 0;
+		for (size_t session = 0; session < overlay_session_count; session++)
+			bytes += std::filesystem::file_size(sessionPath(prefix, session));
+		return bytes;
+	};
+
+	double copy_us, overlay_us, snapshot_us;
+	uint64_t copy_bytes, delta_bytes;
+	{
+		ScopedSilence silence;
+		copy_us = measure(overlay_session_count, [&, session = size_t{ 0 }]() mutable
+		{
+			std::string image = sessionPath("copy", session++);
+			std::filesystem::copy_file(base, image);
+			FAT12 fat12(image);
+			fat12.copyFromSystem(source);
+		}) / 1e3;
+		copy_bytes = totalSize("copy");
+
+		MountOptions options;
+		overlay_us = measure(overlay_session_count, [&, session = size_t{ 0 }]() mutable
+		{
+			options.overlay = sessionPath("delta", session++);
+			FAT12 fat12(base.string(), options);
+			fat12.copyFromSystem(source);
+		}) / 1e3;
+		delta_bytes = totalSize("delta");
+
+		options.overlay = sessionPath("delta", 0);
+		FAT12 branched(base.string(), options);
+		snapshot_us = measure(overlay_session_count, [&, session = size_t{ 0 }]() mutable
+		{
+			branched.snapshotOverlay(sessionPath("branch", session++));
+		}) / 1e3;
+	}
+
+	report("overlay/copy-session", copy_us, "us/job");
+	report("overlay/copy-bytes", static_cast<double>(copy_bytes) / overlay_session_count / 1024.0, "KiB/job");
+	report("overlay/overlay-session", overlay_us, "us/job");
+	report("overlay/delta-bytes", static_cast<double>(delta_bytes) / overlay_session_count / 1024.0, "KiB/job");
+	report("overlay/snapshot", snapshot_us, "us");
+
+	std::filesystem::remove_all(scratch);
+}
@@ -0,0 +1,89 @@
+#include "Bench.h"
+#include "Core/Core.h"
+
+#include <fstream>
+#include <random>
+
+static const uint16_t fragment_count = 1200;
+
+// Adds FRAG.BIN to a copy of fat12.img, stored on every other cluster from
+// cluster 100 so its chain has one extent per cluster
+static void writeFragmentedImage(const std::filesystem::path &image)
+{
+	std::fstream file(image, std::ios::in | std::ios::out | std::ios::binary);
+	const size_t fat_offset = 512, fat_bytes = 9 * 512, root_offset = 19 * 512;
+
+	std::vector<std::byte> packed(fat_bytes);
+	file.seekg(fat_offset);
+	file.read(reinterpret_cast<char*>(packed.data()), packed.size());
+	std::vector<uint16_t> fat(fat_bytes * 2 / 3);
+	FatCodec::decode(packed, fat);
+
+	for (uint16_t i = 0; i < fragment_count; i++)
+	{
+		uint16_t cluster = 100 + i * 2;
+		fat[cluster] = (i + 1 < fragment_count) ? cluster + 2 : 0xFFF;
+	}
+	FatCodec::encode(fat, packed);
+	for (size_t copy = 0; copy < 2; copy++)
+	{
+		file.seekp(fat_offset + copy * fat_bytes);
+		file.write(reinterpret_cast<const char*>(packed.data()), packed.size());
+	}
+
+	// First end-of-directory slot of the root directory
+	DirectoryEntry entry{};
+	for (size_t slot = 0; slot < 224; slot++)
+	{
+		file.seekg(root_offset + slot * sizeof(DirectoryEntry));
+		file.read(reinterpret_cast<char*>(&entry), sizeof(entry));
+		if (entry.isEndOfDirectory())
+		{
+			entry = DirectoryEntry{};
+			entry.setName("FRAG", "BIN");
+			entry.attributes = 0x20;
+			entry.first_logical_cluster = 100;
+			entry.file_size = fragment_count * 512u;
+			file.seekp(root_offset + slot * sizeof(DirectoryEntry));
+			file.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+			break;
+		}
+	}
+}
+
+// Header peeks inside a heavily fragmented file: the first read resolves the
+// chain, later reads seek through the cached extent list
+void runPeekBench(const BenchContext &context)
+{
+	std::filesystem::path scratch = makeScratchDirectory("peek");
+	std::filesystem::path image = scratch / "fragmented.img";
+	std::filesystem::copy_file(context.image_directory + "fat12.img", image);
+	writeFragmentedImage(image);
+
+	const size_t iterations = 2000;
+	std::vector<std::byte> data;
+	double first_read_ns = 0.0;
+	for (size_t i = 0; i < iterations / 10; i++)
+	{
+		FAT12 fat12(image.string());
+		first_read_ns += measure(1, [&] { fat12.readAt("FRAG.BIN", fragment_count * 512u - 64, 64, data); });
+	}
+	first_read_ns /= iterations / 10;
+
+	FAT12 fat12(image.string());
+	std::mt19937 generator(9);
+	std::uniform_int_distribution<uint32_t> offsets(0, fragment_count * 512u - 64);
+	size_t read_bytes = 0;
+	double cached_ns = measure(iterations, [&]
+	{
+		fat12.readAt("FRAG.BIN", offsets(generator), 64, data);
+		read_bytes += data.size();
+	});
+
+	report("peek/fragmented/first-read", first_read_ns / 1000.0, "us");
+	report("peek/fragmented/cached-random", cached_ns / 1000.0, "us");
+	if (read_bytes != iterations * 64)
+		std::cerr << "ERROR: Short reads from the fragmented file." << std::endl;
+
+	std::filesystem::remove_all(scratch);
+}
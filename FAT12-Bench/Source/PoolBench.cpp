@@ -0,0 +1,72 @@
+#include "Bench.h"
+#include "Core/ImagePool.h"
+
+#include <system_error>
+
+// Lists every image of an archive of identical floppies: one fresh mount per
+// image, against an ImagePool on one and on all hardware threads. A second
+// pass over a working set smaller than the budget reuses the idle mounts.
+void runPoolBench(const BenchContext &context)
+{
+	const size_t image_count = 1000;
+	std::filesystem::path scratch = makeScratchDirectory("pool");
+	std::filesystem::path original = scratch / "original.img";
+	std::filesystem::copy_file(context.image_directory + "fat12subdir.img", original);
+
+	// Hard links keep the archive small on disk; every path still mounts on its own
+	std::vector<std::string> images;
+	for (size_t i = 0; i < image_count; i++)
+	{
+		std::filesystem::path image = scratch / ("IMG" + std::to_string(i) + ".img");
+		std::error_code error;
+		std::filesystem::create_hard_link(original, image, error);
+		if (error)
+			std::filesystem::copy_file(original, image);
+		images.push_back(image.string());
+	}
+
+	NullBuffer discarded;
+	std::ostream null_stream(&discarded);
+	MountOptions lazy;
+	lazy.lazy_directories = true;
+
+	double sequential_ns = measure(1, [&]
+	{
+		for (const std::string &image : images)
+		{
+			FAT12 fat12(image, lazy);
+			fat12.LS("/", null_stream);
+		}
+	});
+	report("pool/fresh-mount-per-image", sequential_ns / image_count / 1000.0, "us/image");
+
+	for (size_t threads : { size_t{ 1 }, size_t{ 0 } })
+	{
+		ImagePool::Options options;
+		options.mount = lazy;
+		options.max_open = 16;
+		ImagePool pool(options);
+		size_t failed = 0;
+		double pooled_ns = measure(1, [&]
+		{
+			failed = pool.forEach(images, [&](const std::string &, FAT12 &fat12) { fat12.LS("/", null_stream); }, threads);
+		});
+
+		std::string name = std::string("pool/for-each-") + (threads == 1 ? "1-thread" : "all-threads");
+		report(name, pooled_ns / image_count / 1000.0, "us/image");
+		report(name + "/snapshot-hits", static_cast<double>(pool.snapshots().hits()), "mounts");
+		if (failed != 0 || pool.openCount() > options.max_open)
+			std::cerr << "ERROR: Pool failed " << failed << " images with " << pool.openCount() << " open" << std::endl;
+
+		// Working set within the budget: every acquire after the first pass is an idle hit
+		std::vector<std::string> working_set(images.begin(), images.begin() + options.max_open / 2);
+		pool.forEach(working_set, [&](const std::string &, FAT12 &) {}, threads);
+		double reuse_ns = measure(20, [&]
+		{
+			pool.forEach(working_set, [&](const std::string &, FAT12 &fat12) { fat12.LS("/", null_stream); }, threads);
+		});
+		report(name + "/reused-mounts", reuse_ns / working_set.size() / 1000.0, "us/image");
+	}
+
+	std::filesystem::remove_all(scratch);
+}
@@ -0,0 +1,43 @@
+#include "Bench.h"
+#include "Core/Core.h"
+
+static const size_t batch_file_count = 100;
+
+// Imports a batch of small files and reports how many metadata bytes reach
+// the image: whole-table rewrites per import (the old behaviour, computed),
+// dirty sectors synced after each import, and one sync for the whole batch
+void runSyncBench(const BenchContext &context)
+{
+	std::filesystem::path scratch = makeScratchDirectory("sync");
+	std::filesystem::path image = scratch / "batch.img";
+
+	std::vector<std::string> sources;
+	for (const std::filesystem::path &file : writeRandomFiles(scratch, batch_file_count, 100, 3000, 10))
+		sources.push_back(file.string());
+
+	// Packed FAT plus the 224-slot root directory, once per import
+	const double full_rewrite_bytes = batch_file_count * (FatCodec::packedSize(2731) + 224.0 * sizeof(DirectoryEntry));
+	report("sync/batch/full-rewrite", full_rewrite_bytes / 1024.0, "KiB (computed)");
+
+	MountOptions per_import, deferred;
+	deferred.deferred_sync = true;
+	for (const auto &[mode, options] : { std::pair{ "per-import", per_import }, std::pair{ "deferred", deferred } })
+	{
+		std::filesystem::copy_file(context.image_directory + "fat12.img", image, std::filesystem::copy_options::overwrite_existing);
+		FAT12 fat12(image.string(), options);
+
+		auto start = std::chrono::steady_clock::now();
+		{
+			ScopedSilence silence;
+			for (const std::string &source : sources)
+				fat12.copyFromSystem(source);
+			fat12.sync();
+		}
+		double batch_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		report(std::string("sync/batch/") + mode, fat12.metadataBytesWritten() / 1024.0, "KiB");
+		report(std::string("sync/batch/") + mode + "-time", batch_ms, "ms");
+	}
+
+	std::filesystem::remove_all(scratch);
+}
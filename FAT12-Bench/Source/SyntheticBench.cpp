@@ -0,0 +1,123 @@
+#include "Bench.h"
+#include "ImageGenerator.h"
+#include "Core/Core.h"
+
+struct SyntheticCase
+{
+	const char *name;
+	ImageSpec spec;
+};
+
+static std::vector<SyntheticCase> syntheticCases()
+{
+	ImageSpec flat;
+	flat.file_count = 150;
+	flat.max_file_size = 12 * 1024;
+
+	ImageSpec deep;
+	deep.file_count = 200;
+	deep.directory_depth = 3;
+	deep.directories_per_level = 3;
+
+	ImageSpec fragmented;
+	fragmented.format = format_2880k;
+	fragmented.file_count = 300;
+	fragmented.directory_depth = 2;
+	fragmented.fragmentation = 0.6;
+
+	return { { "flat", flat }, { "deep", deep }, { "fragmented", fragmented } };
+}
+
+// Micro and macro benchmarks over generated images: FAT decode/encode,
+// directory parsing and chain walks, then mount, ls, export-all, a batch
+// import and status, each with throughput and p50/p99 latency
+void runSyntheticBench(const BenchContext &)
+{
+	std::filesystem::path scratch = makeScratchDirectory("synthetic");
+	std::vector<std::string> import_sources;
+	for (const std::filesystem::path &file : writeRandomFiles(scratch, 20, 100, 4000, 22))
+		import_sources.push_back(file.string());
+	NullBuffer discarded;
+	std::ostream null_stream(&discarded);
+
+	for (const SyntheticCase &synthetic : syntheticCases())
+	{
+		const std::string prefix = std::string("synthetic/") + synthetic.name;
+		std::filesystem::path image = scratch / (std::string(synthetic.name) + ".img");
+		GeneratedImage generated;
+		if (!generateImage(image, synthetic.spec, generated))
+			continue;
+		const Layout &layout = standard_formats[synthetic.spec.format].layout;
+
+		// FAT codec over the image's own FAT
+		std::vector<std::byte> packed(FatCodec::packedSize(layout.fat_entries));
+		{
+			std::ifstream input(image, std::ios::binary);
+			input.seekg(static_cast<std::streamoff>(layout.fat_offset));
+			input.read(reinterpret_cast<char*>(packed.data()), packed.size());
+		}
+		std::vector<uint16_t> fat(layout.fat_entries);
+		const double fat_mib = packed.size() / (1024.0 * 1024.0);
+		reportLatency(prefix + "/fat-decode", measureLatency(2000, [&] { FatCodec::decode(packed, fat); }), fat_mib, "MiB");
+		reportLatency(prefix + "/fat-encode", measureLatency(2000, [&] { FatCodec::encode(fat, packed); }), fat_mib, "MiB");
+
+		// Directory parsing: every table attached and indexed
+		size_t entry_count = 0;
+		for (const GeneratedDirectory &directory : generated.directories)
+			entry_count += directory.entries.size();
+		DirectoryTree tree;
+		reportLatency(prefix + "/dir-parse", measureLatency(500, [&]
+		{
+			tree.reset();
+			for (const GeneratedDirectory &directory : generated.directories)
+			{
+				uint32_t node = directory.first_cluster == 0 ? DirectoryTree::root : tree.find(directory.path);
+				tree.attachTable(node, directory.first_cluster, directory.entries);
+				tree.addChildren(node);
+			}
+		}), static_cast<double>(entry_count), "entries");
+
+		// Chain walks of every file
+		ChainCache::Chain chain;
+		uint64_t walked = 0;
+		Latency walk = measureLatency(500, [&]
+		{
+			for (uint16_t first_cluster : generated.chains)
+			{
+				ChainCache::resolve(first_cluster, fat, chain);
+				walked += chain.size();
+			}
+		});
+		reportLatency(prefix + "/chain-walk", walk, static_cast<double>(generated.used_clusters), "clusters");
+
+		const double image_mib = generated.file_bytes / (1024.0 * 1024.0);
+		reportLatency(prefix + "/mount", measureLatency(100, [&] { FAT12 fat12(image.string()); }), 1.0, "mounts");
+
+		FAT12 fat12(image.string());
+		reportLatency(prefix + "/ls", measureLatency(100, [&] { fat12.LS("/", null_stream); }), 1.0, "listings");
+		reportLatency(prefix + "/status", measureLatency(100, [&] { fat12.analyzeDisk(null_stream); }), 1.0, "reports");
+		std::filesystem::path exported = scratch / "out";
+		reportLatency(prefix + "/export-all", measureLatency(10, [&] { fat12.exportTree("/", exported.string(), 1, null_stream); }), image_mib, "MiB");
+		std::filesystem::remove_all(exported);
+
+		// Each batch goes into a fresh copy; only the import itself is timed
+		std::filesystem::path copy = scratch / "import.img";
+		uint64_t import_bytes = 0;
+		for (const std::string &source : import_sources)
+			import_bytes += std::filesystem::file_size(source);
+		std::vector<double> samples;
+		for (size_t iteration = 0; iteration < 10; iteration++)
+		{
+			std::filesystem::copy_file(image, copy, std::filesystem::copy_options::overwrite_existing);
+			FAT12 target(copy.string());
+			auto start = std::chrono::steady_clock::now();
+			target.importBatch(import_sources, "/");
+			samples.push_back(std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count());
+		}
+		reportLatency(prefix + "/import-batch", summarize(std::move(samples)), import_bytes / (1024.0 * 1024.0), "MiB");
+		if (walked == 0)
+			std::cerr << "ERROR: Generated image has no chains" << std::endl;
+	}
+
+	std::filesystem::remove_all(scratch);
+}
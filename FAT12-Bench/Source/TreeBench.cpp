@@ -0,0 +1,102 @@
+#include "Bench.h"
+#include "Core/Core.h"
+
+#include <cstdio>
+#include <random>
+
+static const size_t tree_directories = 64;
+static const size_t tree_files_per_directory = 120;
+
+static DirectoryEntry makeEntry(const std::string &name, const std::string &ext, uint8_t attributes)
+{
+	DirectoryEntry entry{};
+	entry.setName(name, ext);
+	entry.attributes = attributes;
+	return entry;
+}
+
+static std::string numbered(const char *prefix, size_t number)
+{
+	char name[9];
+	std::snprintf(name, sizeof(name), "%s%03zu", prefix, number);
+	return name;
+}
+
+// Root with one chain of nested directories, each holding the same file names
+static void buildTree(DirectoryTree &tree)
+{
+	std::vector<DirectoryEntry> root(224);
+	root[0] = makeEntry("D000", "", 0x10);
+	tree.reset();
+	tree.attachTable(DirectoryTree::root, 0, std::move(root));
+	tree.addChildren(DirectoryTree::root);
+
+	uint32_t directory = tree.find("/D000");
+	for (size_t depth = 0; depth < tree_directories; depth++)
+	{
+		std::vector<DirectoryEntry> entries(tree_files_per_directory + 1);
+		for (size_t i = 0; i < tree_files_per_directory; i++)
+			entries[i] = makeEntry(numbered("F", i), "TXT", 0x20);
+		entries[tree_files_per_directory] = makeEntry(numbered("D", depth + 1), "", 0x10);
+		tree.attachTable(directory, 0, std::move(entries));
+		tree.addChildren(directory);
+		directory = tree.find(tree.node(directory).path + "/" + numbered("D", depth + 1));
+	}
+}
+
+// Path lookups in a deep tree: the hashed index against matching the path
+// segment by segment through every table on the way, as findFile used to
+void runTreeBench(const BenchContext &)
+{
+	DirectoryTree tree;
+	buildTree(tree);
+
+	std::vector<std::string> paths;
+	std::mt19937 generator(8);
+	for (size_t i = 0; i < 1000; i++)
+	{
+		std::string path;
+		size_t depth = generator() % tree_directories;
+		for (size_t level = 0; level <= depth; level++)
+			path += "/" + numbered("D", level);
+		paths.push_back(path + "/" + numbered("F", generator() % tree_files_per_directory) + ".TXT");
+	}
+
+	size_t next = 0, found = 0;
+	double hashed_ns = measure(paths.size() * 20, [&] { found += tree.find(paths[next++ % paths.size()]) != DirectoryTree::no_node; });
+
+	next = 0;
+	double scanned_ns = measure(paths.size() * 20, [&]
+	{
+		const std::string &path = paths[next++ % paths.size()];
+		uint32_t directory = DirectoryTree::root;
+		for (size_t start = 1; directory != DirectoryTree::no_node;)
+		{
+			size_t end = path.find('/', start);
+			std::string name = path.substr(start, end == std::string::npos ? std::string::npos : end - start);
+			const std::vector<DirectoryEntry> &entries = tree.entries(directory);
+			uint32_t match = DirectoryTree::no_node;
+			for (uint32_t child = tree.node(directory).first_child; child != DirectoryTree::no_node; child = tree.node(child).next_sibling)
+			{
+				if (entries[tree.node(child).slot].hasFullName(name))
+				{
+					match = child;
+					break;
+				}
+			}
+			if (end == std::string::npos)
+			{
+				found += match != DirectoryTree::no_node;
+				break;
+			}
+			directory = (match != DirectoryTree::no_node && tree.isLoaded(match)) ? match : DirectoryTree::no_node;
+			start = end + 1;
+		}
+	});
+
+	report("tree/lookup/nodes", static_cast<double>(tree.nodeCount()), "nodes");
+	report("tree/lookup/hashed", hashed_ns, "ns");
+	report("tree/lookup/scan", scanned_ns, "ns");
+	if (found != paths.size() * 40)
+		std::cerr << "ERROR: Lookups missed existing paths." << std::endl;
+}
@@ -0,0 +1,109 @@
+#include "BlockDevice.h"
+#include "Instrumentation.h"
+
+#include <algorithm>
+#include <iostream>
+
+std::unique_ptr<BlockDevice> BlockDevice::open(const std::string &path, Backend backend)
+{
+	// An overlay needs its delta file; falling back to a writable backend would change the base
+	if (backend == Backend::Overlay)
+	{
+		std::cerr << "ERROR: Overlay devices are opened through OverlayBlockDevice with a delta file: " << path << std::endl;
+		return nullptr;
+	}
+	if (backend == Backend::Mapped)
+	{
+		auto mapped = std::make_unique<MappedBlockDevice>();
+		if (mapped->open(path))
+			return mapped;
+	}
+
+	auto stream = std::make_unique<StreamBlockDevice>();
+	if (stream->open(path))
+		return stream;
+
+	return nullptr;
+}
+
+bool BlockDevice::copyTo(uint64_t offset, uint64_t length, File &output, uint64_t output_offset) const
+{
+	std::span<const std::byte> range = bytes(offset, length);
+	if (range.size() != length)
+		return false;
+	return output.writeAt(output_offset, range.data(), range.size());
+}
+
+bool MappedBlockDevice::open(const std::string &path)
+{
+	writable = file.open(path, File::Mode::ReadWrite);
+	if (!writable && !file.open(path, File::Mode::Read))
+		return false;
+
+	return region.map(file);
+}
+
+bool MappedBlockDevice::write(uint64_t offset, std::span<const std::byte> data)
+{
+	if (!writable || offset + data.size() > size())
+		return false;
+
+	// The mapping is shared, so positional writes show up in bytes() directly
+	if (!file.writeAt(offset, data.data(), data.size()))
+		return false;
+	++write_count;
+	FAT12_COUNT(device_writes, 1);
+	FAT12_COUNT(device_bytes_written, data.size());
+	return true;
+}
+
+bool MappedBlockDevice::copyTo(uint64_t offset, uint64_t length, File &output, uint64_t output_offset) const
+{
+	if (offset + length > size())
+		return false;
+	return file.copyRangeTo(offset, length, output, output_offset);
+}
+
+bool StreamBlockDevice::open(const std::string &path)
+{
+	stream.open(path, std::ios::in | std::ios::out | std::ios::binary);
+	writable = stream.is_open() && sync_handle.open(path, File::Mode::ReadWrite);
+	if (!stream.is_open())
+		stream.open(path, std::ios::in | std::ios::binary);
+	if (!stream.is_open())
+		return false;
+
+	stream.seekg(0, std::ios::end);
+	contents.resize(static_cast<size_t>(stream.tellg()));
+	stream.seekg(0);
+	stream.read(reinterpret_cast<char*>(contents.data()), contents.size());
+	FAT12_COUNT(seeks, 2);
+	FAT12_COUNT(syscalls, 2);
+	FAT12_COUNT(bytes_read, contents.size());
+	return static_cast<bool>(stream);
+}
+
+bool StreamBlockDevice::write(uint64_t offset, std::span<const std::byte> data)
+{
+	if (!writable || offset + data.size() > contents.size())
+		return false;
+
+	std::copy(data.begin(), data.end(), contents.begin() + offset);
+	stream.seekp(offset);
+	stream.write(reinterpret_cast<const char*>(data.data()), data.size());
+	stream.flush();
+	FAT12_COUNT(seeks, 1);
+	FAT12_COUNT(syscalls, 2);
+	FAT12_COUNT(bytes_written, data.size());
+	if (!stream)
+		return false;
+	++write_count;
+	FAT12_COUNT(device_writes, 1);
+	FAT12_COUNT(device_bytes_written, data.size());
+	return true;
+}
+
+bool StreamBlockDevice::sync()
+{
+	return writable && stream.flush() && sync_handle.sync();
+}
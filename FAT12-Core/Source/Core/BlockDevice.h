@@ -0,0 +1,97 @@
+#pragma once
+
+#include "File.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+// Byte-addressable view of a disk image. All metadata parsing is done over
+// bytes(); writes go through write() so each backend keeps its view coherent.
+class BlockDevice
+{
+public:
+	enum class Backend
+	{
+		Mapped,	// Memory-mapped image, no syscalls after open
+		Stream,	// std::fstream, image read into memory with a single read on open
+		Overlay	// Read-only base image plus a delta file holding every changed sector
+	};
+
+	virtual ~BlockDevice() = default;
+
+	// Opens the image with the requested backend, falling back to Stream if mapping fails.
+	// Overlay is refused here, since it needs a delta file (see OverlayBlockDevice).
+	static std::unique_ptr<BlockDevice> open(const std::string &path, Backend backend);
+
+	virtual Backend backend() const = 0;
+	virtual std::span<const std::byte> bytes() const = 0;
+	virtual bool write(uint64_t offset, std::span<const std::byte> data) = 0;
+	// Makes every write so far durable
+	virtual bool sync() = 0;
+	// Copies a range of the image into a host file
+	virtual bool copyTo(uint64_t offset, uint64_t length, File &output, uint64_t output_offset) const;
+
+	uint64_t size() const { return bytes().size(); }
+	uint64_t writeCount() const { return write_count; }	// Successful write() calls so far
+
+	// Returns an empty span if the range is outside the image
+	std::span<const std::byte> bytes(uint64_t offset, uint64_t length) const
+	{
+		std::span<const std::byte> image = bytes();
+		if (offset > image.size() || length > image.size() - offset)
+			return {};
+		return image.subspan(offset, length);
+	}
+
+protected:
+	uint64_t write_count = 0;
+};
+
+class MappedBlockDevice : public BlockDevice
+{
+public:
+	bool open(const std::string &path);
+
+	Backend backend() const override { return Backend::Mapped; }
+	std::span<const std::byte> bytes() const override { return region.bytes(); }
+	bool write(uint64_t offset, std::span<const std::byte> data) override;
+	bool sync() override { return writable && file.sync(); }
+	bool copyTo(uint64_t offset, uint64_t length, File &output, uint64_t output_offset) const override;
+
+private:
+	File file;
+	MappedRegion region;
+	bool writable = false;
+};
+
+class StreamBlockDevice : public BlockDevice
+{
+public:
+	bool open(const std::string &path);
+
+	Backend backend() const override { return Backend::Stream; }
+	std::span<const std::byte> bytes() const override { return contents; }
+	bool write(uint64_t offset, std::span<const std::byte> data) override;
+	bool sync() override;
+
+private:
+	std::fstream stream;
+	File sync_handle;	// std::fstream cannot be synced, a second handle to the same file can
+	std::vector<std::byte> contents;
+	bool writable = false;
+};
+
+// Reads a little-endian on-disk field (the host is assumed little-endian)
+template <typename T>
+inline T readField(std::span<const std::byte> bytes, size_t offset)
+{
+	T value{};
+	std::memcpy(&value, bytes.data() + offset, sizeof(T));
+	return value;
+}
@@ -0,0 +1,95 @@
+#include "ChainCache.h"
+#include "Instrumentation.h"
+
+#include <algorithm>
+
+void ChainCache::reset(size_t cluster_count)
+{
+	chains.clear();
+	owners.assign(cluster_count, 0);
+}
+
+bool ChainCache::resolve(uint16_t first_cluster, std::span<const uint16_t> fat_table, Chain &chain)
+{
+	chain.clear();
+	if (first_cluster == 0)
+		return true;	// Empty file
+
+	// A chain can never be longer than the FAT, so this also stops cycles
+	uint16_t current_cluster = first_cluster;
+	uint32_t logical_cluster = 0;
+	for (; current_cluster < 0xFF8; ++logical_cluster)
+	{
+		if (current_cluster < 2 || current_cluster >= fat_table.size() || logical_cluster == fat_table.size())
+			return false;
+
+		// Extend the current run while clusters stay physically contiguous
+		if (!chain.empty() && chain.back().first + chain.back().count == current_cluster)
+			++chain.back().count;
+		else
+			chain.push_back({ logical_cluster, current_cluster, 1 });
+
+		current_cluster = fat_table[current_cluster];
+	}
+	FAT12_COUNT(clusters_walked, logical_cluster);
+	return true;
+}
+
+ChainCache::ChainRef ChainCache::find(uint16_t first_cluster, std::span<const uint16_t> fat_table)
+{
+	auto cached = chains.find(first_cluster);
+	if (cached != chains.end())
+		return cached->second;
+
+	Chain chain;
+	if (!resolve(first_cluster, fat_table, chain))
+		return nullptr;
+	if (chain.empty())
+		return chains[first_cluster] = std::make_shared<const Chain>();
+
+	// Clusters belong to at most one cached chain, so invalidation stays exact
+	// even for cross-linked chains
+	for (const Extent &extent : chain)
+	{
+		for (uint16_t cluster = extent.first; cluster < extent.first + extent.count; ++cluster)
+		{
+			if (owners[cluster] != 0)
+				erase(owners[cluster]);
+		}
+	}
+	for (const Extent &extent : chain)
+		std::fill_n(owners.begin() + extent.first, extent.count, first_cluster);
+
+	return chains[first_cluster] = std::make_shared<const Chain>(std::move(chain));
+}
+
+void ChainCache::invalidate(uint16_t cluster)
+{
+	if (cluster < owners.size() && owners[cluster] != 0)
+		erase(owners[cluster]);
+}
+
+void ChainCache::erase(uint16_t first_cluster)
+{
+	auto cached = chains.find(first_cluster);
+	if (cached == chains.end())
+		return;
+
+	for (const Extent &extent : *cached->second)
+		std::fill_n(owners.begin() + extent.first, extent.count, uint16_t{ 0 });
+	chains.erase(cached);
+}
+
+ChainCache::Chain::const_iterator ChainCache::seek(const Chain &chain, uint32_t logical_cluster)
+{
+	// Last extent starting at or before logical_cluster
+	auto next = std::upper_bound(chain.begin(), chain.end(), logical_cluster,
+		[](uint32_t value, const Extent &extent) { return value < extent.logical_cluster; });
+	if (next == chain.begin())
+		return chain.end();
+
+	auto extent = std::prev(next);
+	if (logical_cluster >= extent->logical_cluster + extent->count)
+		return chain.end();
+	return extent;
+}
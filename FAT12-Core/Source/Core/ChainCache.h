@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+// Cluster chains resolved into extent lists, keyed by their first cluster.
+// The owner calls invalidate() for every FAT entry it changes; only the
+// chain containing that cluster is dropped.
+class ChainCache
+{
+public:
+	struct Extent
+	{
+		uint32_t logical_cluster;	// Index of first within the file
+		uint16_t first;
+		uint16_t count;
+	};
+	using Chain = std::vector<Extent>;
+	// Chains are shared so a reader keeps its chain alive even if it is evicted meanwhile
+	using ChainRef = std::shared_ptr<const Chain>;
+
+	// Forgets every chain and tracks clusters 0..cluster_count-1
+	void reset(size_t cluster_count);
+
+	// Cached chain starting at first_cluster, resolved from the FAT on a miss.
+	// Returns nullptr for chains that leave the FAT or loop.
+	ChainRef find(uint16_t first_cluster, std::span<const uint16_t> fat_table);
+
+	void invalidate(uint16_t cluster);
+
+	// Extent holding the given cluster index of the file, or chain.end()
+	static Chain::const_iterator seek(const Chain &chain, uint32_t logical_cluster);
+
+	// Walks a chain without caching it
+	static bool resolve(uint16_t first_cluster, std::span<const uint16_t> fat_table, Chain &chain);
+
+private:
+	std::unordered_map<uint16_t, ChainRef> chains;
+	std::vector<uint16_t> owners;	// First cluster of the cached chain holding each cluster, 0 if none
+
+	void erase(uint16_t first_cluster);
+};
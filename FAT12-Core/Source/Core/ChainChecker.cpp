@@ -0,0 +1,74 @@
+#include "ChainChecker.h"
+#include "Instrumentation.h"
+
+#include <algorithm>
+
+ChainChecker::ChainChecker(std::span<const uint16_t> fat_table, uint32_t end_cluster)
+	: fat(fat_table), end_cluster(std::min<uint32_t>(end_cluster, static_cast<uint32_t>(fat_table.size()))),
+	owners(std::make_unique<std::atomic<uint32_t>[]>(fat_table.size()))
+{
+}
+
+ChainChecker::Result ChainChecker::walk(uint32_t id, uint16_t first_cluster)
+{
+	Result result;
+	uint16_t cluster = first_cluster;
+	while (cluster != 0 && cluster < 0xFF8)
+	{
+		if (cluster < 2 || cluster >= end_cluster)
+		{
+			result.status = Status::out_of_range;
+			break;
+		}
+		if (fat[cluster] == 0x000 || fat[cluster] == 0xFF7)
+		{
+			result.status = Status::free_cluster;
+			break;
+		}
+
+		// Whoever claims a cluster first owns it; anyone arriving later has found a cycle or a cross link
+		uint32_t expected = 0;
+		if (!owners[cluster].compare_exchange_strong(expected, id, std::memory_order_relaxed))
+		{
+			result.status = expected == id ? Status::cycle : Status::cross_linked;
+			result.other = expected;
+			break;
+		}
+		++result.length;
+		result.last_good = cluster;
+		cluster = fat[cluster];
+	}
+	if (result.status != Status::ok)
+		result.stop_cluster = cluster;
+	FAT12_COUNT(clusters_walked, result.length);
+	return result;
+}
+
+uint32_t ChainChecker::owner(uint16_t cluster) const
+{
+	return cluster < fat.size() ? owners[cluster].load(std::memory_order_relaxed) : 0;
+}
+
+void ChainChecker::findLost(std::vector<uint16_t> &lost_clusters, std::vector<uint16_t> &lost_heads) const
+{
+	auto isLost = [&](uint32_t cluster)
+	{
+		return cluster >= 2 && cluster < end_cluster && fat[cluster] != 0x000 && fat[cluster] != 0xFF7 &&
+			owners[cluster].load(std::memory_order_relaxed) == 0;
+	};
+
+	std::vector<bool> linked_to(end_cluster, false);
+	for (uint32_t cluster = 2; cluster < end_cluster; ++cluster)
+	{
+		if (!isLost(cluster))
+			continue;
+		lost_clusters.push_back(static_cast<uint16_t>(cluster));
+		if (isLost(fat[cluster]))
+			linked_to[fat[cluster]] = true;
+	}
+	for (uint16_t cluster : lost_clusters)
+	{
+		if (!linked_to[cluster])
+			lost_heads.push_back(cluster);
+	}
+}
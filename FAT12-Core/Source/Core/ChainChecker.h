@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+// Validates cluster chains against the FAT in one pass. Every walk claims the
+// clusters it visits in a shared owner table, so each cluster is visited once
+// however many chains run into it, and chains can be walked from any number
+// of threads at once.
+class ChainChecker
+{
+public:
+	enum class Status : uint8_t
+	{
+		ok,
+		out_of_range,	// A link leaves the data area
+		free_cluster,	// A link points at a free or bad cluster
+		cycle,
+		cross_linked	// Runs into a cluster claimed by another chain
+	};
+
+	struct Result
+	{
+		Status status = Status::ok;
+		uint32_t length = 0;	// Clusters claimed by this walk
+		uint16_t last_good = 0;	// Last cluster claimed, 0 if none
+		uint16_t stop_cluster = 0;	// Cluster the walk failed at
+		uint32_t other = 0;	// Owner of stop_cluster for cross links
+	};
+
+	// Tracks clusters 2..end_cluster-1 of the table
+	ChainChecker(std::span<const uint16_t> fat_table, uint32_t end_cluster);
+
+	// Walks the chain starting at first_cluster as chain id (nonzero, unique per chain)
+	Result walk(uint32_t id, uint16_t first_cluster);
+
+	uint32_t owner(uint16_t cluster) const;
+	// In use in the FAT but claimed by no walk; heads are lost clusters no other lost cluster links to
+	void findLost(std::vector<uint16_t> &lost_clusters, std::vector<uint16_t> &lost_heads) const;
+
+private:
+	std::span<const uint16_t> fat;
+	uint32_t end_cluster;
+	std::unique_ptr<std::atomic<uint32_t>[]> owners;
+};
@@ -0,0 +1,170 @@
+#include "ClusterAllocator.h"
+#include "Instrumentation.h"
+
+#include <algorithm>
+#include <bit>
+
+void ClusterAllocator::reset(std::span<const uint16_t> fat_table)
+{
+	end_cluster = static_cast<uint32_t>(fat_table.size());
+	free_bitmap.assign((end_cluster + 63) / 64, 0);
+	free_count = 0;
+	cursor = 2;
+
+	for (uint32_t cluster = 2; cluster < end_cluster; ++cluster)
+	{
+		if (fat_table[cluster] == 0x000)
+			free_bitmap[cluster / 64] |= uint64_t{ 1 } << (cluster % 64);
+	}
+	for (uint64_t word : free_bitmap)
+		free_count += std::popcount(word);
+}
+
+void ClusterAllocator::markUsed(uint16_t cluster)
+{
+	if (cluster < 2 || cluster >= end_cluster || !isFree(cluster))
+		return;
+	free_bitmap[cluster / 64] &= ~(uint64_t{ 1 } << (cluster % 64));
+	--free_count;
+}
+
+void ClusterAllocator::markFree(uint16_t cluster)
+{
+	if (cluster < 2 || cluster >= end_cluster || isFree(cluster))
+		return;
+	free_bitmap[cluster / 64] |= uint64_t{ 1 } << (cluster % 64);
+	++free_count;
+}
+
+bool ClusterAllocator::isFree(uint16_t cluster) const
+{
+	if (cluster >= end_cluster)
+		return false;
+	return (free_bitmap[cluster / 64] >> (cluster % 64)) & 1;
+}
+
+uint32_t ClusterAllocator::nextFree(uint32_t from) const
+{
+	if (from >= end_cluster)
+		return end_cluster;
+
+	size_t word_index = from / 64;
+	uint64_t word = free_bitmap[word_index] & (~uint64_t{ 0 } << (from % 64));
+	while (word == 0)
+	{
+		if (++word_index == free_bitmap.size())
+		{
+			FAT12_COUNT(allocator_probes, word_index - from / 64);
+			return end_cluster;
+		}
+		word = free_bitmap[word_index];
+	}
+	FAT12_COUNT(allocator_probes, word_index - from / 64 + 1);
+	return std::min<uint32_t>(static_cast<uint32_t>(word_index * 64 + std::countr_zero(word)), end_cluster);
+}
+
+uint32_t ClusterAllocator::nextUsed(uint32_t from) const
+{
+	if (from >= end_cluster)
+		return end_cluster;
+
+	size_t word_index = from / 64;
+	uint64_t word = ~free_bitmap[word_index] & (~uint64_t{ 0 } << (from % 64));
+	while (word == 0)
+	{
+		if (++word_index == free_bitmap.size())
+		{
+			FAT12_COUNT(allocator_probes, word_index - from / 64);
+			return end_cluster;
+		}
+		word = ~free_bitmap[word_index];
+	}
+	FAT12_COUNT(allocator_probes, word_index - from / 64 + 1);
+	return std::min<uint32_t>(static_cast<uint32_t>(word_index * 64 + std::countr_zero(word)), end_cluster);
+}
+
+uint16_t ClusterAllocator::findFree() const
+{
+	uint32_t cluster = nextFree(cursor);
+	if (cluster == end_cluster)
+		cluster = nextFree(2);
+	return (cluster == end_cluster) ? no_cluster : static_cast<uint16_t>(cluster);
+}
+
+bool ClusterAllocator::findRun(uint32_t from, uint32_t to, uint32_t count, uint32_t &first) const
+{
+	for (uint32_t run_start = nextFree(from); run_start < to; run_start = nextFree(run_start))
+	{
+		uint32_t run_end = std::min(nextUsed(run_start), to);
+		if (run_end - run_start >= count)
+		{
+			first = run_start;
+			return true;
+		}
+		run_start = run_end;
+	}
+	return false;
+}
+
+void ClusterAllocator::claim(uint32_t first, uint32_t count)
+{
+	for (uint32_t cluster = first; cluster < first + count; ++cluster)
+		free_bitmap[cluster / 64] &= ~(uint64_t{ 1 } << (cluster % 64));
+	free_count -= count;
+	cursor = first + count;
+}
+
+bool ClusterAllocator::allocate(uint32_t count, std::vector<Extent> &extents)
+{
+	extents.clear();
+	if (count == 0)
+		return true;
+	if (count > free_count)
+		return false;
+
+	// Next-fit: one contiguous run after the cursor, then before it
+	uint32_t first = 0;
+	if (findRun(cursor, end_cluster, count, first) || findRun(2, cursor, count, first))
+	{
+		claim(first, count);
+		extents.push_back({ static_cast<uint16_t>(first), static_cast<uint16_t>(count) });
+		return true;
+	}
+
+	// Fragmented: take the largest runs first to keep the extent count low
+	std::vector<Extent> runs;
+	for (uint32_t run_start = nextFree(2); run_start < end_cluster;)
+	{
+		uint32_t run_end = nextUsed(run_start);
+		runs.push_back({ static_cast<uint16_t>(run_start), static_cast<uint16_t>(run_end - run_start) });
+		run_start = nextFree(run_end);
+	}
+	std::stable_sort(runs.begin(), runs.end(), [](const Extent &a, const Extent &b) { return a.count > b.count; });
+
+	uint32_t remaining = count;
+	for (const Extent &run : runs)
+	{
+		if (remaining == 0)
+			break;
+		uint16_t taken = static_cast<uint16_t>(std::min<uint32_t>(run.count, remaining));
+		extents.push_back({ run.first, taken });
+		remaining -= taken;
+	}
+
+	std::sort(extents.begin(), extents.end(), [](const Extent &a, const Extent &b) { return a.first < b.first; });
+	for (const Extent &extent : extents)
+		claim(extent.first, extent.count);
+	return true;
+}
+
+uint16_t ClusterAllocator::claimRun(uint32_t count, uint32_t limit)
+{
+	uint32_t first = 0;
+	if (count == 0 || !findRun(2, std::min(limit, end_cluster), count, first))
+		return no_cluster;
+
+	uint32_t previous_cursor = cursor;
+	claim(first, count);
+	cursor = previous_cursor;
+	return static_cast<uint16_t>(first);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Free-cluster bitmap mirroring the FAT. A set bit means the cluster is free.
+// The owner must report every FAT change through markUsed/markFree.
+class ClusterAllocator
+{
+public:
+	struct Extent
+	{
+		uint16_t first;
+		uint16_t count;
+	};
+
+	static constexpr uint16_t no_cluster = 0xFFFF;
+
+	// Rebuilds the bitmap from clusters 2..fat_table.size()-1
+	void reset(std::span<const uint16_t> fat_table);
+
+	void markUsed(uint16_t cluster);
+	void markFree(uint16_t cluster);
+	bool isFree(uint16_t cluster) const;
+	uint32_t freeCount() const { return free_count; }
+
+	// First free cluster at or after the next-fit cursor, wrapping around
+	uint16_t findFree() const;
+
+	// Claims count clusters, preferring one contiguous run at or after the
+	// cursor, otherwise the fewest, largest runs. Extents come back in
+	// ascending cluster order. Fails without claiming anything if short.
+	bool allocate(uint32_t count, std::vector<Extent> &extents);
+
+	// Claims the lowest run of count free clusters that ends before limit, or
+	// returns no_cluster. Leaves the next-fit cursor alone.
+	uint16_t claimRun(uint32_t count, uint32_t limit);
+
+private:
+	std::vector<uint64_t> free_bitmap;
+	uint32_t end_cluster = 0;	// One past the last tracked cluster
+	uint32_t free_count = 0;
+	uint32_t cursor = 2;
+
+	// First free cluster in [from, end_cluster), or end_cluster
+	uint32_t nextFree(uint32_t from) const;
+	// First used cluster in [from, end_cluster), or end_cluster
+	uint32_t nextUsed(uint32_t from) const;
+	bool findRun(uint32_t from, uint32_t to, uint32_t count, uint32_t &first) const;
+	void claim(uint32_t first, uint32_t count);
+};
@@ -0,0 +1,384 @@
+#include "ContentHash.h"
+#include "CpuFeatures.h"
+
+#include <algorithm>
+#include <cstring>
+
+constexpr uint64_t prime32_1 = 0x9E3779B1u;
+constexpr uint64_t prime32_2 = 0x85EBCA77u;
+constexpr uint64_t prime32_3 = 0xC2B2AE3Du;
+constexpr uint64_t prime64_1 = 0x9E3779B185EBCA87ull;
+constexpr uint64_t prime64_2 = 0xC2B2AE3D27D4EB4Full;
+constexpr uint64_t prime64_3 = 0x165667B19E3779F9ull;
+constexpr uint64_t prime64_4 = 0x85EBCA77C2B2AE63ull;
+constexpr uint64_t prime64_5 = 0x27D4EB2F165667C5ull;
+
+constexpr size_t stripes_per_block = ContentHash::Hasher64::block_size / ContentHash::Hasher64::stripe_size;
+constexpr size_t secret_size = 192;	// Stripe n reads bytes 8n..8n+63; the scramble key is the last 64
+
+// Fixed secret, filled from splitmix64 at compile time
+struct HashSecret
+{
+	uint8_t bytes[secret_size];
+
+	constexpr HashSecret() : bytes{}
+	{
+		uint64_t state = 0x46415431324B4559ull;	// "FAT12KEY"
+		for (size_t word = 0; word < secret_size / 8; word++)
+		{
+			state += 0x9E3779B97F4A7C15ull;
+			uint64_t value = state;
+			value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+			value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+			value ^= value >> 31;
+			for (size_t byte = 0; byte < 8; byte++)
+				bytes[word * 8 + byte] = static_cast<uint8_t>(value >> (8 * byte));
+		}
+	}
+};
+constexpr HashSecret secret;
+static const uint8_t *const scramble_key = secret.bytes + secret_size - 64;
+
+static uint64_t read64(const uint8_t *bytes)
+{
+	uint64_t value;
+	std::memcpy(&value, bytes, sizeof(value));
+	return value;
+}
+
+static uint64_t mulFold64(uint64_t a, uint64_t b)
+{
+#if defined(__SIZEOF_INT128__)
+	unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+	return static_cast<uint64_t>(product) ^ static_cast<uint64_t>(product >> 64);
+#else
+	uint64_t a_lo = a & 0xFFFFFFFF, a_hi = a >> 32, b_lo = b & 0xFFFFFFFF, b_hi = b >> 32;
+	uint64_t lo_lo = a_lo * b_lo, hi_lo = a_hi * b_lo, lo_hi = a_lo * b_hi, hi_hi = a_hi * b_hi;
+	uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFF) + lo_hi;
+	uint64_t upper = (hi_lo >> 32) + (cross >> 32) + hi_hi;
+	uint64_t lower = (cross << 32) | (lo_lo & 0xFFFFFFFF);
+	return lower ^ upper;
+#endif
+}
+
+static void accumulateStripeScalar(uint64_t *accumulators, const uint8_t *stripe, const uint8_t *key)
+{
+	for (size_t lane = 0; lane < 8; lane++)
+	{
+		uint64_t data = read64(stripe + lane * 8);
+		uint64_t keyed = data ^ read64(key + lane * 8);
+		accumulators[lane ^ 1] += data;
+		accumulators[lane] += (keyed & 0xFFFFFFFF) * (keyed >> 32);
+	}
+}
+
+static void scrambleScalar(uint64_t *accumulators)
+{
+	for (size_t lane = 0; lane < 8; lane++)
+	{
+		uint64_t value = accumulators[lane];
+		value ^= value >> 47;
+		value ^= read64(scramble_key + lane * 8);
+		accumulators[lane] = value * prime32_1;
+	}
+}
+
+static void accumulateBlocksScalar(uint64_t *accumulators, const uint8_t *data, size_t blocks)
+{
+	for (size_t block = 0; block < blocks; block++, data += ContentHash::Hasher64::block_size)
+	{
+		for (size_t stripe = 0; stripe < stripes_per_block; stripe++)
+			accumulateStripeScalar(accumulators, data + stripe * 64, secret.bytes + stripe * 8);
+		scrambleScalar(accumulators);
+	}
+}
+
+#ifdef FAT12_X86
+// acc[lane ^ 1] += data: lanes pair up inside each 128-bit half, so one shuffle swaps them
+FAT12_TARGET("avx2")
+static __m256i accumulateAVX2(__m256i accumulator, const uint8_t *stripe, const uint8_t *key)
+{
+	__m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(stripe));
+	__m256i keyed = _mm256_xor_si256(data, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(key)));
+	__m256i product = _mm256_mul_epu32(keyed, _mm256_srli_epi64(keyed, 32));
+	__m256i swapped = _mm256_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+	return _mm256_add_epi64(accumulator, _mm256_add_epi64(swapped, product));
+}
+
+// The 64x32 multiply is built from two 32x32 products
+FAT12_TARGET("avx2")
+static __m256i scrambleAVX2(__m256i accumulator, const uint8_t *key)
+{
+	const __m256i prime = _mm256_set1_epi32(static_cast<int>(prime32_1));
+	accumulator = _mm256_xor_si256(accumulator, _mm256_srli_epi64(accumulator, 47));
+	accumulator = _mm256_xor_si256(accumulator, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(key)));
+	__m256i product_low = _mm256_mul_epu32(accumulator, prime);
+	__m256i product_high = _mm256_mul_epu32(_mm256_srli_epi64(accumulator, 32), prime);
+	return _mm256_add_epi64(product_low, _mm256_slli_epi64(product_high, 32));
+}
+
+FAT12_TARGET("avx2")
+static void accumulateBlocksAVX2(uint64_t *accumulators, const uint8_t *data, size_t blocks)
+{
+	__m256i low = _mm256_load_si256(reinterpret_cast<const __m256i*>(accumulators));
+	__m256i high = _mm256_load_si256(reinterpret_cast<const __m256i*>(accumulators + 4));
+	for (size_t block = 0; block < blocks; block++, data += ContentHash::Hasher64::block_size)
+	{
+		for (size_t stripe = 0; stripe < stripes_per_block; stripe++)
+		{
+			const uint8_t *bytes = data + stripe * 64;
+			const uint8_t *key = secret.bytes + stripe * 8;
+			low = accumulateAVX2(low, bytes, key);
+			high = accumulateAVX2(high, bytes + 32, key + 32);
+		}
+		low = scrambleAVX2(low, scramble_key);
+		high = scrambleAVX2(high, scramble_key + 32);
+	}
+	_mm256_store_si256(reinterpret_cast<__m256i*>(accumulators), low);
+	_mm256_store_si256(reinterpret_cast<__m256i*>(accumulators + 4), high);
+}
+#endif
+
+static void accumulateBlocks(ContentHash::Kernel kernel, uint64_t *accumulators, const uint8_t *data, size_t blocks)
+{
+#ifdef FAT12_X86
+	if (kernel == ContentHash::Kernel::AVX2)
+	{
+		accumulateBlocksAVX2(accumulators, data, blocks);
+		return;
+	}
+#endif
+	accumulateBlocksScalar(accumulators, data, blocks);
+}
+
+bool ContentHash::isSupported(Kernel kernel)
+{
+	switch (kernel)
+	{
+	case Kernel::Scalar:
+		return true;
+#ifdef FAT12_X86
+	case Kernel::AVX2:
+		return CpuFeatures::avx2();
+#endif
+	default:
+		return false;
+	}
+}
+
+const char *ContentHash::kernelName(Kernel kernel)
+{
+	switch (kernel)
+	{
+	case Kernel::Scalar: return "scalar";
+	case Kernel::AVX2: return "avx2";
+	}
+	return "unknown";
+}
+
+ContentHash::Kernel ContentHash::bestKernel()
+{
+	static const Kernel best = isSupported(Kernel::AVX2) ? Kernel::AVX2 : Kernel::Scalar;
+	return best;
+}
+
+ContentHash::Hasher64::Hasher64(Kernel kernel)
+	: kernel(isSupported(kernel) ? kernel : Kernel::Scalar),
+	accumulators{ prime32_3, prime64_1, prime64_2, prime64_3, prime64_4, prime32_2, prime64_5, prime32_1 }
+{
+}
+
+void ContentHash::Hasher64::update(std::span<const std::byte> data)
+{
+	const uint8_t *bytes = reinterpret_cast<const uint8_t*>(data.data());
+	size_t length = data.size();
+	total_length += length;
+
+	// A full block is only consumed once more data follows, so finish() always
+	// sees the last 1..1024 bytes
+	if (buffered > 0)
+	{
+		size_t take = std::min(length, block_size - buffered);
+		std::memcpy(buffer.data() + buffered, bytes, take);
+		buffered += take;
+		bytes += take;
+		length -= take;
+		if (length == 0)
+			return;
+		accumulateBlocks(kernel, accumulators, reinterpret_cast<const uint8_t*>(buffer.data()), 1);
+		buffered = 0;
+	}
+
+	// Whole blocks straight from the input
+	if (length > block_size)
+	{
+		size_t blocks = (length - 1) / block_size;
+		accumulateBlocks(kernel, accumulators, bytes, blocks);
+		bytes += blocks * block_size;
+		length -= blocks * block_size;
+	}
+	std::memcpy(buffer.data(), bytes, length);
+	buffered = length;
+}
+
+uint64_t ContentHash::Hasher64::finish() const
+{
+	uint64_t lanes[8];
+	std::copy(std::begin(accumulators), std::end(accumulators), lanes);
+
+	// Whole stripes of the last block, then the rest zero-padded; the length
+	// mixed in below tells padding from real zeroes
+	const uint8_t *tail = reinterpret_cast<const uint8_t*>(buffer.data());
+	size_t stripes = buffered / stripe_size;
+	for (size_t stripe = 0; stripe < stripes; stripe++)
+		accumulateStripeScalar(lanes, tail + stripe * stripe_size, secret.bytes + stripe * 8);
+	if (buffered % stripe_size != 0)
+	{
+		uint8_t last[stripe_size] = {};
+		std::memcpy(last, tail + stripes * stripe_size, buffered % stripe_size);
+		accumulateStripeScalar(lanes, last, secret.bytes + stripes * 8);
+	}
+
+	uint64_t result = total_length * prime64_1;
+	for (size_t pair = 0; pair < 4; pair++)
+		result += mulFold64(lanes[2 * pair] ^ read64(secret.bytes + 11 + 16 * pair), lanes[2 * pair + 1] ^ read64(secret.bytes + 19 + 16 * pair));
+	result ^= result >> 37;
+	result *= 0x165667919E3779F9ull;
+	return result ^ (result >> 32);
+}
+
+uint64_t ContentHash::hash64(std::span<const std::byte> data, Kernel kernel)
+{
+	Hasher64 hasher(kernel);
+	hasher.update(data);
+	return hasher.finish();
+}
+
+uint64_t ContentHash::hash64(std::span<const std::byte> data)
+{
+	return hash64(data, bestKernel());
+}
+
+constexpr uint32_t sha256_rounds[64] =
+{
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static uint32_t rotateRight(uint32_t value, int bits)
+{
+	return (value >> bits) | (value << (32 - bits));
+}
+
+ContentHash::Sha256::Sha256()
+	: state{ 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 }
+{
+}
+
+void ContentHash::Sha256::compress(const uint8_t *block)
+{
+	uint32_t schedule[64];
+	for (size_t i = 0; i < 16; i++)
+		schedule[i] = (uint32_t{ block[i * 4] } << 24) | (uint32_t{ block[i * 4 + 1] } << 16) | (uint32_t{ block[i * 4 + 2] } << 8) | block[i * 4 + 3];
+	for (size_t i = 16; i < 64; i++)
+	{
+		uint32_t s0 = rotateRight(schedule[i - 15], 7) ^ rotateRight(schedule[i - 15], 18) ^ (schedule[i - 15] >> 3);
+		uint32_t s1 = rotateRight(schedule[i - 2], 17) ^ rotateRight(schedule[i - 2], 19) ^ (schedule[i - 2] >> 10);
+		schedule[i] = schedule[i - 16] + s0 + schedule[i - 7] + s1;
+	}
+
+	uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4], f = state[5], g = state[6], h = state[7];
+	for (size_t i = 0; i < 64; i++)
+	{
+		uint32_t t1 = h + (rotateRight(e, 6) ^ rotateRight(e, 11) ^ rotateRight(e, 25)) + ((e & f) ^ (~e & g)) + sha256_rounds[i] + schedule[i];
+		uint32_t t2 = (rotateRight(a, 2) ^ rotateRight(a, 13) ^ rotateRight(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+		h = g;
+		g = f;
+		f = e;
+		e = d + t1;
+		d = c;
+		c = b;
+		b = a;
+		a = t1 + t2;
+	}
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+	state[4] += e;
+	state[5] += f;
+	state[6] += g;
+	state[7] += h;
+}
+
+void ContentHash::Sha256::update(std::span<const std::byte> data)
+{
+	const uint8_t *bytes = reinterpret_cast<const uint8_t*>(data.data());
+	size_t length = data.size();
+	total_length += length;
+	if (buffered > 0)
+	{
+		size_t take = std::min(length, buffer.size() - buffered);
+		std::memcpy(buffer.data() + buffered, bytes, take);
+		buffered += take;
+		bytes += take;
+		length -= take;
+		if (buffered < buffer.size())
+			return;
+		compress(buffer.data());
+		buffered = 0;
+	}
+	for (; length >= 64; bytes += 64, length -= 64)
+		compress(bytes);
+	std::memcpy(buffer.data(), bytes, length);
+	buffered = length;
+}
+
+ContentHash::Digest ContentHash::Sha256::finish()
+{
+	// 0x80, zeroes up to 56 mod 64, then the length in bits, big-endian
+	uint64_t bit_length = total_length * 8;
+	uint8_t padding[72] = { 0x80 };
+	size_t padding_length = (buffered < 56 ? 56 : 120) - buffered;
+	for (size_t i = 0; i < 8; i++)
+		padding[padding_length + i] = static_cast<uint8_t>(bit_length >> (56 - 8 * i));
+	update(std::as_bytes(std::span(padding, padding_length + 8)));
+
+	Digest digest;
+	for (size_t i = 0; i < 8; i++)
+	{
+		digest[i * 4] = static_cast<uint8_t>(state[i] >> 24);
+		digest[i * 4 + 1] = static_cast<uint8_t>(state[i] >> 16);
+		digest[i * 4 + 2] = static_cast<uint8_t>(state[i] >> 8);
+		digest[i * 4 + 3] = static_cast<uint8_t>(state[i]);
+	}
+	return digest;
+}
+
+std::string ContentHash::toHex(uint64_t hash)
+{
+	static const char digits[] = "0123456789abcdef";
+	std::string hex(16, '0');
+	for (size_t i = 0; i < 16; i++)
+		hex[i] = digits[(hash >> (60 - 4 * i)) & 0xF];
+	return hex;
+}
+
+std::string ContentHash::toHex(const Digest &digest)
+{
+	static const char digits[] = "0123456789abcdef";
+	std::string hex;
+	hex.reserve(digest.size() * 2);
+	for (uint8_t value : digest)
+	{
+		hex += digits[value >> 4];
+		hex += digits[value & 0xF];
+	}
+	return hex;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+
+// File content hashes for comparing and deduplicating files across images.
+//
+// hash64 is a stripe hash in the style of XXH3: eight 64-bit lanes accumulate
+// the 32x32->64 products of every 64-byte stripe mixed with a fixed secret, and
+// are scrambled every 1 KiB. The arithmetic is the same one lane at a time or
+// four lanes per AVX2 register, so every kernel returns the same value. It is
+// not XXH3-compatible and not cryptographic; SHA-256 is there when it must be.
+namespace ContentHash
+{
+	enum class Kernel
+	{
+		Scalar,
+		AVX2	// Four lanes per 256-bit register
+	};
+
+	bool isSupported(Kernel kernel);
+	const char *kernelName(Kernel kernel);
+	// Fastest kernel supported by the running CPU, detected once
+	Kernel bestKernel();
+
+	// Streaming hash64; any split of the input into update() calls gives the same value
+	class Hasher64
+	{
+	public:
+		explicit Hasher64(Kernel kernel = bestKernel());
+		void update(std::span<const std::byte> data);
+		uint64_t finish() const;
+
+		static constexpr size_t stripe_size = 64;
+		static constexpr size_t block_size = 1024;	// Stripes between scrambles, times stripe_size
+
+	private:
+		Kernel kernel;
+		alignas(32) uint64_t accumulators[8];
+		std::array<std::byte, block_size> buffer;
+		size_t buffered = 0;
+		uint64_t total_length = 0;
+	};
+
+	uint64_t hash64(std::span<const std::byte> data, Kernel kernel);
+	uint64_t hash64(std::span<const std::byte> data);
+
+	using Digest = std::array<uint8_t, 32>;
+
+	class Sha256
+	{
+	public:
+		Sha256();
+		void update(std::span<const std::byte> data);
+		Digest finish();
+
+	private:
+		uint32_t state[8];
+		std::array<uint8_t, 64> buffer;
+		size_t buffered = 0;
+		uint64_t total_length = 0;
+
+		void compress(const uint8_t *block);
+	};
+
+	// Lowercase hex, 16 digits for a hash64
+	std::string toHex(uint64_t hash);
+	std::string toHex(const Digest &digest);
+}
+
+// Content of one file in an image
+struct FileHash
+{
+	std::string path;
+	uint32_t size = 0;
+	uint64_t hash = 0;
+	bool has_sha256 = false;
+	ContentHash::Digest sha256{};
+};
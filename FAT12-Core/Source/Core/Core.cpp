@@ -1,315 +1,348 @@
 #include "Core.h"
 
 // Private member function implementations
-inline void FAT12::readBootSector()
+inline bool FAT12::readBootSector()
 {
-	disk_image.seekg(11);
-	disk_image.read(reinterpret_cast<char*>(&boot_sector_contents.sector_size), 
-		sizeof(boot_sector_contents.sector_size));
+	std::span<const std::byte> boot_sector = disk_image->bytes(0, 512);
+
+	boot_sector_contents.sector_size = readField<uint16_t>(boot_sector, 11);
+	boot_sector_contents.sectors_per_cluster = readField<uint8_t>(boot_sector, 13);
+	boot_sector_contents.num_reserved_sectors = readField<uint16_t>(boot_sector, 14);
+	boot_sector_contents.num_fats = readField<uint8_t>(boot_sector, 16);
+	boot_sector_contents.max_num_root_entries = readField<uint16_t>(boot_sector, 17);
+	boot_sector_contents.total_sector_count = readField<uint16_t>(boot_sector, 19);
+	boot_sector_contents.media = readField<uint8_t>(boot_sector, 21);
+	boot_sector_contents.sectors_per_fat = readField<uint16_t>(boot_sector, 22);
+	boot_sector_contents.sectors_per_track = readField<uint16_t>(boot_sector, 24);
+	boot_sector_contents.heads = readField<uint16_t>(boot_sector, 26);
+	// Volumes of 32 MB and up keep their sector count in the 32-bit field
+	if (boot_sector_contents.total_sector_count == 0)
+		boot_sector_contents.total_sector_count = readField<uint32_t>(boot_sector, 32);
+
+	// Images cut short lose the clusters past their end
+	layout = layoutFor(boot_sector_contents);
+	if (!layout.valid() || layout.data_offset >= disk_image->size())
+		return false;
+	uint64_t stored_clusters = (disk_image->size() - layout.data_offset) / layout.cluster_size;
+	layout.cluster_count = static_cast<uint32_t>(std::min<uint64_t>(layout.cluster_count, stored_clusters));
+	layout.fat_entries = layout.cluster_count + 2;
+	return layout.cluster_count != 0;
+}
 
-	disk_image.read(reinterpret_cast<char*>(&boot_sector_contents.sectors_per_cluster),
-		sizeof(boot_sector_contents.sectors_per_cluster));
+inline void FAT12::readFat()
+{
+	FAT12_TIME(read_fat);
+	fat_table.resize(layout.fat_entries);
 
-	disk_image.read(reinterpret_cast<char*>(&boot_sector_contents.num_reserved_sectors), 
-		sizeof(boot_sector_contents.num_reserved_sectors));
+	std::span<const std::byte> fat_bytes = disk_image->bytes(layout.fat_offset, FatCodec::packedSize(layout.fat_entries));
+	if (fat_bytes.empty())
+	{
+		std::cerr << "ERROR: FAT is outside the disk image." << std::endl;
+		return;
+	}
 
-	disk_image.read(reinterpret_cast<char*>(&boot_sector_contents.num_fats), 
-		sizeof(boot_sector_contents.num_fats));
+	// Unpack every 12-bit entry in one pass
+	FatCodec::decode(fat_bytes, fat_table);
+	resetFatState();
+}
 
-	disk_image.read(reinterpret_cast<char*>(&boot_sector_contents.max_num_root_entries), 
-		sizeof(boot_sector_contents.max_num_root_entries));
+inline void FAT12::resetFatState()
+{
+	size_t packed_size = FatCodec::packedSize(fat_table.size());
+	dirty_fat_sectors.assign((packed_size + layout.sector_size - 1) / layout.sector_size, false);
+	cluster_allocator.reset(fat_table);
+	chain_cache.reset(fat_table.size());
+	space_accounting.reset(fat_table, layout.cluster_count);
+}
 
-	disk_image.read(reinterpret_cast<char*>(&boot_sector_contents.total_sector_count), 
-		sizeof(boot_sector_contents.total_sector_count));
+bool FAT12::mountFromSnapshot(SnapshotCache &snapshots)
+{
+	// The key covers the boot sector, every FAT copy and the root directory
+	uint64_t metadata_size = layout.root_offset + layout.rootSize();
+	std::span<const std::byte> metadata = disk_image->bytes(0, metadata_size);
+	if (metadata.empty())
+		return false;
+
+	uint64_t key = SnapshotCache::hash(metadata);
+	SnapshotCache::SnapshotRef snapshot = snapshots.find(key);
+	if (snapshot && std::ranges::equal(snapshot->metadata, metadata))
+	{
+		fat_table = snapshot->fat_table;
+		resetFatState();
+		directory_tree.attachTable(DirectoryTree::root, 0, std::vector<DirectoryEntry>(snapshot->root_entries));
+		directory_tree.addChildren(DirectoryTree::root);
+		return true;
+	}
 
-	disk_image.seekg(22);
-	disk_image.read(reinterpret_cast<char*>(&boot_sector_contents.sectors_per_fat),
-		sizeof(boot_sector_contents.sectors_per_fat));
+	// On a collision the snapshot already cached under this key stays
+	readFat();
+	if (!loadDirectory(DirectoryTree::root) || snapshot)
+		return true;
+
+	auto parsed = std::make_shared<MountSnapshot>();
+	parsed->boot_sector = boot_sector_contents;
+	parsed->fat_table = fat_table;
+	parsed->root_entries = directory_tree.entries(DirectoryTree::root);
+	parsed->metadata.assign(metadata.begin(), metadata.end());
+	snapshots.insert(key, std::move(parsed));
+	return true;
 }
 
-inline void FAT12::readFat()
+void FAT12::reloadMetadata()
 {
-	disk_image.seekg(boot_sector_contents.num_reserved_sectors * boot_sector_contents.sector_size);
-	uint16_t total_fat_entries = static_cast<uint16_t>(ceil((boot_sector_contents.sector_size * 8) / 1.5));
-	fat_table.resize(total_fat_entries);  
-	std::vector<uint8_t> buffer(3); // Temporary buffer to read 3 bytes at a time
-
-	// Read each 3-byte group and convert to 2 12-bit entries
-	for (int i = 0; i < total_fat_entries / 2; ++i)
-	{
-		disk_image.read(reinterpret_cast<char*>(buffer.data()), 3);
+	readBootSector();
+	readFat();
+	directory_tree.reset();
+	metadata_cache.reset(disk_image.get(), layout.sector_size, journaled ? &journal : nullptr);
+}
 
-		// Convert 3 bytes into 2 12-bit entries (little-endian assumption)
-		uint16_t entry1 = (buffer[0] | ((buffer[1] & 0x0F) << 8));
-		uint16_t entry2 = (((buffer[1] & 0xF0) >> 4) | (buffer[2] << 4));
+FAT12::Savepoint FAT12::savepoint() const
+{
+	// Only deferred changes need copying; otherwise the image is the savepoint for free
+	bool pending = metadata_cache.dirtySectorCount() != 0 ||
+		std::find(dirty_fat_sectors.begin(), dirty_fat_sectors.end(), true) != dirty_fat_sectors.end();
+	if (!pending)
+		return { true, {}, {}, {}, {} };
+	return { false, fat_table, dirty_fat_sectors, metadata_cache.staged(), directory_tree };
+}
 
-		// Store the 12-bit entries in the vector
-		fat_table[i * 2].value = entry1;
-		fat_table[i * 2 + 1].value = entry2;
+void FAT12::rollback(Savepoint &savepoint)
+{
+	// Clusters claimed since are free again in the rebuilt allocator; data written
+	// to them is unreferenced
+	if (savepoint.on_image)
+	{
+		reloadMetadata();
+		return;
 	}
+	fat_table = std::move(savepoint.fat_table);
+	resetFatState();
+	dirty_fat_sectors = std::move(savepoint.dirty_fat_sectors);
+	metadata_cache.restore(std::move(savepoint.staged));
+	directory_tree = std::move(savepoint.directory_tree);
 }
 
-void FAT12::readRootDirectoryEntries()
+bool FAT12::readRootDirectoryEntries(std::vector<DirectoryEntry> &entries)
 {
-	uint32_t root_dir_offset = (boot_sector_contents.num_reserved_sectors +
-		(boot_sector_contents.num_fats * boot_sector_contents.sectors_per_fat)) *
-		boot_sector_contents.sector_size;
-	disk_image.seekg(root_dir_offset);
+	size_t root_dir_entry_count = layout.root_entries;
+	std::span<const std::byte> root_directory = disk_image->bytes(layout.root_offset, layout.rootSize());
+	if (root_directory.empty())
+		return false;
+
+	// Slots map 1:1 onto DirectoryEntry, including free and end-of-directory entries
+	entries.resize(root_dir_entry_count);
+	std::memcpy(entries.data(), root_directory.data(), root_directory.size());
+	return true;
+}
+
+bool FAT12::readDirectoryTable(uint16_t first_cluster, std::vector<DirectoryEntry> &entries)
+{
+	// Subdirectories span their whole cluster chain, including entries "." and ".."
+	ChainCache::ChainRef chain = chain_cache.find(first_cluster, fat_table);
+	if (!chain || chain->empty())
+		return false;
 
-	size_t root_dir_entry_count = boot_sector_contents.max_num_root_entries;
-	for (size_t i{ 0 }; i < root_dir_entry_count; i++)
+	uint32_t cluster_size = layout.cluster_size;
+	for (const ChainCache::Extent &extent : *chain)
 	{
-		DirectoryEntry entry;
-		entry.name = "";
-		entry.extension = "";
-		entry.attributes = 0;
-		entry.reserved = 0;
-		entry.creation_time = 0;
-		entry.creation_date = 0;
-		entry.last_access_date = 0;
-		entry.last_write_time = 0;
-		entry.last_write_date = 0;
-		entry.first_logical_cluster = 0;
-		entry.file_size = 0;
-		entry.is_directory = false;
-		entry.path = "/";
-		entry.parent_name = "";
-		entry.parent_cluster = root_dir_offset / boot_sector_contents.sector_size;
-		char name[9];
-		char extension[4];
-
-		disk_image.read(name, 8);
-		name[8] = '\0';
-		std::string name_without_spaces;
-		// Convert name to uppercase
-		for (int j = 0; j < 8; j++)
-		{
-			if (name[j] != ' ')
-			{
-				name[j] = std::toupper(name[j]);
-				name_without_spaces += name[j];
-			}
-		}
-		entry.name = name_without_spaces;
+		uint64_t run_offset = layout.clusterOffset(extent.first);
+		std::span<const std::byte> run = disk_image->bytes(run_offset, static_cast<uint64_t>(extent.count) * cluster_size);
+		if (run.empty())
+			return false;
+
+		size_t table_size = entries.size();
+		entries.resize(table_size + run.size() / sizeof(DirectoryEntry));
+		std::memcpy(entries.data() + table_size, run.data(), run.size());
+	}
+	return true;
+}
 
-		disk_image.read(extension, 3);
-		extension[3] = '\0';
-		std::string extension_without_spaces;
-		// Convert extension to uppercase
-		for (int j = 0; j < 3; j++)
-		{
-			if (extension[j] != ' ')
-			{
-				extension[j] = std::toupper(extension[j]);
-				extension_without_spaces += extension[j];
-			}
-		}
-		entry.extension = extension_without_spaces;
-		
-		if (name[0] == 0xE5 || name[0] == 0x00)
+bool FAT12::loadDirectory(uint32_t directory)
+{
+	if (directory_tree.isLoaded(directory))
+		return true;
+	FAT12_TIME(load_directory);
+
+	// Failed directories still get an empty table, so errors are reported once
+	std::vector<DirectoryEntry> entries;
+	uint16_t first_cluster = 0;
+	bool loaded = false;
+	if (directory == DirectoryTree::root)
+	{
+		loaded = disk_image && readRootDirectoryEntries(entries);
+		if (!loaded)
+			std::cerr << "ERROR: Root directory is outside the disk image." << std::endl;
+	}
+	else
+	{
+		const DirectoryEntry &entry = directory_tree.entry(directory);
+		const std::string &path = directory_tree.node(directory).path;
+		if (!entry.isDirectory())
+			return false;
+
+		// A directory cluster reached twice means the tree loops back on itself
+		if (directory_tree.hasTableAt(entry.first_logical_cluster))
+			std::cerr << "ERROR: Directory loop at " << path << std::endl;
+		else if (!readDirectoryTable(entry.first_logical_cluster, entries))
+			std::cerr << "ERROR: Subdirectory is outside the disk image: " << path << std::endl;
+		else
 		{
-			// Include both free entries and end-of-directory entries
-			root_directory_entries.push_back(entry);
-			// Move to the next entry
-			disk_image.seekg(32 - 8 - 3, std::ios::cur);
-			continue;
+			first_cluster = entry.first_logical_cluster;
+			loaded = true;
 		}
-		
-		disk_image.read(reinterpret_cast<char*>(&entry.attributes), sizeof(entry.attributes));
-		disk_image.read(reinterpret_cast<char*>(&entry.reserved), sizeof(entry.reserved));
-		disk_image.read(reinterpret_cast<char*>(&entry.creation_time), sizeof(entry.creation_time));
-		disk_image.read(reinterpret_cast<char*>(&entry.creation_date), sizeof(entry.creation_date));
-		disk_image.read(reinterpret_cast<char*>(&entry.last_access_date), sizeof(entry.last_access_date));
-		disk_image.seekg(2, std::ios::cur); // ignores 2 bytes
-		disk_image.read(reinterpret_cast<char*>(&entry.last_write_time), sizeof(entry.last_write_time));
-		disk_image.read(reinterpret_cast<char*>(&entry.last_write_date), sizeof(entry.last_write_date));
-		disk_image.read(reinterpret_cast<char*>(&entry.first_logical_cluster), sizeof(entry.first_logical_cluster));
-		disk_image.read(reinterpret_cast<char*>(&entry.file_size), sizeof(entry.file_size));
-
-		entry.is_directory = (entry.attributes & 0x10) != 0;
-		root_directory_entries.push_back(entry);
 	}
+
+	if (!loaded)
+		entries.clear();
+	FAT12_COUNT(directory_entries_parsed, entries.size());
+	directory_tree.attachTable(directory, first_cluster, std::move(entries));
+	directory_tree.addChildren(directory);
+	return loaded;
 }
 
-void FAT12::readSubdirectoriesEntries()
+void FAT12::loadSubtree(uint32_t directory)
 {
-	for (const DirectoryEntry& entry : root_directory_entries)
+	// Breadth-first over a work list, so deep trees never grow the call stack
+	std::vector<uint32_t> pending{ directory };
+	for (size_t next = 0; next < pending.size(); ++next)
 	{
-		std::vector<DirectoryEntry> subdirectory_entries;
-		if (!entry.is_directory || entry.name[0] == 0xE5 || entry.name[0] == 0x00)
+		if (!loadDirectory(pending[next]))
 			continue;
 
-		DirectoryEntry subdirectory_entry;
-		subdirectory_entry.name = "";
-		subdirectory_entry.extension = "";
-		subdirectory_entry.attributes = 0;
-		subdirectory_entry.reserved = 0;
-		subdirectory_entry.creation_time = 0;
-		subdirectory_entry.creation_date = 0;
-		subdirectory_entry.last_access_date = 0;
-		subdirectory_entry.last_write_time = 0;
-		subdirectory_entry.last_write_date = 0;
-		subdirectory_entry.first_logical_cluster = entry.first_logical_cluster;
-		subdirectory_entry.file_size = 0;
-		subdirectory_entry.is_directory = false;
-		subdirectory_entry.path = entry.path + entry.name + "/";
-		subdirectory_entry.parent_name = "/";
-		subdirectory_entry.parent_cluster = 0;	// Will be updated later to actual parent cluster
-
-		uint32_t subdirectoy_offset = ((33 + subdirectory_entry.first_logical_cluster - 2) *
-			boot_sector_contents.sectors_per_cluster * boot_sector_contents.sector_size);
-		subdirectoy_offset += 58; // skips to first_logical_cluster of second entry (entry "..")
-		disk_image.seekg(subdirectoy_offset);
-		
-		disk_image.read(reinterpret_cast<char*>(&subdirectory_entry.parent_cluster), sizeof(subdirectory_entry.parent_cluster));
-		
-		// Updates the parent_name if it isn't the Root Directory
-		if (subdirectory_entry.parent_cluster != 0)
-		{
-			for (const auto &subdir : subdirectories)
-			{
-				for (const auto& entry : subdir.second)
-				{
-					if (entry.first_logical_cluster == subdirectory_entry.parent_cluster)
-						subdirectory_entry.parent_name = subdir.first;
-				}
-			}
-		}
-
-		disk_image.seekg(4, std::ios::cur);	// skips file size field of entry ".."
-		
-		size_t remaining_entries = 14;
-		for (size_t i{ 0 }; i < remaining_entries; i++)
+		for (uint32_t child = directory_tree.node(pending[next]).first_child; child != DirectoryTree::no_node;
+			child = directory_tree.node(child).next_sibling)
 		{
-			char name[9];
-			char extension[4];
-
-			disk_image.read(name, 8);
-			name[8] = '\0';
-			std::string name_without_spaces;
-			// Convert name to uppercase
-			for (int j = 0; j < 8; j++)
-			{
-				if (name[j] != ' ')
-				{
-					name[j] = std::toupper(name[j]);
-					name_without_spaces += name[j];
-				}
-			}
-			subdirectory_entry.name = name_without_spaces;
-
-			disk_image.read(extension, 3);
-			extension[3] = '\0';
-			std::string extension_without_spaces;
-			// Convert extension to uppercase
-			for (int j = 0; j < 3; j++)
-			{
-				if (extension[j] != ' ')
-				{
-					extension[j] = std::toupper(extension[j]);
-					extension_without_spaces += extension[j];
-				}
-			}
-			subdirectory_entry.extension = extension_without_spaces;
-
-			if (name[0] == 0xE5 || name[0] == 0x00)
-			{
-				// Include both free entries and end-of-directory entries
-				subdirectory_entries.push_back(subdirectory_entry);
-				// Move to the next entry
-				disk_image.seekg(32 - 8 - 3, std::ios::cur);
-				continue;
-			}
-
-			disk_image.read(reinterpret_cast<char*>(&subdirectory_entry.attributes), sizeof(subdirectory_entry.attributes));
-			disk_image.read(reinterpret_cast<char*>(&subdirectory_entry.reserved), sizeof(subdirectory_entry.reserved));
-			disk_image.read(reinterpret_cast<char*>(&subdirectory_entry.creation_time), sizeof(subdirectory_entry.creation_time));
-			disk_image.read(reinterpret_cast<char*>(&subdirectory_entry.creation_date), sizeof(subdirectory_entry.creation_date));
-			disk_image.read(reinterpret_cast<char*>(&subdirectory_entry.last_access_date), sizeof(subdirectory_entry.last_access_date));
-			disk_image.seekg(2, std::ios::cur); // ignores 2 bytes
-			disk_image.read(reinterpret_cast<char*>(&subdirectory_entry.last_write_time), sizeof(subdirectory_entry.last_write_time));
-			disk_image.read(reinterpret_cast<char*>(&subdirectory_entry.last_write_date), sizeof(subdirectory_entry.last_write_date));
-			disk_image.read(reinterpret_cast<char*>(&subdirectory_entry.first_logical_cluster), sizeof(subdirectory_entry.first_logical_cluster));
-			disk_image.read(reinterpret_cast<char*>(&subdirectory_entry.file_size), sizeof(subdirectory_entry.file_size));
-
-			subdirectory_entry.is_directory = (subdirectory_entry.attributes & 0x10) != 0;
+			if (directory_tree.entry(child).isDirectory())
+				pending.push_back(child);
+		}
+	}
+}
 
-			if (subdirectory_entry.is_directory && subdirectory_entry.parent_cluster != 0)
-				subdirectory_entry.path = subdirectory_entry.path + "/" + subdirectory_entry.name + "/";
+uint32_t FAT12::findNode(const std::string &path)
+{
+	uint32_t node = directory_tree.find(path);
+	if (node != DirectoryTree::no_node)
+		return node;
 
-			subdirectory_entries.push_back(subdirectory_entry);
+	// Not indexed yet: load each directory on the way down, then look again
+	node = DirectoryTree::root;
+	for (size_t start = 0; start < path.size();)
+	{
+		size_t end = path.find('/', start);
+		if (end == std::string::npos)
+			break;
+		if (end > start)
+		{
+			if (!loadDirectory(node))
+				return DirectoryTree::no_node;
+			node = directory_tree.find(std::string_view(path).substr(0, end));
+			if (node == DirectoryTree::no_node || !directory_tree.entry(node).isDirectory())
+				return DirectoryTree::no_node;
 		}
-		subdirectories[entry.name] = subdirectory_entries;
+		start = end + 1;
 	}
+	loadDirectory(node);
+	return directory_tree.find(path);
 }
 
-void FAT12::listDirectory(const std::vector<DirectoryEntry> &directory_entries)
+void FAT12::listDirectory(const std::vector<DirectoryEntry> &directory_entries, const std::string &path, std::ostream &out)
 {
 	for (const DirectoryEntry& entry : directory_entries)
 	{
-		if (entry.name[0] == 0xE5 || entry.name[0] == 0x00)
+		if (entry.isFree() || entry.isDotEntry())
 			continue;
 
 		std::string entryPath;
-		if (entry.is_directory)
-			entryPath = entry.path + entry.name + " (dir)";
+		if (entry.isDirectory())
+			entryPath = path + entry.nameString() + " (dir)";
 		else
-			entryPath = entry.path + entry.name + "." + entry.extension;
-		std::cout << entryPath << std::endl;
+			entryPath = path + entry.nameString() + "." + entry.extensionString();
+		out << entryPath << std::endl;
 	}
 }
 
-inline uint16_t FAT12::findFreeCluster()
+inline void FAT12::setFatEntry(uint16_t cluster, uint16_t value)
 {
-	for (uint16_t cluster = 2; cluster < fat_table.size(); ++cluster)
-	{
-		if (fat_table[cluster].value == 0x000)
-			return cluster;
-	}
-
-	return 0xFFFF; // No free cluster found
+	// Every FAT change goes through here so the allocator bitmap, chain cache and space counts stay in sync
+	space_accounting.update(cluster, fat_table[cluster], value);
+	fat_table[cluster] = value;
+	chain_cache.invalidate(cluster);
+
+	// A 12-bit entry can straddle two sectors
+	size_t byte_offset = cluster * 3 / 2;
+	dirty_fat_sectors[byte_offset / layout.sector_size] = true;
+	dirty_fat_sectors[std::min((byte_offset + 1) / layout.sector_size, dirty_fat_sectors.size() - 1)] = true;
+
+	if (value == 0x000)
+		cluster_allocator.markFree(cluster);
+	else
+		cluster_allocator.markUsed(cluster);
 }
 
-inline bool FAT12::hasEnoughFreeClusters(uint32_t &required_clusters)
+inline bool FAT12::hasEnoughFreeClusters(uint32_t required_clusters)
 {
-	// Count the number of free clusters in the FAT table
-	uint32_t free_clusters = 0;
+	return cluster_allocator.freeCount() >= required_clusters;
+}
 
-	for (uint16_t cluster = 2; cluster < fat_table.size(); ++cluster)
+inline void FAT12::linkClusterChain(const std::vector<ClusterAllocator::Extent> &extents)
+{
+	uint16_t previous_cluster = 0;
+	for (const ClusterAllocator::Extent &extent : extents)
 	{
-		if (fat_table[cluster].value == 0x000)
-			++free_clusters;
+		for (uint16_t cluster = extent.first; cluster < extent.first + extent.count; ++cluster)
+		{
+			if (previous_cluster != 0)
+				setFatEntry(previous_cluster, cluster);
+			previous_cluster = cluster;
+		}
 	}
 
-	return free_clusters >= required_clusters;
+	// Mark the last cluster as end-of-file
+	if (previous_cluster != 0)
+		setFatEntry(previous_cluster, 0xFFF);
 }
 
-inline void FAT12::findFreeEntry(DirectoryEntry &new_entry, size_t &insert_index, std::ifstream &input_file)
+bool FAT12::findFreeEntry(uint32_t directory, size_t &insert_index)
 {
-	bool found_free_entry = false;
-
-	for (size_t i = 0; i < root_directory_entries.size(); ++i)
+	std::vector<DirectoryEntry> &entries = directory_tree.entries(directory);
+	for (size_t i = 0; i < entries.size(); ++i)
 	{
-		if (root_directory_entries[i].name[0] == 0xE5 || root_directory_entries[i].name[0] == 0x00)
+		if (entries[i].isFree())
 		{
-			new_entry = root_directory_entries[i];
-			found_free_entry = true;
 			insert_index = i;
-			break;
+			return true;
 		}
 	}
 
-	if (!found_free_entry)
+	// The root directory has a fixed size
+	if (directory == DirectoryTree::root)
 	{
 		std::cerr << "ERROR: No free entry available in the root directory." << std::endl;
-		input_file.close();
-		return;
+		return false;
+	}
+
+	// Subdirectories grow by one zeroed cluster at the end of their chain
+	ChainCache::ChainRef chain = chain_cache.find(directory_tree.table(directory).first_cluster, fat_table);
+	std::vector<ClusterAllocator::Extent> extents;
+	if (!chain || chain->empty() || !cluster_allocator.allocate(1, extents))
+	{
+		std::cerr << "ERROR: No free entry available in " << directory_tree.node(directory).path << std::endl;
+		return false;
 	}
+	const ChainCache::Extent &last_extent = chain->back();
+	setFatEntry(static_cast<uint16_t>(last_extent.first + last_extent.count - 1), extents.front().first);
+	setFatEntry(extents.front().first, 0xFFF);
+
+	uint32_t cluster_size = layout.cluster_size;
+	insert_index = entries.size();
+	entries.resize(entries.size() + cluster_size / sizeof(DirectoryEntry));
+	std::vector<std::byte> zeroes(cluster_size);
+	return metadata_cache.stage(layout.clusterOffset(extents.front().first), zeroes);
 }
 
 inline void FAT12::updateNewEntryFields(DirectoryEntry& new_entry, const std::string& destination)
 {
-	std::string base_name, ext;
+	std::string base_name = destination, ext;
 	size_t dot_pos = destination.find('.');
 
 	if (dot_pos != std::string::npos)
@@ -318,132 +351,356 @@ inline void FAT12::updateNewEntryFields(DirectoryEntry& new_entry, const std::st
 		ext = destination.substr(dot_pos + 1);
 	}
 
-	new_entry.name = base_name;
-	new_entry.extension = ext;
+	new_entry.setName(base_name, ext);
 	new_entry.attributes = 0x20; // Archive (0x10 for dir)
 	new_entry.reserved = 0;
 	new_entry.creation_time = 0;
 	new_entry.creation_date = 0;
 	new_entry.last_access_date = 0;
+	new_entry.ignored = 0;
 	new_entry.last_write_time = 0;
 	new_entry.last_write_date = 0;
-
-	// Find the first cluster for the new file
-	uint16_t new_cluster = findFreeCluster();
-	new_entry.first_logical_cluster = new_cluster;
+	new_entry.first_logical_cluster = 0;
+	new_entry.file_size = 0;
 }
 
-inline void FAT12::writeInputFileInDiskImage(std::fstream &writable_disk_image, std::vector<char> &buffer, uint16_t &new_cluster, uint32_t &required_clusters)
+inline bool FAT12::writeImportData(const std::vector<ImportFile> &files)
 {
-	uint32_t remaining_bytes = static_cast<uint32_t>(buffer.size());
-	uint32_t total_remaining_bytes = static_cast<uint32_t>(required_clusters * boot_sector_contents.sector_size);
-	auto buffer_it = buffer.begin();
-	
-	while (new_cluster < 0xFF8 && remaining_bytes > 0)
+	uint32_t cluster_size = layout.cluster_size;
+
+	// Whole clusters per chunk, so the zero padding of the last cluster always fits
+	size_t chunk_capacity = std::max<size_t>(64 * 1024 / cluster_size, 1) * cluster_size;
+	if (io_buffer.size() < chunk_capacity)
+		io_buffer.resize(chunk_capacity);
+
+	// Files are laid out back to back in physical order, so consecutive files
+	// share a chunk and small files cost a fraction of a write each
+	uint64_t buffer_offset = 0;
+	size_t buffered = 0;
+	auto flushBuffer = [&]()
 	{
-		uint32_t data_cluster_offset = ((33 + new_cluster - 2) *
-			boot_sector_contents.sectors_per_cluster * boot_sector_contents.sector_size);
-		writable_disk_image.seekp(data_cluster_offset);
+		bool written = buffered == 0 || disk_image->write(buffer_offset, std::span(io_buffer.data(), buffered));
+		buffered = 0;
+		return written;
+	};
 
-		uint32_t bytes_to_write = std::min(remaining_bytes,
-			static_cast<uint32_t>(boot_sector_contents.sectors_per_cluster *
-				boot_sector_contents.sector_size));
+	for (const ImportFile &file : files)
+	{
+		uint64_t source_offset = 0;
+		for (const ClusterAllocator::Extent &extent : file.extents)
+		{
+			uint64_t extent_offset = layout.clusterOffset(extent.first);
+			uint64_t extent_bytes = static_cast<uint64_t>(extent.count) * cluster_size;
+			for (uint64_t written = 0; written < extent_bytes;)
+			{
+				uint64_t position = extent_offset + written;
+				if (buffered > 0 && (buffer_offset + buffered != position || buffered == chunk_capacity) && !flushBuffer())
+					return false;
+				if (buffered == 0)
+					buffer_offset = position;
+
+				size_t chunk = static_cast<size_t>(std::min<uint64_t>(chunk_capacity - buffered, extent_bytes - written));
+				size_t data_bytes = static_cast<size_t>(std::min<uint64_t>(chunk, file.size - source_offset));
+				if (!file.input.readAt(source_offset, io_buffer.data() + buffered, data_bytes))
+					return false;
+				// Zero the rest of the last cluster
+				std::fill(io_buffer.begin() + buffered + data_bytes, io_buffer.begin() + buffered + chunk, std::byte{ 0 });
+
+				buffered += chunk;
+				written += chunk;
+				source_offset += data_bytes;
+			}
+		}
+	}
+	return flushBuffer();
+}
 
-		writable_disk_image.write(&(*buffer_it), bytes_to_write);
-		remaining_bytes -= bytes_to_write;
-		std::advance(buffer_it, bytes_to_write);
+uint32_t FAT12::createDirectory(uint32_t parent, DirectoryEntry entry)
+{
+	size_t slot = 0;
+	std::vector<ClusterAllocator::Extent> extents;
+	if (!findFreeEntry(parent, slot) || !cluster_allocator.allocate(1, extents))
+		return DirectoryTree::no_node;
+	uint16_t cluster = extents.front().first;
+	setFatEntry(cluster, 0xFFF);
+
+	// A new directory is one cluster holding "." and ".." and end-of-directory slots
+	uint32_t cluster_size = layout.cluster_size;
+	std::vector<DirectoryEntry> entries(cluster_size / sizeof(DirectoryEntry));
+	entries[0] = entry;
+	entries[0].setName(".", "");
+	entries[0].first_logical_cluster = cluster;
+	entries[1] = entry;
+	entries[1].setName("..", "");
+	entries[1].first_logical_cluster = directory_tree.table(parent).first_cluster;
+
+	if (!metadata_cache.stage(layout.clusterOffset(cluster), std::as_bytes(std::span(entries))))
+		return DirectoryTree::no_node;
+
+	entry.first_logical_cluster = cluster;
+	uint32_t directory = directory_tree.insert(parent, slot, entry);
+	directory_tree.attachTable(directory, cluster, std::move(entries));
+	if (!stageDirectoryEntry(parent, slot))
+		return DirectoryTree::no_node;
+	return directory;
+}
 
-		if (remaining_bytes > 0)
+bool FAT12::commitImport(std::vector<ImportTarget> &targets, std::vector<ImportFile> &files)
+{
+	FAT12_TIME(import);
+	uint32_t cluster_size = layout.cluster_size;
+	size_t entries_per_cluster = cluster_size / sizeof(DirectoryEntry);
+
+	// Name clashes, within the batch or with what is already there, fail the whole batch
+	std::vector<std::unordered_set<std::string>> names(targets.size());
+	std::vector<size_t> new_entries(targets.size(), 0);
+	auto claimName = [&](size_t target, const DirectoryEntry &entry)
+	{
+		++new_entries[target];
+		std::string name = entry.fullName();
+		bool exists = false;
+		if (targets[target].node != DirectoryTree::no_node)
 		{
-			fat_table[new_cluster].value = 0xFF0;
-			uint16_t next_new_cluster = findFreeCluster();
-			fat_table[new_cluster].value = next_new_cluster;
-			new_cluster = next_new_cluster;
+			const std::string &path = directory_tree.node(targets[target].node).path;
+			exists = directory_tree.find(targets[target].node == DirectoryTree::root ? "/" + name : path + "/" + name) != DirectoryTree::no_node;
 		}
+		if (!exists && names[target].insert(std::move(name)).second)
+			return true;
+		std::cerr << "ERROR: File already exists in the destination: " << entry.fullName() << std::endl;
+		return false;
+	};
+	for (size_t i = 1; i < targets.size(); ++i)
+	{
+		if (targets[i].node == DirectoryTree::no_node && !claimName(targets[i].parent, targets[i].entry))
+			return false;
+	}
+	for (const ImportFile &file : files)
+	{
+		if (!claimName(file.target, file.entry))
+			return false;
 	}
 
-	// Update the FAT table to mark the last cluster as end-of-file
-	if (new_cluster < 0xFF8)
+	// Capacity planning for the whole batch: data, new directories and directory growth
+	uint64_t required_clusters = 0;
+	for (const ImportFile &file : files)
+		required_clusters += (file.size + cluster_size - 1) / cluster_size;
+	for (size_t i = 0; i < targets.size(); ++i)
 	{
-		fat_table[new_cluster].value = 0xFFF;
-		if (total_remaining_bytes - buffer.size() > 0)
+		size_t free_slots = entries_per_cluster - 2;
+		if (targets[i].node != DirectoryTree::no_node)
+		{
+			const std::vector<DirectoryEntry> &entries = directory_tree.entries(targets[i].node);
+			free_slots = std::count_if(entries.begin(), entries.end(), [](const DirectoryEntry &entry) { return entry.isFree(); });
+		}
+		else
+			++required_clusters;
+
+		if (new_entries[i] <= free_slots)
+			continue;
+		if (targets[i].node == DirectoryTree::root)
 		{
-			std::vector<char> zeros(total_remaining_bytes - buffer.size(), 0);
-			writable_disk_image.write(zeros.data(), zeros.size());
+			std::cerr << "ERROR: No free entry available in the root directory." << std::endl;
+			return false;
 		}
+		required_clusters += (new_entries[i] - free_slots + entries_per_cluster - 1) / entries_per_cluster;
+	}
+	if (required_clusters > UINT16_MAX || !hasEnoughFreeClusters(static_cast<uint32_t>(required_clusters)))
+	{
+		std::cerr << "ERROR: Not enough free clusters for the new files." << std::endl;
+		return false;
 	}
-}
 
-inline void FAT12::updateDiskImageFatTable(std::fstream &writable_disk_image)
-{
-	std::vector<uint8_t> packed_fat_table;
+	// Nothing has changed so far; from here on a failure undoes everything up to the flush
+	Savepoint before = savepoint();
+	auto fail = [&](const char *message)
+	{
+		if (message)
+			std::cerr << "ERROR: " << message << std::endl;
+		rollback(before);
+		return false;
+	};
+
+	// Parents always come before their children in targets
+	for (ImportTarget &target : targets)
+	{
+		if (target.node != DirectoryTree::no_node)
+			continue;
+		target.node = createDirectory(targets[target.parent].node, target.entry);
+		if (target.node == DirectoryTree::no_node)
+		{
+			std::cerr << "ERROR: Failed to create directory " << target.entry.fullName() << std::endl;
+			return fail(nullptr);
+		}
+	}
 
-	for (size_t i = 0; i < fat_table.size(); i += 2)
+	// One allocation for every file, carved up in address order
+	uint64_t data_clusters = 0;
+	for (const ImportFile &file : files)
+		data_clusters += (file.size + cluster_size - 1) / cluster_size;
+	std::vector<ClusterAllocator::Extent> extents;
+	if (data_clusters > 0 && !cluster_allocator.allocate(static_cast<uint32_t>(data_clusters), extents))
+		return fail("Not enough free clusters for the new files.");
+
+	size_t next_extent = 0;
+	for (ImportFile &file : files)
 	{
-		uint16_t entry1 = fat_table[i].value;
-		uint16_t entry2 = (i + 1 < fat_table.size()) ? fat_table[i + 1].value : 0;
+		for (uint64_t needed = (file.size + cluster_size - 1) / cluster_size; needed > 0;)
+		{
+			ClusterAllocator::Extent &extent = extents[next_extent];
+			uint16_t taken = static_cast<uint16_t>(std::min<uint64_t>(needed, extent.count));
+			file.extents.push_back({ extent.first, taken });
+			extent.first += taken;
+			extent.count -= taken;
+			needed -= taken;
+			if (extent.count == 0)
+				++next_extent;
+		}
+		linkClusterChain(file.extents);
+
+		size_t slot = 0;
+		if (!findFreeEntry(targets[file.target].node, slot))
+			return fail(nullptr);
+		file.entry.first_logical_cluster = file.extents.empty() ? 0 : file.extents.front().first;
+		file.entry.file_size = static_cast<uint32_t>(file.size);
+		directory_tree.insert(targets[file.target].node, slot, file.entry);
+		if (!stageDirectoryEntry(targets[file.target].node, slot))
+			return fail("Failed to stage a directory entry.");
+	}
 
-		// Pack two 12-bit values into three bytes
-		uint8_t byte1 = entry1 & 0xFF;
-		uint8_t byte2 = ((entry1 >> 8) & 0x0F) | ((entry2 & 0x0F) << 4);
-		uint8_t byte3 = (entry2 >> 4) & 0xFF;
+	// A short read here (a source shrunk since it was opened) leaves no entry behind
+	if (!writeImportData(files))
+		return fail("Failed to write to the disk image.");
+
+	// Metadata goes through the write-back cache, flushed once unless syncs are deferred
+	if (deferred_sync)
+		return true;
+	if (!stageFatSectors())
+		return fail("Failed to update the disk image metadata.");
+
+	// A flush that fails part way may have written some sectors, so keep what each
+	// held before the batch and write that back before rolling back
+	WriteBackCache::Staged undo = before.staged;
+	uint32_t sector_size = layout.sector_size;
+	for (const auto &[sector, bytes] : metadata_cache.staged())
+	{
+		if (undo.count(sector))
+			continue;
+		std::span<const std::byte> original = disk_image->bytes(sector * sector_size, sector_size);
+		undo[sector].assign(original.begin(), original.end());
+	}
+	if (metadata_cache.flush())
+		return true;
 
-		packed_fat_table.push_back(byte1);
-		packed_fat_table.push_back(byte2);
-		packed_fat_table.push_back(byte3);
+	metadata_cache.restore(undo);
+	bool restored = metadata_cache.flush();
+	fail("Failed to update the disk image metadata.");
+	if (!restored)
+	{
+		// Retried by the next sync; until then the image may hold part of the batch
+		std::cerr << "ERROR: Failed to restore the disk image metadata; check -r may be needed." << std::endl;
+		metadata_cache.restore(std::move(undo));
 	}
+	return false;
+}
 
-	// Write the packed FAT table to the disk image
-	uint32_t fat_offset = boot_sector_contents.num_reserved_sectors * boot_sector_contents.sector_size;
-	writable_disk_image.seekp(fat_offset);
-	writable_disk_image.write(reinterpret_cast<char*>(packed_fat_table.data()), packed_fat_table.size());
+bool FAT12::openImportFile(const std::filesystem::path &source, size_t target, std::vector<ImportFile> &files)
+{
+	ImportFile file;
+	if (!std::filesystem::is_regular_file(source) || !file.input.open(source.string(), File::Mode::Read))
+	{
+		std::cerr << "ERROR: Failed to open input file: " << source.string() << std::endl;
+		return false;
+	}
+	file.size = file.input.size();
+	if (file.size > UINT32_MAX)
+	{
+		std::cerr << "ERROR: Input file is too large: " << source.string() << std::endl;
+		return false;
+	}
+	file.target = target;
+	updateNewEntryFields(file.entry, source.filename().string());
+	files.push_back(std::move(file));
+	return true;
+}
+
+uint32_t FAT12::findTargetDirectory(const std::string &target_directory)
+{
+	uint32_t directory = findNode(target_directory);
+	if (directory == DirectoryTree::no_node || !directory_tree.entry(directory).isDirectory() || !loadDirectory(directory))
+	{
+		std::cerr << "ERROR: Directory not found: " << target_directory << std::endl;
+		return DirectoryTree::no_node;
+	}
+	return directory;
 }
 
-inline void FAT12::updateDiskImageRootDirectory(std::fstream &writable_disk_image)
+inline bool FAT12::stageFatSectors()
 {
-	// Calculate the offset to the root directory
-	uint32_t root_dir_offset = (boot_sector_contents.num_reserved_sectors +
-		(boot_sector_contents.num_fats * boot_sector_contents.sectors_per_fat)) *
-		boot_sector_contents.sector_size;
+	if (std::find(dirty_fat_sectors.begin(), dirty_fat_sectors.end(), true) == dirty_fat_sectors.end())
+		return true;
 
-	// Seek to the root directory on the writable disk image
-	writable_disk_image.seekp(root_dir_offset);
+	std::span<const std::byte> current_fat = disk_image->bytes(layout.fat_offset, FatCodec::packedSize(fat_table.size()));
+	if (current_fat.empty())
+		return false;
 
-	// Write the modified root directory entries
-	for (const auto& entry : root_directory_entries)
+	// Pack the table over the current bytes so a trailing half entry is preserved
+	std::vector<std::byte> packed_fat_table(current_fat.begin(), current_fat.end());
+	FatCodec::encode(fat_table, packed_fat_table);
+
+	// Only changed sectors are staged, once per FAT copy
+	uint32_t sector_size = layout.sector_size;
+	for (size_t sector = 0; sector < dirty_fat_sectors.size(); ++sector)
 	{
-		// Convert the entry's name and extension to the format used in the directory entry
-		char name[8], extension[3];
-		std::fill(std::begin(name), std::end(name), ' ');
-		std::fill(std::begin(extension), std::end(extension), ' ');
+		if (!dirty_fat_sectors[sector])
+			continue;
+
+		std::span<const std::byte> bytes = std::span(packed_fat_table).subspan(sector * sector_size,
+			std::min<size_t>(sector_size, packed_fat_table.size() - sector * sector_size));
+		for (uint32_t copy = 0; copy < layout.fat_count; ++copy)
+		{
+			if (!metadata_cache.stage(layout.fatCopyOffset(copy) + sector * sector_size, bytes))
+				return false;
+		}
+		dirty_fat_sectors[sector] = false;
+	}
+	return true;
+}
 
-		// Copy the characters from the entry's name and extension
-		std::copy(entry.name.begin(), entry.name.end(), name);
-		std::copy(entry.extension.begin(), entry.extension.end(), extension);
+inline bool FAT12::flushMetadata()
+{
+	FAT12_TIME(flush_metadata);
+	return stageFatSectors() && metadata_cache.flush();
+}
 
-		// Write the name and extension
-		writable_disk_image.write(name, sizeof(name));
-		writable_disk_image.write(extension, sizeof(extension));
+bool FAT12::stageDirectoryEntry(uint32_t directory, size_t slot)
+{
+	const DirectoryTree::Table &table = directory_tree.tables()[directory_tree.node(directory).table];
+	std::span<const std::byte> entry = std::as_bytes(std::span(&table.entries[slot], 1));
 
-		// Write the remaining fields of the directory entry
-		writable_disk_image.write(reinterpret_cast<const char*>(&entry.attributes), sizeof(entry.attributes));
-		writable_disk_image.write(reinterpret_cast<const char*>(&entry.reserved), sizeof(entry.reserved));
-		writable_disk_image.write(reinterpret_cast<const char*>(&entry.creation_time), sizeof(entry.creation_time));
-		writable_disk_image.write(reinterpret_cast<const char*>(&entry.creation_date), sizeof(entry.creation_date));
-		writable_disk_image.write(reinterpret_cast<const char*>(&entry.last_access_date), sizeof(entry.last_access_date));
-		uint16_t zero = 0;
-		writable_disk_image.write(reinterpret_cast<const char*>(&zero), sizeof(zero));
-		writable_disk_image.write(reinterpret_cast<const char*>(&entry.last_write_time), sizeof(entry.last_write_time));
-		writable_disk_image.write(reinterpret_cast<const char*>(&entry.last_write_date), sizeof(entry.last_write_date));
-		writable_disk_image.write(reinterpret_cast<const char*>(&entry.first_logical_cluster), sizeof(entry.first_logical_cluster));
-		writable_disk_image.write(reinterpret_cast<const char*>(&entry.file_size), sizeof(entry.file_size));
+	if (directory == DirectoryTree::root)
+	{
+		return metadata_cache.stage(layout.root_offset + slot * sizeof(DirectoryEntry), entry);
 	}
+
+	// Subdirectory slots live in the cluster of the chain that holds them
+	uint32_t cluster_size = layout.cluster_size;
+	uint64_t slot_offset = slot * sizeof(DirectoryEntry);
+	ChainCache::ChainRef chain = chain_cache.find(table.first_cluster, fat_table);
+	if (!chain)
+		return false;
+	auto extent = ChainCache::seek(*chain, static_cast<uint32_t>(slot_offset / cluster_size));
+	if (extent == chain->end())
+		return false;
+
+	uint64_t cluster_offset = layout.clusterOffset(extent->first);
+	return metadata_cache.stage(cluster_offset + slot_offset - static_cast<uint64_t>(extent->logical_cluster) * cluster_size, entry);
 }
 
 
 // Public member function implementations
-FAT12::FAT12(const std::string& image)
+FAT12::FAT12(const std::string& image, const MountOptions &options)
 {
+	FAT12_TIME(mount);
 	disk_image_name = image;
 	boot_sector_contents.sector_size = 0;
 	boot_sector_contents.sectors_per_cluster = 0;
@@ -453,312 +710,1328 @@ FAT12::FAT12(const std::string& image)
 	boot_sector_contents.total_sector_count = 0;
 	boot_sector_contents.sectors_per_fat = 0;
 
-	disk_image.open(image, std::ios::binary);
-	if (!disk_image.is_open())
+	if (!options.overlay.empty())
+	{
+		auto overlay_device = std::make_unique<OverlayBlockDevice>();
+		if (overlay_device->open(image, options.overlay))
+		{
+			overlay = overlay_device.get();
+			disk_image = std::move(overlay_device);
+		}
+	}
+	else
+		disk_image = BlockDevice::open(image, options.backend);
+	if (!disk_image)
 	{
 		std::cerr << "ERROR: Failed to open the disk image." << std::endl;
 		return;
 	}
+	if (disk_image->size() < 512)
+	{
+		std::cerr << "ERROR: Disk image is too small to hold a boot sector." << std::endl;
+		disk_image.reset();
+		overlay = nullptr;
+		return;
+	}
 
-	readBootSector();
-	readFat();
-	readRootDirectoryEntries();
-	readSubdirectoriesEntries();
+	// A journal left behind by a crash holds the newest metadata, so it goes in before anything is parsed.
+	// Overlay sessions keep theirs next to the delta, since the base is shared.
+	journal_path = MetadataJournal::pathFor(overlay ? options.overlay : image);
+	uint32_t replayed = 0;
+	if (!MetadataJournal::recover(journal_path, *disk_image, replayed))
+	{
+		disk_image.reset();
+		overlay = nullptr;
+		return;
+	}
+	if (replayed != 0)
+		std::cerr << "Recovered " << replayed << " metadata transaction(s) from the journal." << std::endl;
+
+	if (!readBootSector())
+	{
+		std::cerr << "ERROR: Boot sector does not describe a FAT12 volume." << std::endl;
+		disk_image.reset();
+		overlay = nullptr;
+		return;
+	}
+	if (!options.snapshots || !mountFromSnapshot(*options.snapshots))
+		readFat();
+	journaled = options.journal;
+	if (journaled)
+		journal.reset(journal_path);
+	metadata_cache.reset(disk_image.get(), layout.sector_size, journaled ? &journal : nullptr);
+	deferred_sync = options.deferred_sync;
+	if (!options.lazy_directories)
+		loadSubtree(DirectoryTree::root);
+}
+
+FAT12::~FAT12()
+{
+	// The journal is only dropped once everything it covers is durable in the image
+	if (sync() && journaled && journal.isOpen() && metadata_cache.checkpoint())
+		journal.remove();
 }
 
-void FAT12::LS()
+bool FAT12::LS(const std::string &path, std::ostream &out)
 {
-	std::cout << std::left;
+	std::unique_lock state_lock(state_mutex);
+	uint32_t directory = findNode(path);
+	if (directory == DirectoryTree::no_node || !directory_tree.entry(directory).isDirectory())
+	{
+		std::cerr << "ERROR: Directory not found: " << path << std::endl;
+		return false;
+	}
+	loadSubtree(directory);
+
+	out << std::left;
 	int table_width = 53;  
 	int title_padding = (table_width - 32) / 2;
 
 	// Print the top of the table
-	std::cout << std::setw(table_width) << std::setfill('-') << "" << std::setfill(' ') << std::endl;
+	out << std::setw(table_width) << std::setfill('-') << "" << std::setfill(' ') << std::endl;
 
 	// Print the title with centered text
-	std::cout << std::setw(title_padding) << "" << "| Listing Files and Directories |" << std::setw(table_width - title_padding - 32)  << std::endl;
+	out << std::setw(title_padding) << "" << "| Listing Files and Directories |" << std::setw(table_width - title_padding - 32)  << std::endl;
 
 	// Print the separator
-	std::cout << std::setw(table_width) << std::setfill('-') << "" << std::setfill(' ') << std::endl;
+	out << std::setw(table_width) << std::setfill('-') << "" << std::setfill(' ') << std::endl;
 
-	listDirectory(root_directory_entries);
-	for(const auto& subdirectory_entries : subdirectories)
-		listDirectory(subdirectory_entries.second);
-	std::cout << "\n" << std::endl;
+	// Breadth-first, so each directory is listed before anything below it
+	std::vector<uint32_t> pending{ directory };
+	for (size_t next = 0; next < pending.size(); ++next)
+	{
+		const DirectoryTree::Node &node = directory_tree.node(pending[next]);
+		listDirectory(directory_tree.entries(pending[next]), pending[next] == DirectoryTree::root ? node.path : node.path + "/", out);
+		for (uint32_t child = node.first_child; child != DirectoryTree::no_node; child = directory_tree.node(child).next_sibling)
+		{
+			if (directory_tree.isLoaded(child))
+				pending.push_back(child);
+		}
+	}
+	out << "\n" << std::endl;
+	return true;
 }
 
-void FAT12::LS1()
+void FAT12::LS1(std::ostream &out)
 {
-	std::cout << std::left;
+	std::unique_lock state_lock(state_mutex);
+	out << std::left;
 	int table_width = 53;
 	int title_padding = (table_width - 29) / 2;
 
 	// Print the top of the table
-	std::cout << std::setw(table_width) << std::setfill('-') << "" << std::setfill(' ') << std::endl;
+	out << std::setw(table_width) << std::setfill('-') << "" << std::setfill(' ') << std::endl;
 
 	// Print the title with centered text
-	std::cout << std::setw(title_padding) << "" << "| Listing Root Directory |" << std::setw(table_width - title_padding - 29) << std::endl;
+	out << std::setw(title_padding) << "" << "| Listing Root Directory |" << std::setw(table_width - title_padding - 29) << std::endl;
 
 	// Print the separator
-	std::cout << std::setw(table_width) << std::setfill('-') << "" << std::setfill(' ') << std::endl;
+	out << std::setw(table_width) << std::setfill('-') << "" << std::setfill(' ') << std::endl;
 
-	listDirectory(root_directory_entries);
-	std::cout << "\n" << std::endl;
+	loadDirectory(DirectoryTree::root);
+	listDirectory(directory_tree.entries(DirectoryTree::root), "/", out);
+	out << "\n" << std::endl;
 }
 
-void FAT12::copyToSystem(const std::string& file_path)
+bool FAT12::forEachEntry(const std::string &path, bool recursive, const std::function<void(const std::string &, const DirectoryEntry &)> &visit)
 {
-	size_t last_slash = file_path.find_last_of('/');
-	std::string last_subdirectory = "";
-	std::string path = file_path.substr(0, last_slash+1);
-
-	// Find Last Subdirectory in file_path
-	if (last_slash != std::string::npos)
+	std::unique_lock state_lock(state_mutex);
+	uint32_t directory = findNode(path);
+	if (directory == DirectoryTree::no_node || !directory_tree.entry(directory).isDirectory())
 	{
-		size_t secondLastSlashPos = file_path.find_last_of('/', last_slash - 1);
-		if (secondLastSlashPos != std::string::npos)
-			last_subdirectory = file_path.substr(secondLastSlashPos + 1, last_slash - secondLastSlashPos - 1);
+		std::cerr << "ERROR: Directory not found: " << path << std::endl;
+		return false;
 	}
-	bool is_in_root_directory = (last_subdirectory.empty());
-
-	if (!is_in_root_directory)
+	if (recursive)
+		loadSubtree(directory);
+	else
+		loadDirectory(directory);
+
+	// Same order as LS: breadth-first, each table in slot order
+	std::vector<uint32_t> pending{ directory };
+	for (size_t next = 0; next < pending.size(); ++next)
 	{
-		auto valid_subdir = subdirectories.find(last_subdirectory);
-
-		if (valid_subdir == subdirectories.end())
+		const DirectoryTree::Node &node = directory_tree.node(pending[next]);
+		std::string prefix = pending[next] == DirectoryTree::root ? node.path : node.path + "/";
+		for (const DirectoryEntry &entry : directory_tree.entries(pending[next]))
 		{
-			std::cerr << "ERROR: Subdirectory not found: " << last_subdirectory << std::endl;
-			return;
+			if (!entry.isFree() && !entry.isDotEntry())
+				visit(prefix + entry.fullName(), entry);
 		}
-
-		bool found{ false };
-		for (const auto& entry : valid_subdir->second)
+		for (uint32_t child = node.first_child; recursive && child != DirectoryTree::no_node; child = directory_tree.node(child).next_sibling)
 		{
-			if (entry.path == path)
-			{
-				found = true;
-				break;
-			}
+			if (directory_tree.isLoaded(child))
+				pending.push_back(child);
 		}
-		if (!found)
+	}
+	return true;
+}
+
+const DirectoryEntry *FAT12::findFile(const std::string &file_path)
+{
+	// One hash lookup on the full path once the directories on the way are loaded
+	uint32_t node = findNode(file_path);
+	if (node == DirectoryTree::no_node || directory_tree.entry(node).isDirectory())
+	{
+		std::cerr << "ERROR: File not found." << std::endl;
+		return nullptr;
+	}
+	return &directory_tree.entry(node);
+}
+
+bool FAT12::lookupFile(const std::string &file_path, DirectoryEntry &entry, ChainCache::ChainRef &chain)
+{
+	// Lookups may load directories and fill the chain cache, so readers take turns here
+	std::lock_guard lookup_lock(lookup_mutex);
+	const DirectoryEntry *found = findFile(file_path);
+	if (!found)
+		return false;
+	entry = *found;
+
+	// The chain is cached as runs of physically contiguous clusters
+	chain = chain_cache.find(entry.first_logical_cluster, fat_table);
+	if (!chain)
+	{
+		std::cerr << "ERROR: Broken cluster chain: " << entry.fullName() << std::endl;
+		return false;
+	}
+	return true;
+}
+
+std::vector<std::byte> FAT12::readRange(const DirectoryEntry &entry, const ChainCache::Chain &chain, uint32_t offset, uint32_t length)
+{
+	std::vector<std::byte> data;
+	if (offset >= entry.file_size)
+		return data;
+	length = std::min(length, entry.file_size - offset);
+
+	// Binary search for the extent holding offset, then copy run by run
+	uint32_t cluster_size = layout.cluster_size;
+	auto extent = ChainCache::seek(chain, offset / cluster_size);
+	if (extent == chain.end())
+		return data;
+
+	data.reserve(length);
+	uint64_t offset_in_extent = offset - static_cast<uint64_t>(extent->logical_cluster) * cluster_size;
+	for (; extent != chain.end() && data.size() < length; ++extent)
+	{
+		uint64_t run_offset = layout.clusterOffset(extent->first) + offset_in_extent;
+		uint64_t run_bytes = std::min<uint64_t>(static_cast<uint64_t>(extent->count) * cluster_size - offset_in_extent,
+			length - data.size());
+
+		std::span<const std::byte> run = disk_image->bytes(run_offset, run_bytes);
+		if (run.empty())
+			break;
+		data.insert(data.end(), run.begin(), run.end());
+		offset_in_extent = 0;
+	}
+	return data;
+}
+
+bool FAT12::copyEntryToFile(const DirectoryEntry &entry, const ChainCache::Chain &chain, const std::string &destination)
+{
+	FAT12_TIME(copy_file);
+	std::string full_name = entry.fullName();
+
+	// Open the file on the host system for writing
+	File output_file;
+	if (!output_file.open(destination, File::Mode::Create))
+	{
+		std::cerr << "ERROR: Failed to open output file: " << destination << std::endl;
+		return false;
+	}
+
+	// Copy each run in one call with positional I/O, stopping at the file size
+	uint32_t cluster_size = layout.cluster_size;
+	uint64_t remaining_bytes = entry.file_size;
+	uint64_t output_offset = 0;
+	for (const ChainCache::Extent &extent : chain)
+	{
+		if (remaining_bytes == 0)
+			break;
+
+		uint64_t run_offset = layout.clusterOffset(extent.first);
+		uint64_t run_bytes = std::min<uint64_t>(static_cast<uint64_t>(extent.count) * cluster_size, remaining_bytes);
+		if (!disk_image->copyTo(run_offset, run_bytes, output_file, output_offset))
 		{
-			std::cerr << "ERROR: Subdirectory not found." << std::endl;
-			return;
+			std::cerr << "ERROR: Failed to copy " << full_name << " out of the disk image." << std::endl;
+			return false;
 		}
-	
+		output_offset += run_bytes;
+		remaining_bytes -= run_bytes;
 	}
-	std::string file_name = file_path.substr(last_slash + 1);
 
-	const std::vector<DirectoryEntry>& directory_entries = is_in_root_directory ? root_directory_entries : subdirectories[last_subdirectory];
+	if (remaining_bytes > 0)
+	{
+		std::cerr << "ERROR: Cluster chain is shorter than the file size: " << full_name << std::endl;
+		return false;
+	}
+	return true;
+}
 
-	// Find the entry for the specified file in the directory
-	for (const DirectoryEntry& entry : directory_entries)
+bool FAT12::copyToSystem(const std::string& file_path, const std::string &destination, std::ostream &out)
+{
+	if (!disk_image)
+	{
+		std::cerr << "ERROR: No disk image mounted." << std::endl;
+		return false;
+	}
+
+	// Exports only read the image, so any number of them can run at once
+	std::shared_lock state_lock(state_mutex);
+	DirectoryEntry entry;
+	ChainCache::ChainRef chain;
+	if (!lookupFile(file_path, entry, chain))
+		return false;
+
+	std::string full_name = entry.fullName();
+	if (!copyEntryToFile(entry, *chain, destination.empty() ? full_name : destination))
+		return false;
+	out << "File copied to system: " << full_name << std::endl;
+	return true;
+}
+
+// Every file below a directory with its chain resolved, found under the lookup
+// lock; the caller holds state_mutex shared for as long as it uses the chains.
+// enter_directory sees each loaded directory, the root first, and can skip it.
+bool FAT12::collectFiles(const std::string &directory, std::vector<FileJob> &jobs, const std::function<bool(const std::string &)> &enter_directory)
+{
+	std::lock_guard lookup_lock(lookup_mutex);
+	uint32_t root = findNode(directory);
+	if (root == DirectoryTree::no_node || !directory_tree.entry(root).isDirectory())
+	{
+		std::cerr << "ERROR: Directory not found: " << directory << std::endl;
+		return false;
+	}
+	loadSubtree(root);
+
+	std::vector<uint32_t> pending{ root };
+	for (size_t next = 0; next < pending.size(); ++next)
 	{
-		std::string full_name = entry.name + "." + entry.extension;
-		if (full_name == file_name)
+		if (enter_directory && !enter_directory(directory_tree.node(pending[next]).path))
+			continue;
+
+		for (uint32_t child = directory_tree.node(pending[next]).first_child; child != DirectoryTree::no_node;
+			child = directory_tree.node(child).next_sibling)
 		{
-			// Open the file on the host system for writing
-			std::ofstream output_file(full_name, std::ios::binary);
+			const DirectoryEntry &entry = directory_tree.entry(child);
+			if (entry.isDirectory())
+			{
+				if (directory_tree.isLoaded(child))
+					pending.push_back(child);
+				continue;
+			}
 
-			if (!output_file.is_open())
+			ChainCache::ChainRef chain = chain_cache.find(entry.first_logical_cluster, fat_table);
+			if (!chain)
 			{
-				std::cerr << "ERROR: Failed to open output file." << std::endl;
-				return;
+				std::cerr << "ERROR: Broken cluster chain: " << directory_tree.node(child).path << std::endl;
+				continue;
 			}
+			jobs.push_back({ directory_tree.node(child).path, entry, std::move(chain) });
+		}
+	}
+	return true;
+}
 
-			// Read the entire file content by traversing the FAT
-			uint16_t current_cluster = entry.first_logical_cluster;
-			std::vector<char> buffer;
+bool FAT12::exportTree(const std::string &source_directory, const std::string &host_directory, size_t thread_count, std::ostream &out)
+{
+	FAT12_TIME(export_tree);
+	if (!disk_image)
+	{
+		std::cerr << "ERROR: No disk image mounted." << std::endl;
+		return false;
+	}
 
-			while (current_cluster < 0xFF8)
-			{
-				uint32_t cluster_offset = ((33 + current_cluster - 2) *
-					boot_sector_contents.sectors_per_cluster *
-					boot_sector_contents.sector_size);
-				disk_image.seekg(cluster_offset);
+	// Held until every copy is done; the copies themselves take no locks
+	std::shared_lock state_lock(state_mutex);
 
-				// Read the content of the current cluster
-				buffer.resize(boot_sector_contents.sectors_per_cluster * boot_sector_contents.sector_size);
-				disk_image.read(buffer.data(), buffer.size());
+	// Mirror the directories on the host before any copy starts; a directory
+	// that cannot be created is skipped along with everything below it
+	std::string root_path;
+	auto hostPath = [&](const std::string &path)
+	{
+		std::string_view relative = std::string_view(path).substr(root_path.size());
+		return std::filesystem::path(host_directory) / relative.substr(relative.starts_with('/') ? 1 : 0);
+	};
+	std::vector<FileJob> jobs;
+	bool found = collectFiles(source_directory, jobs, [&](const std::string &path)
+	{
+		if (root_path.empty())
+			root_path = path;
+		std::filesystem::path destination = hostPath(path);
+		std::error_code error;
+		std::filesystem::create_directories(destination, error);
+		if (error)
+			std::cerr << "ERROR: Failed to create host directory: " << destination.string() << std::endl;
+		return !error;
+	});
+	if (!found)
+		return false;
+
+	// Largest files first: each worker runs its deque front to back and thieves
+	// take from the back, so the big copies start early and none is left at the end
+	std::sort(jobs.begin(), jobs.end(), [](const FileJob &a, const FileJob &b) { return a.entry.file_size > b.entry.file_size; });
+
+	std::atomic<size_t> failed_files{ 0 };
+	size_t workers = std::min(thread_count != 0 ? thread_count : std::thread::hardware_concurrency(), std::max<size_t>(jobs.size(), 1));
+	if (workers <= 1)
+	{
+		// No pool for a single worker; callers running many images at once ask for this
+		for (const FileJob &job : jobs)
+		{
+			if (!copyEntryToFile(job.entry, *job.chain, hostPath(job.path).string()))
+				++failed_files;
+		}
+	}
+	else
+	{
+		ThreadPool pool(workers);
+		for (const FileJob &job : jobs)
+		{
+			pool.submit([this, &job, &failed_files, &hostPath]
+			{
+				if (!copyEntryToFile(job.entry, *job.chain, hostPath(job.path).string()))
+					++failed_files;
+			});
+		}
+		pool.wait();
+	}
 
-				// Calculate the amount of data to write
-				size_t data_to_write = std::min<size_t>(entry.file_size, buffer.size());
+	out << "Files copied to system: " << jobs.size() - failed_files << " of " << jobs.size()
+		<< " into " << host_directory << std::endl;
+	return failed_files == 0;
+}
 
-				// Write the actual data to the output file
-				output_file.write(buffer.data(), data_to_write);
+bool FAT12::hashEntry(const DirectoryEntry &entry, const ChainCache::Chain &chain, bool sha256, FileHash &hash)
+{
+	// Each run is fed from the mapped image as is; nothing is copied
+	ContentHash::Hasher64 hasher;
+	ContentHash::Sha256 digest;
+	uint32_t cluster_size = layout.cluster_size;
+	uint64_t remaining_bytes = entry.file_size;
+	for (const ChainCache::Extent &extent : chain)
+	{
+		if (remaining_bytes == 0)
+			break;
 
-				// Move to the next cluster in the chain
-				current_cluster = fat_table[current_cluster].value;
-			}
+		uint64_t run_bytes = std::min<uint64_t>(static_cast<uint64_t>(extent.count) * cluster_size, remaining_bytes);
+		std::span<const std::byte> run = disk_image->bytes(layout.clusterOffset(extent.first), run_bytes);
+		if (run.size() != run_bytes)
+			break;
+		hasher.update(run);
+		if (sha256)
+			digest.update(run);
+		remaining_bytes -= run_bytes;
+	}
 
-			output_file.close();
-			std::cout << "File copied to system: " << full_name << std::endl;
-			return;
-		}
+	if (remaining_bytes > 0)
+	{
+		std::cerr << "ERROR: Cluster chain is shorter than the file size: " << hash.path << std::endl;
+		return false;
 	}
-	std::cerr << "ERROR: File not found." << std::endl;
+	hash.size = entry.file_size;
+	hash.hash = hasher.finish();
+	hash.has_sha256 = sha256;
+	if (sha256)
+		hash.sha256 = digest.finish();
+	return true;
 }
 
-void FAT12::copyFromSystem(const std::string &source)
+bool FAT12::hashFiles(const std::string &directory, bool sha256, size_t thread_count, std::vector<FileHash> &hashes)
 {
-	size_t file_name_pos = source.find_last_of('/');
-	const std::string& destination = source.substr(file_name_pos+1);
-	
-	// Try to find the entry for the specified destination file in the root directory
-	for (DirectoryEntry &entry : root_directory_entries)
+	FAT12_TIME(hash_files);
+	hashes.clear();
+	if (!disk_image)
 	{
-		std::string full_name = entry.name + "." + entry.extension;
-		if (full_name == destination)
+		std::cerr << "ERROR: No disk image mounted." << std::endl;
+		return false;
+	}
+
+	// Same locking as exportTree: shared for the whole pass, lookups serialized
+	std::shared_lock state_lock(state_mutex);
+	std::vector<FileJob> jobs;
+	if (!collectFiles(directory, jobs))
+		return false;
+
+	// Largest files first, which the pool starts in that order (see exportTree),
+	// so no worker is left with a big file at the end
+	std::sort(jobs.begin(), jobs.end(), [](const FileJob &a, const FileJob &b) { return a.entry.file_size > b.entry.file_size; });
+	hashes.resize(jobs.size());
+	for (size_t index = 0; index < jobs.size(); index++)
+		hashes[index].path = std::move(jobs[index].path);
+
+	std::atomic<size_t> failed_files{ 0 };
+	std::vector<char> failed(hashes.size(), 0);
+	size_t workers = std::min(thread_count != 0 ? thread_count : std::thread::hardware_concurrency(), std::max<size_t>(jobs.size(), 1));
+	auto run = [this, sha256, &jobs, &hashes, &failed, &failed_files](size_t index)
+	{
+		if (!hashEntry(jobs[index].entry, *jobs[index].chain, sha256, hashes[index]))
 		{
-			std::cerr << "ERROR: File already exists in the destination." << std::endl;
-			return;
+			failed[index] = 1;
+			++failed_files;
 		}
+	};
+	if (workers <= 1)
+	{
+		for (size_t index = 0; index < jobs.size(); index++)
+			run(index);
+	}
+	else
+	{
+		ThreadPool pool(workers);
+		for (size_t index = 0; index < jobs.size(); index++)
+			pool.submit([&run, index] { run(index); });
+		pool.wait();
 	}
 
-	// Open the file on the host system for reading
-	std::ifstream input_file(source, std::ios::binary);
-	if (!input_file.is_open())
+	// Drop unreadable files, then order by path
+	if (failed_files > 0)
 	{
-		std::cerr << "ERROR: Failed to open input file." << std::endl;
-		return;
+		size_t kept = 0;
+		for (size_t index = 0; index < hashes.size(); index++)
+		{
+			if (failed[index])
+				continue;
+			if (kept != index)
+				hashes[kept] = std::move(hashes[index]);
+			kept++;
+		}
+		hashes.resize(kept);
 	}
+	std::sort(hashes.begin(), hashes.end(), [](const FileHash &a, const FileHash &b) { return a.path < b.path; });
+	return failed_files == 0;
+}
 
-	// Copy the content from the source file to the buffer
-	std::vector<char> buffer(std::istreambuf_iterator<char>(input_file), {});
+bool FAT12::readAt(const DirectoryEntry &entry, uint32_t offset, uint32_t length, std::vector<std::byte> &data)
+{
+	data.clear();
+	if (!disk_image)
+		return false;
 
-	// Check if fat_table has enough free clusters for file content 
-	uint32_t required_clusters = static_cast<uint32_t>(std::ceil(static_cast<double>(buffer.size()) /
-		(boot_sector_contents.sectors_per_cluster * boot_sector_contents.sector_size)));
-	if (!hasEnoughFreeClusters(required_clusters))
+	std::shared_lock state_lock(state_mutex);
+	ChainCache::ChainRef chain;
 	{
-		std::cerr << "ERROR: Not enough free clusters for the new file." << std::endl;
-		input_file.close();
-		return;
+		std::lock_guard lookup_lock(lookup_mutex);
+		chain = chain_cache.find(entry.first_logical_cluster, fat_table);
+	}
+	if (!chain)
+	{
+		std::cerr << "ERROR: Broken cluster chain: " << entry.fullName() << std::endl;
+		return false;
 	}
+	data = readRange(entry, *chain, offset, length);
+	return true;
+}
 
-	// Try to find a free entry in the root directory for the new file
-	DirectoryEntry new_entry;
-	size_t insert_index = 0; // Track the index of the free entry
-	findFreeEntry(new_entry, insert_index, input_file);
+bool FAT12::readAt(const std::string &file_path, uint32_t offset, uint32_t length, std::vector<std::byte> &data)
+{
+	data.clear();
+	if (!disk_image)
+		return false;
+
+	std::shared_lock state_lock(state_mutex);
+	DirectoryEntry entry;
+	ChainCache::ChainRef chain;
+	if (!lookupFile(file_path, entry, chain))
+		return false;
+	data = readRange(entry, *chain, offset, length);
+	return true;
+}
 
-	// Update the new entry with the destination file name (and other fields)
-	updateNewEntryFields(new_entry, destination);
+bool FAT12::copyFromSystem(const std::string &source, std::ostream &out)
+{
+	if (!importBatch({ source }, "/"))
+		return false;
+	out << "File copied from system to disk image: " << source.substr(source.find_last_of('/') + 1) << std::endl;
+	return true;
+}
 
-	// Insert the new_entry in root_directory
-	root_directory_entries[insert_index] = new_entry;
-		
-	// Open the disk image in writing mode
-	disk_image.close();
-	std::fstream writable_disk_image;
-	writable_disk_image.open(disk_image_name, std::ios::in | std::ios::out |std::ios::binary);
-	if (!writable_disk_image.is_open())
+bool FAT12::importBatch(const std::vector<std::string> &sources, const std::string &target_directory)
+{
+	if (!disk_image)
 	{
-		std::cerr << "ERROR: Failed to open disk image for writing." << std::endl;
-		input_file.close();
-		return;
+		std::cerr << "ERROR: No disk image mounted." << std::endl;
+		return false;
 	}
 
-	// Write the content of the input file to the disk image
-	writeInputFileInDiskImage(writable_disk_image, buffer, new_entry.first_logical_cluster, required_clusters);
+	// Imports change the FAT and directories, so they wait for every reader to leave
+	std::unique_lock state_lock(state_mutex);
+	std::vector<ImportTarget> targets{ { findTargetDirectory(target_directory), 0, {} } };
+	if (targets.front().node == DirectoryTree::no_node)
+		return false;
 
-	// Update file size of the new entry
-	root_directory_entries[insert_index].file_size = static_cast<uint32_t>(buffer.size());
+	std::vector<ImportFile> files;
+	for (const std::string &source : sources)
+	{
+		if (!openImportFile(source, 0, files))
+			return false;
+	}
+	return commitImport(targets, files);
+}
+
+bool FAT12::importTree(const std::string &host_directory, const std::string &target_directory, std::ostream &out)
+{
+	if (!disk_image)
+	{
+		std::cerr << "ERROR: No disk image mounted." << std::endl;
+		return false;
+	}
+
+	std::unique_lock state_lock(state_mutex);
+	std::vector<ImportTarget> targets{ { findTargetDirectory(target_directory), 0, {} } };
+	if (targets.front().node == DirectoryTree::no_node)
+		return false;
+
+	std::error_code error;
+	std::filesystem::recursive_directory_iterator walker(host_directory, error);
+	if (error)
+	{
+		std::cerr << "ERROR: Failed to open host directory: " << host_directory << std::endl;
+		return false;
+	}
 
-	// After updating the FAT table in memory, pack it and write it to the disk image
-	updateDiskImageFatTable(writable_disk_image);
+	// The walk reaches every directory before anything inside it; parents[depth]
+	// is the target the entries at that depth go into
+	std::vector<size_t> parents{ 0 };
+	std::vector<ImportFile> files;
+	for (; walker != std::filesystem::recursive_directory_iterator(); walker.increment(error))
+	{
+		if (error)
+		{
+			std::cerr << "ERROR: Failed to read host directory: " << host_directory << std::endl;
+			return false;
+		}
+		parents.resize(walker.depth() + 1);
+		const std::filesystem::path &path = walker->path();
 
-	// After updating the Root Directory in memory, write it to the disk image
-	updateDiskImageRootDirectory(writable_disk_image);
+		if (walker->is_directory())
+		{
+			ImportTarget target{ DirectoryTree::no_node, parents.back(), {} };
+			updateNewEntryFields(target.entry, path.filename().string());
+			target.entry.attributes = 0x10;
+			parents.push_back(targets.size());
+			targets.push_back(target);
+		}
+		else if (!openImportFile(path, parents.back(), files))
+			return false;
+	}
 
-	input_file.close();
-	writable_disk_image.close();
-	disk_image.open(disk_image_name, std::ios::binary);
-	std::cout << "File copied from system to disk image: " << destination << std::endl;
+	if (!commitImport(targets, files))
+		return false;
+	out << "Files copied from system to disk image: " << files.size() << " files, " << targets.size() - 1 << " directories" << std::endl;
+	return true;
 }
 
-void FAT12::analyzeDisk()
+DiskUsage FAT12::diskUsage()
 {
+	std::shared_lock state_lock(state_mutex);
+	DiskUsage usage;
 	// Calculate the partition size (capacity of storage)
-	uint32_t partition_size = boot_sector_contents.total_sector_count *
-		boot_sector_contents.sector_size;
+	usage.partition_size = static_cast<uint32_t>(layout.volume_size);
 
 	// Calculate the size of the reserved area (FAT tables and boot sector)
-	uint32_t reserved_size = boot_sector_contents.num_reserved_sectors *
-		boot_sector_contents.sector_size;
+	usage.reserved_size = static_cast<uint32_t>(layout.fat_offset);
 
 	// Calculate the size of one FAT table
-	uint32_t fat_size = boot_sector_contents.num_fats *
-		boot_sector_contents.sectors_per_fat *
-		boot_sector_contents.sector_size;
+	usage.fat_size = layout.fat_count * layout.fat_size;
 
 	// Calculate the size of the root directory
-	uint32_t root_directory_size = boot_sector_contents.max_num_root_entries * 32;
+	usage.root_directory_size = layout.rootSize();
+
+	// Calculate the size of the data area; sectors past the last whole cluster are not part of it
+	usage.data_area_size = layout.cluster_count * layout.cluster_size;
+
+	// Used, bad and reserved space come straight from the cluster counts
+	uint32_t cluster_size = layout.cluster_size;
+	const SpaceAccounting::Counts &counts = space_accounting.counts();
+	usage.used_space = counts.used * cluster_size;
+	usage.bad_space = counts.bad * cluster_size;
+	usage.reserved_cluster_space = counts.reserved * cluster_size;
+
+	// Calculate available space
+	usage.available_space = usage.data_area_size - usage.used_space - usage.bad_space - usage.reserved_cluster_space;
+
+	return usage;
+}
+
+SpaceDetails FAT12::spaceDetails()
+{
+	std::unique_lock state_lock(state_mutex);
+	loadSubtree(DirectoryTree::root);
+
+	SpaceDetails details;
+	uint32_t cluster_size = layout.cluster_size;
+	std::vector<bool> reached(fat_table.size(), false);
+	ChainCache::Chain chain;
+	// Clusters of a chain, marked as reached; broken chains count up to the break
+	auto walk = [&](uint16_t first_cluster)
+	{
+		ChainCache::resolve(first_cluster, fat_table, chain);
+		uint32_t clusters = 0;
+		for (const ChainCache::Extent &extent : chain)
+		{
+			std::fill_n(reached.begin() + extent.first, extent.count, true);
+			clusters += extent.count;
+		}
+		return clusters;
+	};
+
+	// Breadth-first, so every directory comes after its parent
+	std::vector<uint32_t> pending{ DirectoryTree::root };
+	std::vector<size_t> parents{ 0 };
+	for (size_t next = 0; next < pending.size(); ++next)
+	{
+		const DirectoryTree::Node &node = directory_tree.node(pending[next]);
+		DirectoryUsage usage{ node.path, 0, 0, 0 };
+		if (pending[next] != DirectoryTree::root)
+			usage.allocated_bytes = static_cast<uint64_t>(walk(directory_tree.entry(pending[next]).first_logical_cluster)) * cluster_size;
+
+		for (uint32_t child = node.first_child; child != DirectoryTree::no_node; child = directory_tree.node(child).next_sibling)
+		{
+			const DirectoryEntry &entry = directory_tree.entry(child);
+			if (entry.isDirectory())
+			{
+				if (directory_tree.isLoaded(child))
+				{
+					pending.push_back(child);
+					parents.push_back(next);
+				}
+				continue;
+			}
+
+			uint64_t allocated = static_cast<uint64_t>(walk(entry.first_logical_cluster)) * cluster_size;
+			++details.files;
+			details.extents += static_cast<uint32_t>(chain.size());
+			if (chain.size() > 1)
+				++details.fragmented_files;
+			if (allocated > entry.file_size)
+				details.slack_space += allocated - entry.file_size;
+
+			++usage.files;
+			usage.file_bytes += entry.file_size;
+			usage.allocated_bytes += allocated;
+		}
+		details.directories.push_back(std::move(usage));
+	}
+
+	// Fold every directory into its parent, deepest first
+	for (size_t index = details.directories.size() - 1; index > 0; --index)
+	{
+		DirectoryUsage &parent = details.directories[parents[index]];
+		parent.files += details.directories[index].files;
+		parent.file_bytes += details.directories[index].file_bytes;
+		parent.allocated_bytes += details.directories[index].allocated_bytes;
+	}
+
+	uint32_t end_cluster = space_accounting.trackedCount() + 2;
+	for (uint32_t cluster = 2; cluster < end_cluster; ++cluster)
+	{
+		if (fat_table[cluster] != 0x000 && fat_table[cluster] != 0xFF7 && !reached[cluster])
+			++details.lost_clusters;
+	}
+	return details;
+}
+
+uint32_t FAT12::countFatCopyMismatches()
+{
+	// Copies are compared with the table decoded from the first one
+	size_t packed_size = FatCodec::packedSize(fat_table.size());
+	std::span<const std::byte> first_copy = disk_image->bytes(layout.fat_offset, packed_size);
+	std::vector<uint16_t> copy_table(fat_table.size());
+	uint32_t mismatches = 0;
+
+	for (uint32_t copy = 1; copy < layout.fat_count; ++copy)
+	{
+		std::span<const std::byte> copy_bytes = disk_image->bytes(layout.fatCopyOffset(copy), packed_size);
+		if (copy_bytes.empty())
+		{
+			mismatches += static_cast<uint32_t>(fat_table.size());
+			continue;
+		}
+		if (!first_copy.empty() && std::memcmp(copy_bytes.data(), first_copy.data(), packed_size) == 0)
+			continue;
+
+		FatCodec::decode(copy_bytes, copy_table);
+		for (size_t cluster = 0; cluster < fat_table.size(); ++cluster)
+		{
+			if (copy_table[cluster] != fat_table[cluster])
+				++mismatches;
+		}
+	}
+	return mismatches;
+}
+
+void FAT12::cutChain(uint32_t node, uint16_t last_cluster)
+{
+	const DirectoryTree::Node &tree_node = directory_tree.node(node);
+	DirectoryEntry &entry = directory_tree.entries(tree_node.parent)[tree_node.slot];
+	if (last_cluster != 0)
+		setFatEntry(last_cluster, 0xFFF);
+	else
+		entry.first_logical_cluster = 0;
+
+	// Whatever used to follow is freed with the lost clusters, once no chain reaches it
+	if (!entry.isDirectory())
+	{
+		uint32_t cluster_size = layout.cluster_size;
+		ChainCache::Chain chain;
+		ChainCache::resolve(entry.first_logical_cluster, fat_table, chain);
+		uint32_t clusters = 0;
+		for (const ChainCache::Extent &extent : chain)
+			clusters += extent.count;
+		entry.file_size = std::min<uint32_t>(entry.file_size, clusters * cluster_size);
+	}
+	stageDirectoryEntry(tree_node.parent, tree_node.slot);
+}
+
+CheckReport FAT12::check(bool repair, size_t thread_count)
+{
+	FAT12_TIME(check);
+	CheckReport report;
+	if (!disk_image)
+	{
+		std::cerr << "ERROR: No disk image mounted." << std::endl;
+		report.problems.push_back("No disk image mounted");
+		return report;
+	}
+
+	std::unique_lock state_lock(state_mutex);
+	// The check reads the FAT copies on disk, so pending changes go first
+	if (!flushMetadata())
+	{
+		std::cerr << "ERROR: Failed to write pending changes before checking." << std::endl;
+		report.problems.push_back("Failed to write pending changes before checking");
+		return report;
+	}
+	loadSubtree(DirectoryTree::root);
+
+	// The chains of each directory's entries form one task
+	struct ChainJob
+	{
+		uint32_t node;
+		ChainChecker::Result result;
+	};
+	std::vector<uint32_t> directories{ DirectoryTree::root };
+	std::vector<std::vector<ChainJob>> jobs;
+	for (size_t next = 0; next < directories.size(); ++next)
+	{
+		std::vector<ChainJob> chains;
+		for (uint32_t child = directory_tree.node(directories[next]).first_child; child != DirectoryTree::no_node;
+			child = directory_tree.node(child).next_sibling)
+		{
+			chains.push_back({ child, {} });
+			if (directory_tree.entry(child).isDirectory() && directory_tree.isLoaded(child))
+				directories.push_back(child);
+		}
+		jobs.push_back(std::move(chains));
+	}
+
+	// Node indexes are unique, so they double as chain ids. Which of two cross-linked
+	// chains keeps the shared clusters depends on who claims them first, so repairs
+	// walk on one thread in directory order to stay reproducible.
+	uint32_t end_cluster = layout.fat_entries;
+	auto walkChains = [&](ChainChecker &checker)
+	{
+		auto checkDirectory = [this, &checker](std::vector<ChainJob> &chains)
+		{
+			for (ChainJob &job : chains)
+				job.result = checker.walk(job.node + 1, directory_tree.entry(job.node).first_logical_cluster);
+		};
+
+		size_t workers = repair ? 1 : std::min(thread_count != 0 ? thread_count : std::thread::hardware_concurrency(), jobs.size());
+		if (workers <= 1)
+		{
+			for (std::vector<ChainJob> &chains : jobs)
+				checkDirectory(chains);
+			return;
+		}
+		ThreadPool pool(workers);
+		for (std::vector<ChainJob> &chains : jobs)
+			pool.submit([&checkDirectory, &chains] { checkDirectory(chains); });
+		pool.wait();
+	};
+
+	auto checker = std::make_unique<ChainChecker>(fat_table, end_cluster);
+	walkChains(*checker);
+
+	uint32_t cluster_size = layout.cluster_size;
+	auto neededClusters = [cluster_size](const DirectoryEntry &entry)
+	{
+		return (entry.isDirectory() || cluster_size == 0) ? 0 : (entry.file_size + cluster_size - 1) / cluster_size;
+	};
+	bool trimmed = false;
+	for (const std::vector<ChainJob> &chains : jobs)
+	{
+		for (const ChainJob &job : chains)
+		{
+			const DirectoryEntry &entry = directory_tree.entry(job.node);
+			const std::string &path = directory_tree.node(job.node).path;
+			const ChainChecker::Result &result = job.result;
+			entry.isDirectory() ? ++report.directories : ++report.files;
+
+			switch (result.status)
+			{
+			case ChainChecker::Status::cross_linked:
+				++report.cross_links;
+				report.problems.push_back("Cross-linked at cluster " + std::to_string(result.stop_cluster) + ": " + path +
+					" and " + directory_tree.node(result.other - 1).path);
+				break;
+			case ChainChecker::Status::cycle:
+				++report.cycles;
+				report.problems.push_back("Cluster chain loops at cluster " + std::to_string(result.stop_cluster) + ": " + path);
+				break;
+			case ChainChecker::Status::out_of_range:
+			case ChainChecker::Status::free_cluster:
+				++report.broken_chains;
+				report.problems.push_back("Broken cluster chain at cluster " + std::to_string(result.stop_cluster) + ": " + path);
+				break;
+			case ChainChecker::Status::ok:
+				uint32_t needed_clusters = neededClusters(entry);
+				if (entry.isDirectory() || result.length == needed_clusters)
+					break;
+
+				++report.size_mismatches;
+				report.problems.push_back("Size of " + std::to_string(entry.file_size) + " bytes needs " + std::to_string(needed_clusters) +
+					" clusters, chain has " + std::to_string(result.length) + ": " + path);
+				if (!repair)
+					break;
+
+				// Files longer than their size are cut first: their tails may be what a
+				// cross-linked chain really owns
+				if (result.length > needed_clusters)
+				{
+					uint16_t last_cluster = 0;
+					for (uint16_t cluster = entry.first_logical_cluster, index = 0; index < needed_clusters; ++index)
+					{
+						last_cluster = cluster;
+						cluster = fat_table[cluster];
+					}
+					cutChain(job.node, last_cluster);
+					trimmed = true;
+				}
+				else
+					cutChain(job.node, result.last_good);
+				++report.repairs;
+				break;
+			}
+		}
+	}
+
+	std::vector<uint16_t> lost_clusters, lost_heads;
+	checker->findLost(lost_clusters, lost_heads);
+	report.lost_clusters = static_cast<uint32_t>(lost_clusters.size());
+	report.lost_chains = static_cast<uint32_t>(lost_heads.size());
+	for (uint16_t head : lost_heads)
+		report.problems.push_back("Lost cluster chain at cluster " + std::to_string(head));
+	if (lost_heads.empty() && !lost_clusters.empty())
+		report.problems.push_back("Lost cluster loops: " + std::to_string(lost_clusters.size()) + " clusters");
 
-	// Calculate the size of the data area
-	uint32_t data_area_size = partition_size - reserved_size - fat_size -
-		root_directory_size;
+	report.fat_copy_mismatches = countFatCopyMismatches();
+	if (report.fat_copy_mismatches != 0)
+		report.problems.push_back("FAT copies disagree on " + std::to_string(report.fat_copy_mismatches) + " entries");
 
-	// Calculate the space used in the data area by the root directory
-	uint32_t used_space = 0;
-	for (const DirectoryEntry& entry : root_directory_entries)
+	if (!repair || report.clean())
+		return report;
+
+	// Walk again after the cuts, then end every chain still damaged at its last own cluster
+	if (trimmed)
+	{
+		checker = std::make_unique<ChainChecker>(fat_table, end_cluster);
+		walkChains(*checker);
+	}
+	for (const std::vector<ChainJob> &chains : jobs)
 	{
-		if (entry.name[0] != 0xE5 && entry.name[0] != 0x00)
+		for (const ChainJob &job : chains)
 		{
-			// Entry is in use
-			uint32_t clusters = static_cast<uint32_t>(std::ceil(static_cast<double>(entry.file_size) /
-				(boot_sector_contents.sectors_per_cluster *
-					boot_sector_contents.sector_size)));
+			// A directory that owns no cluster has nothing to keep, and is left alone
+			if (job.result.status == ChainChecker::Status::ok ||
+				(job.result.last_good == 0 && directory_tree.entry(job.node).isDirectory()))
+				continue;
+			cutChain(job.node, job.result.last_good);
+			++report.repairs;
+		}
+	}
 
-			used_space += clusters * boot_sector_contents.sectors_per_cluster *
-				boot_sector_contents.sector_size;
+	lost_clusters.clear();
+	lost_heads.clear();
+	checker->findLost(lost_clusters, lost_heads);
+	for (uint16_t cluster : lost_clusters)
+		setFatEntry(cluster, 0x000);
+	if (!lost_clusters.empty())
+		++report.repairs;
+
+	// Staging every sector rewrites each copy from the first
+	if (report.fat_copy_mismatches != 0)
+	{
+		dirty_fat_sectors.assign(dirty_fat_sectors.size(), true);
+		++report.repairs;
+	}
+	if (!flushMetadata())
+		std::cerr << "ERROR: Failed to write the repairs to the disk image." << std::endl;
+	return report;
+}
+
+std::vector<FAT12::Relocation> FAT12::collectChains(uint32_t &fragmented, uint32_t &extents)
+{
+	// Every file and directory below the root that owns clusters; broken chains are left to check()
+	std::vector<Relocation> chains;
+	fragmented = 0;
+	extents = 0;
+	for (uint32_t node = DirectoryTree::root + 1; node < directory_tree.nodeCount(); ++node)
+	{
+		Relocation relocation{ node, {}, 0 };
+		uint16_t first_cluster = directory_tree.entry(node).first_logical_cluster;
+		if (first_cluster == 0 || !ChainCache::resolve(first_cluster, fat_table, relocation.chain))
+			continue;
+
+		for (const ChainCache::Extent &extent : relocation.chain)
+			relocation.clusters += extent.count;
+		extents += static_cast<uint32_t>(relocation.chain.size());
+		if (relocation.chain.size() > 1)
+			++fragmented;
+		chains.push_back(std::move(relocation));
+	}
+	return chains;
+}
+
+bool FAT12::relocateChains(std::vector<Relocation> &relocations)
+{
+	uint32_t cluster_size = layout.cluster_size;
+
+	// Copy the data into the new runs first, in target order, merging runs that
+	// follow each other into one write
+	std::sort(relocations.begin(), relocations.end(), [](const Relocation &a, const Relocation &b) { return a.target < b.target; });
+	size_t chunk_capacity = std::max<size_t>(256 * 1024 / cluster_size, 1) * cluster_size;
+	if (io_buffer.size() < chunk_capacity)
+		io_buffer.resize(chunk_capacity);
+
+	uint64_t buffer_offset = 0;
+	size_t buffered = 0;
+	auto flushBuffer = [&]()
+	{
+		bool written = buffered == 0 || disk_image->write(buffer_offset, std::span(io_buffer.data(), buffered));
+		buffered = 0;
+		return written;
+	};
+	for (const Relocation &relocation : relocations)
+	{
+		uint64_t position = layout.clusterOffset(relocation.target);
+		for (const ChainCache::Extent &extent : relocation.chain)
+		{
+			std::span<const std::byte> source = disk_image->bytes(layout.clusterOffset(extent.first), static_cast<uint64_t>(extent.count) * cluster_size);
+			if (source.empty())
+				return false;
+			for (size_t copied = 0; copied < source.size();)
+			{
+				if (buffered > 0 && (buffer_offset + buffered != position || buffered == chunk_capacity) && !flushBuffer())
+					return false;
+				if (buffered == 0)
+					buffer_offset = position;
+
+				size_t chunk = std::min(chunk_capacity - buffered, source.size() - copied);
+				std::memcpy(io_buffer.data() + buffered, source.data() + copied, chunk);
+				buffered += chunk;
+				copied += chunk;
+				position += chunk;
+			}
+		}
+	}
+	if (!flushBuffer())
+		return false;
+
+	// First commit: link the copies and point every entry at them. The old chains
+	// stay allocated, so a crash before the second commit only leaves lost clusters.
+	// The journal's flush syncs the copied data before it commits any of this.
+	Savepoint before = savepoint();
+	auto fail = [this](Savepoint &savepoint)
+	{
+		rollback(savepoint);
+		return false;
+	};
+	for (const Relocation &relocation : relocations)
+	{
+		for (uint32_t index = 0; index < relocation.clusters; ++index)
+		{
+			uint16_t cluster = static_cast<uint16_t>(relocation.target + index);
+			setFatEntry(cluster, index + 1 < relocation.clusters ? cluster + 1 : 0xFFF);
 		}
+		if (directory_tree.entry(relocation.node).isDirectory())
+			directory_tree.moveTable(relocation.node, relocation.target);
 	}
+	for (const Relocation &relocation : relocations)
+	{
+		const DirectoryTree::Node &node = directory_tree.node(relocation.node);
+		directory_tree.entry(relocation.node).first_logical_cluster = relocation.target;
+		if (!stageDirectoryEntry(node.parent, node.slot))
+			return fail(before);
+		if (!directory_tree.entry(relocation.node).isDirectory())
+			continue;
 
-	// Calculate the space used in the data area by subdirectories
-	for (const auto& subdirectory : subdirectories)
+		// The directory's own "." entry and the ".." entry of each subdirectory name its first cluster
+		std::vector<DirectoryEntry> &table = directory_tree.entries(relocation.node);
+		for (size_t slot = 0; slot < table.size() && table[slot].isDotEntry(); ++slot)
+		{
+			if (table[slot].name[1] != '.')
+			{
+				table[slot].first_logical_cluster = relocation.target;
+				if (!stageDirectoryEntry(relocation.node, slot))
+					return fail(before);
+			}
+		}
+		for (uint32_t child = node.first_child; child != DirectoryTree::no_node; child = directory_tree.node(child).next_sibling)
+		{
+			if (!directory_tree.entry(child).isDirectory() || !directory_tree.isLoaded(child))
+				continue;
+			std::vector<DirectoryEntry> &child_table = directory_tree.entries(child);
+			for (size_t slot = 0; slot < child_table.size() && child_table[slot].isDotEntry(); ++slot)
+			{
+				if (child_table[slot].name[1] == '.')
+				{
+					child_table[slot].first_logical_cluster = relocation.target;
+					if (!stageDirectoryEntry(child, slot))
+						return fail(before);
+				}
+			}
+		}
+	}
+	if (!flushMetadata())
+		return fail(before);
+
+	// Second commit: free the old chains
+	Savepoint linked = savepoint();
+	for (const Relocation &relocation : relocations)
 	{
-		for (const DirectoryEntry& entry : subdirectory.second)
+		for (const ChainCache::Extent &extent : relocation.chain)
 		{
-			if (entry.name[0] != 0xE5 && entry.name[0] != 0x00)
+			for (uint16_t cluster = extent.first; cluster < extent.first + extent.count; ++cluster)
+				setFatEntry(cluster, 0x000);
+		}
+	}
+	return flushMetadata() || fail(linked);
+}
+
+DefragReport FAT12::defragment()
+{
+	FAT12_TIME(defragment);
+	DefragReport report;
+	if (!disk_image)
+	{
+		std::cerr << "ERROR: No disk image mounted." << std::endl;
+		return report;
+	}
+
+	std::unique_lock state_lock(state_mutex);
+	if (!flushMetadata())
+	{
+		std::cerr << "ERROR: Failed to write pending changes before defragmenting." << std::endl;
+		return report;
+	}
+	loadSubtree(DirectoryTree::root);
+
+	std::vector<Relocation> chains = collectChains(report.fragmented_before, report.extents_before);
+	report.chains = static_cast<uint32_t>(chains.size());
+	report.fragmented_after = report.fragmented_before;
+	report.extents_after = report.extents_before;
+
+	// Freeing a moved chain must never free clusters another chain still uses
+	std::vector<bool> claimed(fat_table.size(), false);
+	for (const Relocation &relocation : chains)
+	{
+		for (const ChainCache::Extent &extent : relocation.chain)
+		{
+			for (uint16_t cluster = extent.first; cluster < extent.first + extent.count; ++cluster)
 			{
-				// Entry is in use
-				uint32_t clusters = static_cast<uint32_t>(std::ceil(static_cast<double>(entry.file_size) /
-					(boot_sector_contents.sectors_per_cluster *
-						boot_sector_contents.sector_size)));
+				if (claimed[cluster])
+				{
+					std::cerr << "ERROR: Cross-linked clusters; repair the image with check -r before defragmenting." << std::endl;
+					return report;
+				}
+				claimed[cluster] = true;
+			}
+		}
+	}
+
+	// Without a journal a round's FAT sectors and entries are separate writes that a
+	// power loss can tear, so defragmenting brings its own
+	bool temporary_journal = !journaled;
+	if (temporary_journal)
+	{
+		journal.reset(journal_path);
+		metadata_cache.reset(disk_image.get(), layout.sector_size, &journal);
+	}
+	bool failed = false;
 
-				used_space += clusters * boot_sector_contents.sectors_per_cluster *
-					boot_sector_contents.sector_size;
+	uint32_t end_cluster = layout.fat_entries;
+	while (true)
+	{
+		// Largest first, so the longest free runs go to the chains that need them most
+		std::vector<Relocation> relocations;
+		std::stable_sort(chains.begin(), chains.end(), [](const Relocation &a, const Relocation &b) { return a.clusters > b.clusters; });
+		for (Relocation &relocation : chains)
+		{
+			if (relocation.chain.size() < 2)
+				continue;
+			relocation.target = cluster_allocator.claimRun(relocation.clusters, end_cluster);
+			if (relocation.target != ClusterAllocator::no_cluster)
+				relocations.push_back(relocation);
+		}
+
+		// No fragmented chain fits anywhere: move contiguous chains, highest first, into
+		// the lowest gap below them, so free space gathers at the end of the data area
+		if (relocations.empty() && report.fragmented_after != 0)
+		{
+			std::sort(chains.begin(), chains.end(), [](const Relocation &a, const Relocation &b) { return a.chain.front().first > b.chain.front().first; });
+			for (Relocation &relocation : chains)
+			{
+				if (relocation.chain.size() != 1)
+					continue;
+				relocation.target = cluster_allocator.claimRun(relocation.clusters, relocation.chain.front().first);
+				if (relocation.target != ClusterAllocator::no_cluster)
+					relocations.push_back(relocation);
 			}
 		}
+		if (relocations.empty())
+			break;
+
+		if (!relocateChains(relocations))
+		{
+			// Runs claimed for copies that were never linked go back to the allocator
+			cluster_allocator.reset(fat_table);
+			std::cerr << "ERROR: Failed to relocate clusters; the image still holds the last completed round." << std::endl;
+			failed = true;
+			break;
+		}
+		++report.rounds;
+		report.moved_chains += static_cast<uint32_t>(relocations.size());
+		for (const Relocation &relocation : relocations)
+			report.moved_clusters += relocation.clusters;
+		chains = collectChains(report.fragmented_after, report.extents_after);
 	}
 
+	// After a failed round the journal may hold a commit the image lacks, so it
+	// stays for the next mount to replay
+	if (temporary_journal)
+	{
+		if (!failed && metadata_cache.checkpoint())
+			journal.remove();
+		metadata_cache.reset(disk_image.get(), layout.sector_size, nullptr);
+	}
+	report.completed = !failed;
+	return report;
+}
 
-	// Calculate available space
-	uint32_t available_space = data_area_size - used_space;
+void FAT12::analyzeDisk(std::ostream &out, bool deep)
+{
+	DiskUsage usage = diskUsage();
 
-	std::cout << std::fixed << std::setprecision(2);
+	out << std::fixed << std::setprecision(2);
 	int table_width = 53;
 	int title_padding = (table_width - 16) / 2;
 
 	// Print the top of the table
-	std::cout << std::setw(table_width) << std::setfill('-') << "" << std::setfill(' ') << std::endl;
+	out << std::setw(table_width) << std::setfill('-') << "" << std::setfill(' ') << std::endl;
 
 	// Print the title with centered text
-	std::cout << std::setw(title_padding) << "" << "| Disk Analysis |" << std::endl;
+	out << std::setw(title_padding) << "" << "| Disk Analysis |" << std::endl;
 
 	// Print the separator
-	std::cout << std::setw(table_width) << std::setfill('-') << "" << std::setfill(' ') << std::endl;
+	out << std::setw(table_width) << std::setfill('-') << "" << std::setfill(' ') << std::endl;
 
 	// Print the results in a table-like format with a fixed right wall
-	std::cout << std::left << std::setw(25) << "| Partition Size:" << std::right << std::setw(20) << partition_size << " bytes |" << std::endl;
-	std::cout << std::left << std::setw(25) << "| Reserved Area Size:" << std::right << std::setw(20) << reserved_size << " bytes |" << std::endl;
-	std::cout << std::left << std::setw(25) << "| FAT Size:" << std::right << std::setw(20) << fat_size << " bytes |" << std::endl;
-	std::cout << std::left << std::setw(25) << "| Root Directory Size:" << std::right << std::setw(20) << root_directory_size << " bytes |" << std::endl;
-	std::cout << std::left << std::setw(25) << "| Data Area Size:" << std::right << std::setw(20) << data_area_size << " bytes |" << std::endl;
-	std::cout << std::left << std::setw(25) << "| Used Space:" << std::right << std::setw(20) << used_space << " bytes |" << std::endl;
-	std::cout << std::left << std::setw(25) << "| Available Space:" << std::right << std::setw(20) << available_space << " bytes |" << std::endl;
+	out << std::left << std::setw(25) << "| Partition Size:" << std::right << std::setw(20) << usage.partition_size << " bytes |" << std::endl;
+	out << std::left << std::setw(25) << "| Reserved Area Size:" << std::right << std::setw(20) << usage.reserved_size << " bytes |" << std::endl;
+	out << std::left << std::setw(25) << "| FAT Size:" << std::right << std::setw(20) << usage.fat_size << " bytes |" << std::endl;
+	out << std::left << std::setw(25) << "| Root Directory Size:" << std::right << std::setw(20) << usage.root_directory_size << " bytes |" << std::endl;
+	out << std::left << std::setw(25) << "| Data Area Size:" << std::right << std::setw(20) << usage.data_area_size << " bytes |" << std::endl;
+	out << std::left << std::setw(25) << "| Used Space:" << std::right << std::setw(20) << usage.used_space << " bytes |" << std::endl;
+	out << std::left << std::setw(25) << "| Bad Space:" << std::right << std::setw(20) << usage.bad_space << " bytes |" << std::endl;
+	out << std::left << std::setw(25) << "| Reserved Cluster Space:" << std::right << std::setw(20) << usage.reserved_cluster_space << " bytes |" << std::endl;
+	out << std::left << std::setw(25) << "| Available Space:" << std::right << std::setw(20) << usage.available_space << " bytes |" << std::endl;
+
+	if (deep)
+	{
+		SpaceDetails details = spaceDetails();
+		out << std::setw(table_width) << std::setfill('-') << "" << std::setfill(' ') << std::endl;
+		out << std::left << std::setw(25) << "| Files:" << std::right << std::setw(26) << details.files << " |" << std::endl;
+		out << std::left << std::setw(25) << "| Fragmented Files:" << std::right << std::setw(26) << details.fragmented_files << " |" << std::endl;
+		out << std::left << std::setw(25) << "| File Extents:" << std::right << std::setw(26) << details.extents << " |" << std::endl;
+		out << std::left << std::setw(25) << "| Slack Space:" << std::right << std::setw(20) << details.slack_space << " bytes |" << std::endl;
+		out << std::left << std::setw(25) << "| Lost Clusters:" << std::right << std::setw(26) << details.lost_clusters << " |" << std::endl;
+		out << std::setw(table_width) << std::setfill('-') << "" << std::setfill(' ') << std::endl;
+		for (const DirectoryUsage &directory : details.directories)
+		{
+			out << std::left << directory.path << ": " << directory.files << " files, " << directory.file_bytes << " bytes, "
+				<< directory.allocated_bytes << " bytes allocated" << std::endl;
+		}
+	}
 
 	// Print the bottom of the table with a fixed right wall
-	std::cout << std::setw(table_width) << std::setfill('-') << "" << std::setfill(' ') << std::endl;
-	std::cout << "\n" << std::endl;
+	out << std::setw(table_width) << std::setfill('-') << "" << std::setfill(' ') << std::endl;
+	out << "\n" << std::endl;
+}
+
+bool FAT12::sync()
+{
+	if (!disk_image)
+		return false;
+
+	std::unique_lock state_lock(state_mutex);
+	FAT12_TIME(sync);
+	return flushMetadata();
+}
+
+bool FAT12::snapshotOverlay(const std::string &snapshot_file)
+{
+	if (!overlay)
+	{
+		std::cerr << "ERROR: The image is not mounted as an overlay." << std::endl;
+		return false;
+	}
+
+	std::unique_lock state_lock(state_mutex);
+	if (!flushMetadata() || !overlay->snapshot(snapshot_file))
+	{
+		std::cerr << "ERROR: Failed to write the snapshot: " << snapshot_file << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool FAT12::commitOverlay()
+{
+	if (!overlay)
+	{
+		std::cerr << "ERROR: The image is not mounted as an overlay." << std::endl;
+		return false;
+	}
+
+	std::unique_lock state_lock(state_mutex);
+	if (!flushMetadata() || !overlay->commit())
+	{
+		std::cerr << "ERROR: Failed to commit the overlay to the base image." << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool FAT12::discardOverlay()
+{
+	if (!overlay)
+	{
+		std::cerr << "ERROR: The image is not mounted as an overlay." << std::endl;
+		return false;
+	}
+
+	std::unique_lock state_lock(state_mutex);
+	// Staged changes are dropped and the journal emptied first, so a crash
+	// never replays metadata over a delta that no longer holds its data
+	metadata_cache.reset(disk_image.get(), layout.sector_size, journaled ? &journal : nullptr);
+	if (!metadata_cache.checkpoint() || !overlay->discard())
+	{
+		std::cerr << "ERROR: Failed to discard the overlay." << std::endl;
+		return false;
+	}
+	reloadMetadata();
+	return true;
 }
@@ -1,73 +1,267 @@
 #pragma once
 
+#include "BlockDevice.h"
+#include "ChainCache.h"
+#include "ChainChecker.h"
+#include "ClusterAllocator.h"
+#include "ContentHash.h"
+#include "DedupIndex.h"
+#include "DirectoryEntry.h"
+#include "DirectoryTree.h"
+#include "FatCodec.h"
+#include "ImageBuilder.h"
+#include "Instrumentation.h"
+#include "MetadataJournal.h"
+#include "OverlayBlockDevice.h"
+#include "SnapshotCache.h"
+#include "SpaceAccounting.h"
+#include "ThreadPool.h"
+#include "WriteBackCache.h"
+
 #include <fstream>
 #include <vector>
+#include <memory>
 #include <map>
+#include <unordered_set>
 #include <iostream>
 #include <iomanip>
 #include <algorithm>
 #include <filesystem>
+#include <functional>
 #include <cmath>
+#include <mutex>
+#include <shared_mutex>
+
+struct MountOptions
+{
+	BlockDevice::Backend backend = BlockDevice::Backend::Mapped;
+	bool lazy_directories = false;	// Only read the boot sector and FAT on mount; directories load on first use
+	bool deferred_sync = false;	// Keep metadata changes cached until sync() or unmount instead of after each import
+	SnapshotCache *snapshots = nullptr;	// Reuse the parsed FAT and root of images whose metadata was seen before
+	bool journal = false;	// Commit metadata through a sidecar redo journal so a crash never leaves it half written
+	std::string overlay;	// Delta file; when set the image is only read and every change goes to the delta
+};
+
+// Sizes in bytes, as reported by status
+struct DiskUsage
+{
+	uint32_t partition_size;
+	uint32_t reserved_size;
+	uint32_t fat_size;	// Every FAT copy
+	uint32_t root_directory_size;
+	uint32_t data_area_size;
+	uint32_t used_space;	// Clusters the FAT marks as in use, including directories and lost chains
+	uint32_t bad_space;
+	uint32_t reserved_cluster_space;	// Clusters holding a reserved FAT value (0xFF0-0xFF6)
+	uint32_t available_space;
+};
+
+struct DirectoryUsage
+{
+	std::string path;
+	uint32_t files;	// Totals cover everything below the directory
+	uint64_t file_bytes;
+	uint64_t allocated_bytes;	// File clusters plus directory tables
+};
+
+// Found by one pass over every directory and chain
+struct SpaceDetails
+{
+	uint32_t files = 0;
+	uint32_t fragmented_files = 0;	// Files stored in more than one extent
+	uint32_t extents = 0;
+	uint64_t slack_space = 0;	// Allocated to files but past their end
+	uint32_t lost_clusters = 0;	// In use in the FAT but reached by no file or directory
+	std::vector<DirectoryUsage> directories;	// Breadth-first from the root
+};
+
+struct CheckReport
+{
+	uint32_t directories = 0;
+	uint32_t files = 0;
+	uint32_t cross_links = 0;	// Chains running into a cluster of another chain
+	uint32_t cycles = 0;
+	uint32_t broken_chains = 0;	// Chains leaving the data area or running into a free cluster
+	uint32_t size_mismatches = 0;	// File sizes that disagree with their chain length
+	uint32_t lost_chains = 0;
+	uint32_t lost_clusters = 0;
+	uint32_t fat_copy_mismatches = 0;	// Entries of later FAT copies that differ from the first
+	uint32_t repairs = 0;
+	std::vector<std::string> problems;	// One line per finding, in directory order
+
+	bool clean() const { return problems.empty(); }
+};
+
+struct DefragReport
+{
+	uint32_t chains = 0;	// Files and directories with clusters
+	uint32_t fragmented_before = 0;
+	uint32_t extents_before = 0;
+	uint32_t fragmented_after = 0;
+	uint32_t extents_after = 0;
+	uint32_t moved_chains = 0;
+	uint32_t moved_clusters = 0;
+	uint32_t rounds = 0;	// Commits; each one leaves a consistent image
+	bool completed = false;	// False if defragmenting was refused or a round failed
+};
 
 class FAT12
 {
 private:
-	struct BootSector
+	// Exports and reads share state_mutex, everything that changes or lists the image takes it
+	// exclusively. Shared holders serialize lookups, lazy loads and chain-cache fills on lookup_mutex.
+	std::shared_mutex state_mutex;
+	std::mutex lookup_mutex;
+	// A directory receiving imported entries; node is no_node until the import creates it
+	struct ImportTarget
+	{
+		uint32_t node;
+		size_t parent;	// Index of the target it is created in
+		DirectoryEntry entry;
+	};
+	struct ImportFile
 	{
-		uint16_t sector_size;
-		uint8_t sectors_per_cluster;
-		uint16_t num_reserved_sectors;
-		uint8_t num_fats;
-		uint16_t max_num_root_entries;
-		uint16_t total_sector_count;
-		uint16_t sectors_per_fat;
+		File input;
+		uint64_t size = 0;
+		size_t target = 0;
+		DirectoryEntry entry{};
+		std::vector<ClusterAllocator::Extent> extents;
 	};
-	struct DirectoryEntry
+	// A file or directory chain being moved to one contiguous run
+	struct Relocation
 	{
-		std::string name;
-		std::string extension;
-		uint8_t attributes;
-		uint16_t reserved;
-		uint16_t creation_time;
-		uint16_t creation_date;
-		uint16_t last_access_date;
-		uint16_t last_write_time;
-		uint16_t last_write_date;
-		uint16_t first_logical_cluster;
-		uint32_t file_size;
-		bool is_directory;
-		std::string path;
-		std::string parent_name;
-		uint16_t parent_cluster;
+		uint32_t node;
+		ChainCache::Chain chain;
+		uint32_t clusters;
+		uint16_t target = 0;
 	};
-	struct FATEntry
+	// A file of a subtree and its resolved chain, for the bulk reads
+	struct FileJob
 	{
-		uint16_t value;
+		std::string path;	// Tree path, such as "/A/B/FILE.TXT"
+		DirectoryEntry entry;
+		ChainCache::ChainRef chain;
 	};
+
+	// In-memory metadata before a transaction; restored if the transaction fails
+	// before its commit, so neither the caller nor the final sync sees half of it
+	struct Savepoint
+	{
+		bool on_image = false;	// Nothing was pending, so the image itself holds this state
+		std::vector<uint16_t> fat_table;
+		std::vector<bool> dirty_fat_sectors;
+		WriteBackCache::Staged staged;
+		DirectoryTree directory_tree;
+	};
+
 	std::string disk_image_name;
-	std::ifstream disk_image;
+	std::unique_ptr<BlockDevice> disk_image;
+	OverlayBlockDevice *overlay = nullptr;	// disk_image, for overlay mounts
 	BootSector boot_sector_contents;
-	std::vector<FATEntry> fat_table;
-	std::vector<DirectoryEntry> root_directory_entries;
-	std::map<std::string, std::vector<DirectoryEntry>> subdirectories;
+	Layout layout;
+	std::vector<uint16_t> fat_table;
+	ClusterAllocator cluster_allocator;
+	ChainCache chain_cache;
+	SpaceAccounting space_accounting;
+	WriteBackCache metadata_cache;
+	MetadataJournal journal;
+	std::string journal_path;	// Next to the image, or to the delta of an overlay mount
+	bool journaled = false;
+	std::vector<bool> dirty_fat_sectors;	// Sectors of the packed FAT changed since the last sync
+	bool deferred_sync = false;
+	std::vector<std::byte> io_buffer;	// Reused by imports, so memory stays flat regardless of file size
+	DirectoryTree directory_tree;
 
-	inline void readBootSector();
+	inline bool readBootSector();
 	inline void readFat();
-	void readRootDirectoryEntries();
-	void readSubdirectoriesEntries();
-	void listDirectory(const std::vector<DirectoryEntry> &directory_entries);
-	inline uint16_t findFreeCluster();
-	inline bool hasEnoughFreeClusters(uint32_t &required_clusters);
-	inline void findFreeEntry(DirectoryEntry &new_entry, size_t &insert_index, std::ifstream &input_file);
+	inline void resetFatState();
+	void reloadMetadata();
+	Savepoint savepoint() const;
+	void rollback(Savepoint &savepoint);
+	bool mountFromSnapshot(SnapshotCache &snapshots);
+	bool readRootDirectoryEntries(std::vector<DirectoryEntry> &entries);
+	bool readDirectoryTable(uint16_t first_cluster, std::vector<DirectoryEntry> &entries);
+	bool loadDirectory(uint32_t directory);
+	void loadSubtree(uint32_t directory);
+	bool collectFiles(const std::string &directory, std::vector<FileJob> &jobs, const std::function<bool(const std::string &)> &enter_directory = {});
+	uint32_t findNode(const std::string &path);
+	void listDirectory(const std::vector<DirectoryEntry> &directory_entries, const std::string &path, std::ostream &out);
+	inline void setFatEntry(uint16_t cluster, uint16_t value);
+	inline bool hasEnoughFreeClusters(uint32_t required_clusters);
+	inline void linkClusterChain(const std::vector<ClusterAllocator::Extent> &extents);
+	const DirectoryEntry *findFile(const std::string &file_path);
+	bool lookupFile(const std::string &file_path, DirectoryEntry &entry, ChainCache::ChainRef &chain);
+	bool copyEntryToFile(const DirectoryEntry &entry, const ChainCache::Chain &chain, const std::string &destination);
+	bool hashEntry(const DirectoryEntry &entry, const ChainCache::Chain &chain, bool sha256, FileHash &hash);
+	std::vector<std::byte> readRange(const DirectoryEntry &entry, const ChainCache::Chain &chain, uint32_t offset, uint32_t length);
+	bool findFreeEntry(uint32_t directory, size_t &insert_index);
 	inline void updateNewEntryFields(DirectoryEntry &new_entry, const std::string &destination);
-	inline void writeInputFileInDiskImage(std::fstream &writable_disk_image, std::vector<char> &buffer, uint16_t &new_cluster, uint32_t &required_clusters);
-	inline void updateDiskImageFatTable(std::fstream &writable_disk_image);
-	inline void updateDiskImageRootDirectory(std::fstream &writable_disk_image);
+	inline bool writeImportData(const std::vector<ImportFile> &files);
+	uint32_t createDirectory(uint32_t parent, DirectoryEntry entry);
+	bool commitImport(std::vector<ImportTarget> &targets, std::vector<ImportFile> &files);
+	bool openImportFile(const std::filesystem::path &source, size_t target, std::vector<ImportFile> &files);
+	uint32_t findTargetDirectory(const std::string &target_directory);
+	inline bool stageFatSectors();
+	inline bool flushMetadata();
+	bool stageDirectoryEntry(uint32_t directory, size_t slot);
+	uint32_t countFatCopyMismatches();
+	void cutChain(uint32_t node, uint16_t last_cluster);
+	std::vector<Relocation> collectChains(uint32_t &fragmented, uint32_t &extents);
+	bool relocateChains(std::vector<Relocation> &relocations);
 public:
-	FAT12(const std::string &image);
-	void LS();
-	void LS1();
-	void copyToSystem(const std::string &file_name);
-	void copyFromSystem(const std::string &source);
-	void analyzeDisk();
+	FAT12(const std::string &image, const MountOptions &options = {});
+	~FAT12();
+	bool isMounted() const { return disk_image != nullptr; }
+	const Layout &volumeLayout() const { return layout; }
+	// False if path is not a directory of the image
+	bool LS(const std::string &path = "/", std::ostream &out = std::cout);
+	void LS1(std::ostream &out = std::cout);
+	// Calls visit with the full path of every entry of a directory, and of everything
+	// below it when recursive. visit must not call back into this object.
+	bool forEachEntry(const std::string &path, bool recursive, const std::function<void(const std::string &, const DirectoryEntry &)> &visit);
+	// Writes the file to destination, or to its own name in the working directory
+	bool copyToSystem(const std::string &file_name, const std::string &destination = "", std::ostream &out = std::cout);
+	// Recreates a directory of the image under host_directory, copying files in parallel
+	// (0 threads means one per hardware thread)
+	bool exportTree(const std::string &source_directory, const std::string &host_directory, size_t thread_count = 0, std::ostream &out = std::cout);
+	// Hashes every file of a directory and everything below it straight from the
+	// mapped clusters on thread_count workers (0 means one per hardware thread).
+	// Results come back sorted by path; sha256 adds the slower cryptographic digest.
+	bool hashFiles(const std::string &directory, bool sha256, size_t thread_count, std::vector<FileHash> &hashes);
+	// Reads up to length bytes at offset, clamped to the file size; false if the
+	// file cannot be found or its chain is broken, unlike a read past the end
+	bool readAt(const DirectoryEntry &entry, uint32_t offset, uint32_t length, std::vector<std::byte> &data);
+	bool readAt(const std::string &file_path, uint32_t offset, uint32_t length, std::vector<std::byte> &data);
+	bool copyFromSystem(const std::string &source, std::ostream &out = std::cout);
+	// Imports every file as one transaction: capacity is checked once, all chains are
+	// allocated together, data is written in physical order and metadata committed once
+	bool importBatch(const std::vector<std::string> &sources, const std::string &target_directory);
+	// Same, for a host directory tree; subdirectories are created in the image
+	bool importTree(const std::string &host_directory, const std::string &target_directory, std::ostream &out = std::cout);
+	// Constant time, from counts kept up to date by every FAT change
+	DiskUsage diskUsage();
+	SpaceDetails spaceDetails();
+	// Validates every chain against the FAT and the FAT copies against each other in
+	// linear time, walking directories on thread_count workers. Repair truncates bad
+	// chains, fixes file sizes, frees lost clusters and rewrites every FAT copy.
+	CheckReport check(bool repair = false, size_t thread_count = 0);
+	// Moves fragmented chains into contiguous runs, compacting the data area toward the
+	// front when no run is long enough. Data is copied into free clusters and synced
+	// before any entry points at it, and old clusters are freed in a separate commit.
+	// Commits always go through the journal (a temporary one if the mount has none),
+	// so a power loss leaves the image as of the last completed commit.
+	DefragReport defragment();
+	// Deep adds slack space, fragmentation and per-directory totals
+	void analyzeDisk(std::ostream &out = std::cout, bool deep = false);
+	// Writes every cached metadata change to the image, mirrored to each FAT copy
+	bool sync();
+	uint64_t metadataBytesWritten() const { return metadata_cache.flushedBytes(); }
+	// Overlay mounts only. A snapshot copies the delta so another session can branch
+	// off the current state; commit writes the changes into the base image and
+	// discard drops them.
+	bool isOverlay() const { return overlay != nullptr; }
+	size_t overlaySectors() const { return overlay ? overlay->changedSectors() : 0; }
+	bool snapshotOverlay(const std::string &snapshot_file);
+	bool commitOverlay();
+	bool discardOverlay();
 };
\ No newline at end of file
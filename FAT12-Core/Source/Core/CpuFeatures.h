@@ -0,0 +1,52 @@
+#pragma once
+
+// Shared by the translation units that carry SIMD kernels: FAT12_X86 is
+// defined where x86 intrinsics are available, and FAT12_TARGET(isa) compiles
+// one function for an instruction set the rest of the build does not assume
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+	#define FAT12_X86 1
+	#include <immintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+		#define FAT12_TARGET(isa)
+	#else
+		#define FAT12_TARGET(isa) __attribute__((target(isa)))
+	#endif
+#endif
+
+#ifdef FAT12_X86
+// Runtime checks for the instruction sets the kernels are written for
+namespace CpuFeatures
+{
+	inline bool ssse3()
+	{
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 1);
+		return (info[2] & (1 << 9)) != 0;
+#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("ssse3");
+#endif
+	}
+
+	inline bool avx2()
+	{
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		int max_leaf = info[0];
+		__cpuid(info, 1);
+		// AVX2 also needs the OS to save YMM registers
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		if (!osxsave || max_leaf < 7 || (_xgetbv(0) & 0x6) != 0x6)
+			return false;
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+}
+#endif
@@ -0,0 +1,225 @@
+#include "DedupIndex.h"
+
+#include <algorithm>
+#include <charconv>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+static bool parseDigest(const std::string &hex, ContentHash::Digest &digest)
+{
+	if (hex.size() != digest.size() * 2)
+		return false;
+	for (size_t index = 0; index < digest.size(); index++)
+	{
+		const char *first = hex.data() + index * 2;
+		if (std::from_chars(first, first + 2, digest[index], 16).ptr != first + 2)
+			return false;
+	}
+	return true;
+}
+
+// Images and paths may hold the separators themselves, so backslash, tab,
+// newline and carriage return are written as \\, \t, \n and \r
+static std::string escape(const std::string &text)
+{
+	std::string escaped;
+	escaped.reserve(text.size());
+	for (char value : text)
+	{
+		switch (value)
+		{
+		case '\\': escaped += "\\\\"; break;
+		case '\t': escaped += "\\t"; break;
+		case '\n': escaped += "\\n"; break;
+		case '\r': escaped += "\\r"; break;
+		default: escaped += value; break;
+		}
+	}
+	return escaped;
+}
+
+static bool unescape(const std::string &escaped, std::string &text)
+{
+	text.clear();
+	for (size_t index = 0; index < escaped.size(); index++)
+	{
+		if (escaped[index] != '\\')
+		{
+			text += escaped[index];
+			continue;
+		}
+		if (++index == escaped.size())
+			return false;
+		switch (escaped[index])
+		{
+		case '\\': text += '\\'; break;
+		case 't': text += '\t'; break;
+		case 'n': text += '\n'; break;
+		case 'r': text += '\r'; break;
+		default: return false;
+		}
+	}
+	return true;
+}
+
+bool DedupIndex::load(const std::string &path)
+{
+	contents.clear();
+	image_keys.clear();
+	file_count = 0;
+
+	std::ifstream in(path);
+	if (!in)
+		return !std::filesystem::exists(path);
+
+	std::string line;
+	size_t line_number = 0;
+	while (std::getline(in, line))
+	{
+		line_number++;
+		if (line.empty())
+			continue;
+
+		std::vector<std::string> fields;
+		std::stringstream stream(line);
+		for (std::string field; std::getline(stream, field, '\t');)
+			fields.push_back(field);
+
+		Key key{};
+		Location location;
+		bool valid = fields.size() == 5 &&
+			std::from_chars(fields[0].data(), fields[0].data() + fields[0].size(), key.first, 16).ec == std::errc{} &&
+			std::from_chars(fields[1].data(), fields[1].data() + fields[1].size(), key.second).ec == std::errc{};
+		if (valid && fields[2] != "-")
+			valid = location.has_sha256 = parseDigest(fields[2], location.sha256);
+		if (!valid || !unescape(fields[3], location.image) || !unescape(fields[4], location.path))
+		{
+			std::cerr << "ERROR: Malformed dedup index line " << line_number << ": " << path << std::endl;
+			return false;
+		}
+		add(key, std::move(location));
+	}
+	return true;
+}
+
+bool DedupIndex::save(const std::string &path) const
+{
+	std::string temporary = path + ".tmp";
+	{
+		std::ofstream out(temporary, std::ios::trunc);
+		if (!out)
+		{
+			std::cerr << "ERROR: Failed to create dedup index: " << temporary << std::endl;
+			return false;
+		}
+		for (const auto &[key, locations] : contents)
+		{
+			for (const Location &location : locations)
+				out << ContentHash::toHex(key.first) << '\t' << key.second << '\t'
+					<< (location.has_sha256 ? ContentHash::toHex(location.sha256) : "-") << '\t'
+					<< escape(location.image) << '\t' << escape(location.path) << '\n';
+		}
+		if (!out.flush())
+		{
+			std::cerr << "ERROR: Failed to write dedup index: " << temporary << std::endl;
+			return false;
+		}
+	}
+
+	std::error_code error;
+	std::filesystem::rename(temporary, path, error);
+	if (error)
+	{
+		std::cerr << "ERROR: Failed to replace dedup index: " << path << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void DedupIndex::add(const Key &key, Location location)
+{
+	image_keys[location.image].push_back(key);
+	contents[key].push_back(std::move(location));
+	file_count++;
+}
+
+void DedupIndex::removeImage(const std::string &image)
+{
+	auto keys = image_keys.find(image);
+	if (keys == image_keys.end())
+		return;
+
+	for (const Key &key : keys->second)
+	{
+		auto content = contents.find(key);
+		if (content == contents.end())
+			continue;
+		std::vector<Location> &locations = content->second;
+		size_t before = locations.size();
+		std::erase_if(locations, [&](const Location &location) { return location.image == image; });
+		file_count -= before - locations.size();
+		if (locations.empty())
+			contents.erase(content);
+	}
+	image_keys.erase(keys);
+}
+
+void DedupIndex::update(const std::string &image, const std::vector<FileHash> &hashes)
+{
+	// Digests of the old records, so a run without SHA-256 does not drop them
+	std::map<std::string, std::pair<Key, ContentHash::Digest>> digests;
+	auto keys = image_keys.find(image);
+	if (keys != image_keys.end())
+	{
+		for (const Key &key : keys->second)
+		{
+			auto content = contents.find(key);
+			if (content == contents.end())
+				continue;
+			for (const Location &location : content->second)
+			{
+				if (location.image == image && location.has_sha256)
+					digests[location.path] = { key, location.sha256 };
+			}
+		}
+	}
+
+	removeImage(image);
+	for (const FileHash &file : hashes)
+	{
+		Key key{ file.hash, file.size };
+		Location location{ image, file.path, file.has_sha256, file.sha256 };
+		auto digest = location.has_sha256 ? digests.end() : digests.find(file.path);
+		if (digest != digests.end() && digest->second.first == key)
+		{
+			location.has_sha256 = true;
+			location.sha256 = digest->second.second;
+		}
+		add(key, std::move(location));
+	}
+}
+
+std::vector<DedupIndex::DuplicateGroup> DedupIndex::duplicates() const
+{
+	std::vector<DuplicateGroup> groups;
+	for (const auto &[key, locations] : contents)
+	{
+		if (locations.size() < 2)
+			continue;
+
+		DuplicateGroup group{ key.first, key.second, {}, true };
+		for (const Location &location : locations)
+		{
+			group.locations.push_back(&location);
+			group.verified = group.verified && location.has_sha256 && location.sha256 == locations.front().sha256;
+		}
+		groups.push_back(std::move(group));
+	}
+	std::stable_sort(groups.begin(), groups.end(), [](const DuplicateGroup &a, const DuplicateGroup &b)
+	{
+		return a.wastedBytes() > b.wastedBytes();
+	});
+	return groups;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "ContentHash.h"
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// Maps file content to every (image, path) holding it, across any number of
+// images, and persists in a text file with one tab-separated line per file:
+// hash64, size, SHA-256 or "-", image, path, with backslash, tab, newline and
+// carriage return in the last two escaped as \\, \t, \n and \r. Contents are
+// keyed by hash64 and size; a SHA-256 match on every copy marks a duplicate
+// group as verified.
+class DedupIndex
+{
+public:
+	struct Location
+	{
+		std::string image;
+		std::string path;
+		bool has_sha256 = false;
+		ContentHash::Digest sha256{};
+	};
+
+	struct DuplicateGroup
+	{
+		uint64_t hash;
+		uint32_t size;
+		std::vector<const Location*> locations;	// Valid until the index changes
+		bool verified;	// Every copy has a SHA-256 and they all agree
+		uint64_t wastedBytes() const { return static_cast<uint64_t>(size) * (locations.size() - 1); }
+	};
+
+	// A missing file is an empty index
+	bool load(const std::string &path);
+	// Written to a temporary file first, so a failed save leaves the old index
+	bool save(const std::string &path) const;
+
+	// Replaces every record of the image with hashes. A file hashed without SHA-256
+	// keeps the digest of its old record if its path, hash64 and size are unchanged.
+	void update(const std::string &image, const std::vector<FileHash> &hashes);
+	void removeImage(const std::string &image);
+
+	// Contents held more than once, most wasted bytes first
+	std::vector<DuplicateGroup> duplicates() const;
+	size_t fileCount() const { return file_count; }
+	size_t contentCount() const { return contents.size(); }
+
+private:
+	using Key = std::pair<uint64_t, uint32_t>;	// hash64, size
+
+	std::map<Key, std::vector<Location>> contents;
+	std::map<std::string, std::vector<Key>> image_keys;	// For replacing an image's records
+	size_t file_count = 0;
+
+	void add(const Key &key, Location location);
+};
@@ -0,0 +1,47 @@
+#include "DirectoryEntry.h"
+
+#include <cctype>
+
+static std::string decodeField(const char *field, size_t length)
+{
+	std::string decoded;
+	for (size_t i{ 0 }; i < length; i++)
+	{
+		if (field[i] != ' ')
+			decoded += static_cast<char>(std::toupper(static_cast<uint8_t>(field[i])));
+	}
+	return decoded;
+}
+
+static void encodeField(char *field, size_t length, const std::string &value)
+{
+	for (size_t i{ 0 }; i < length; i++)
+		field[i] = (i < value.size()) ? static_cast<char>(std::toupper(static_cast<uint8_t>(value[i]))) : ' ';
+}
+
+std::string DirectoryEntry::nameString() const
+{
+	return decodeField(name, sizeof(name));
+}
+
+std::string DirectoryEntry::extensionString() const
+{
+	return decodeField(extension, sizeof(extension));
+}
+
+std::string DirectoryEntry::fullName() const
+{
+	std::string ext = extensionString();
+	return ext.empty() ? nameString() : nameString() + "." + ext;
+}
+
+bool DirectoryEntry::hasFullName(const std::string &full_name) const
+{
+	return !isFree() && !isDotEntry() && fullName() == full_name;
+}
+
+void DirectoryEntry::setName(const std::string &base_name, const std::string &ext)
+{
+	encodeField(name, sizeof(name), base_name);
+	encodeField(extension, sizeof(extension), ext);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+// 32-byte directory slot exactly as stored on disk. Names are kept in their
+// space-padded on-disk form and only decoded when asked for.
+#pragma pack(push, 1)
+struct DirectoryEntry
+{
+	char name[8];
+	char extension[3];
+	uint8_t attributes;
+	uint16_t reserved;
+	uint16_t creation_time;
+	uint16_t creation_date;
+	uint16_t last_access_date;
+	uint16_t ignored;	// High cluster word on FAT32, always 0 on FAT12
+	uint16_t last_write_time;
+	uint16_t last_write_date;
+	uint16_t first_logical_cluster;
+	uint32_t file_size;
+
+	bool isEndOfDirectory() const { return static_cast<uint8_t>(name[0]) == 0x00; }
+	bool isFree() const { return static_cast<uint8_t>(name[0]) == 0xE5 || isEndOfDirectory(); }
+	bool isDirectory() const { return (attributes & 0x10) != 0; }
+	bool isDotEntry() const { return name[0] == '.'; }
+
+	// Name and extension without padding, converted to uppercase
+	std::string nameString() const;
+	std::string extensionString() const;
+	// "NAME.EXT", or "NAME" when there is no extension
+	std::string fullName() const;
+	bool hasFullName(const std::string &full_name) const;
+
+	// Stores an 8.3 name, truncating and space-padding each part
+	void setName(const std::string &base_name, const std::string &ext);
+};
+#pragma pack(pop)
+
+static_assert(sizeof(DirectoryEntry) == 32, "DirectoryEntry must match the on-disk layout");
+static_assert(std::is_trivially_copyable_v<DirectoryEntry>, "DirectoryEntry must be trivially copyable");
@@ -0,0 +1,109 @@
+#include "DirectoryTree.h"
+
+void DirectoryTree::reset()
+{
+	nodes.clear();
+	directory_tables.clear();
+	path_index.clear();
+	table_clusters.clear();
+
+	nodes.push_back({ no_node, 0, no_node, no_node, no_node, "/" });
+	path_index.emplace("/", root);
+}
+
+size_t DirectoryTree::addChildren(uint32_t directory)
+{
+	size_t added = 0;
+	const std::vector<DirectoryEntry> &table = entries(directory);
+	for (size_t slot = 0; slot < table.size(); ++slot)
+	{
+		if (table[slot].isEndOfDirectory())
+			break;
+		if (table[slot].isFree() || table[slot].isDotEntry())
+			continue;
+		addNode(directory, static_cast<uint32_t>(slot));
+		++added;
+	}
+	return added;
+}
+
+void DirectoryTree::attachTable(uint32_t directory, uint16_t first_cluster, std::vector<DirectoryEntry> entries)
+{
+	nodes[directory].table = static_cast<uint32_t>(directory_tables.size());
+	if (first_cluster != 0)
+		table_clusters.emplace(first_cluster, nodes[directory].table);
+	directory_tables.push_back({ directory, first_cluster, std::move(entries) });
+}
+
+void DirectoryTree::moveTable(uint32_t directory, uint16_t first_cluster)
+{
+	Table &table = directory_tables[nodes[directory].table];
+	table_clusters.erase(table.first_cluster);
+	table_clusters.emplace(first_cluster, nodes[directory].table);
+	table.first_cluster = first_cluster;
+}
+
+uint32_t DirectoryTree::insert(uint32_t directory, size_t slot, const DirectoryEntry &entry)
+{
+	entries(directory)[slot] = entry;
+	return addNode(directory, static_cast<uint32_t>(slot));
+}
+
+uint32_t DirectoryTree::find(std::string_view path) const
+{
+	auto found = path_index.find(normalize(path));
+	return found != path_index.end() ? found->second : no_node;
+}
+
+const DirectoryEntry &DirectoryTree::entry(uint32_t index) const
+{
+	// The root has no slot of its own
+	static const DirectoryEntry root_entry = [] { DirectoryEntry entry{}; entry.setName("", ""); entry.attributes = 0x10; return entry; }();
+	if (index == root)
+		return root_entry;
+	return entries(nodes[index].parent)[nodes[index].slot];
+}
+
+DirectoryEntry &DirectoryTree::entry(uint32_t index)
+{
+	return const_cast<DirectoryEntry&>(static_cast<const DirectoryTree*>(this)->entry(index));
+}
+
+uint32_t DirectoryTree::addNode(uint32_t parent, uint32_t slot)
+{
+	uint32_t index = static_cast<uint32_t>(nodes.size());
+	const std::string &parent_path = nodes[parent].path;
+	std::string path = (parent == root ? "/" : parent_path + "/") + entries(parent)[slot].fullName();
+
+	// Children are kept in slot order
+	nodes.push_back({ parent, slot, no_node, no_node, no_node, path });
+	uint32_t *link = &nodes[parent].first_child;
+	while (*link != no_node && nodes[*link].slot < slot)
+		link = &nodes[*link].next_sibling;
+	nodes[index].next_sibling = *link;
+	*link = index;
+
+	// First entry wins if a corrupted table holds the same name twice
+	path_index.emplace(std::move(path), index);
+	return index;
+}
+
+std::string DirectoryTree::normalize(std::string_view path)
+{
+	// Collapses repeated slashes and drops a trailing one
+	std::string normalized = "/";
+	for (size_t start = 0; start < path.size();)
+	{
+		size_t end = path.find('/', start);
+		if (end == std::string_view::npos)
+			end = path.size();
+		if (end > start)
+		{
+			if (normalized.size() > 1)
+				normalized += '/';
+			normalized.append(path.substr(start, end - start));
+		}
+		start = end + 1;
+	}
+	return normalized;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "DirectoryEntry.h"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Every directory of the image in one flat arena. Nodes refer to each other by
+// index and to their entry by (parent table, slot), so entries stay in the
+// on-disk tables that get written back. Full paths are hashed for lookups.
+// Directories get their table when first loaded; until then only their own
+// entry is known and nothing below them is indexed.
+class DirectoryTree
+{
+public:
+	static constexpr uint32_t no_node = UINT32_MAX;
+	static constexpr uint32_t root = 0;
+
+	struct Node
+	{
+		uint32_t parent;
+		uint32_t slot;	// Index of the entry in the parent's table
+		uint32_t table;	// Index into tables for directories, no_node for files
+		uint32_t first_child;
+		uint32_t next_sibling;
+		std::string path;	// "/" for the root, "/A/B/FILE.TXT" otherwise
+	};
+
+	struct Table
+	{
+		uint32_t node;
+		uint16_t first_cluster;	// 0 for the root directory
+		std::vector<DirectoryEntry> entries;	// Every slot, including free ones
+	};
+
+	DirectoryTree() { reset(); }
+
+	// Drops every node and starts over with an unloaded root directory
+	void reset();
+
+	// Adds nodes for the used slots of a directory table; returns how many were added
+	size_t addChildren(uint32_t directory);
+	// Gives a directory node the table read from its cluster chain
+	void attachTable(uint32_t directory, uint16_t first_cluster, std::vector<DirectoryEntry> entries);
+	// Records that a loaded directory's table now starts at first_cluster
+	void moveTable(uint32_t directory, uint16_t first_cluster);
+	// True if a loaded directory already starts at first_cluster
+	bool hasTableAt(uint16_t first_cluster) const { return table_clusters.count(first_cluster) != 0; }
+	// Stores entry in a slot of a directory table and indexes it
+	uint32_t insert(uint32_t directory, size_t slot, const DirectoryEntry &entry);
+
+	// Node for a path such as "/A/B/FILE.TXT"; a missing leading slash means the root
+	uint32_t find(std::string_view path) const;
+
+	const Node &node(uint32_t index) const { return nodes[index]; }
+	size_t nodeCount() const { return nodes.size(); }
+	const DirectoryEntry &entry(uint32_t index) const;
+	DirectoryEntry &entry(uint32_t index);
+	bool isLoaded(uint32_t index) const { return nodes[index].table != no_node; }
+
+	const Table &table(uint32_t directory) const { return directory_tables[nodes[directory].table]; }
+
+	// Directory tables in load order
+	const std::vector<Table> &tables() const { return directory_tables; }
+	std::vector<DirectoryEntry> &entries(uint32_t directory) { return directory_tables[nodes[directory].table].entries; }
+	const std::vector<DirectoryEntry> &entries(uint32_t directory) const { return directory_tables[nodes[directory].table].entries; }
+
+private:
+	std::vector<Node> nodes;
+	std::vector<Table> directory_tables;
+	std::unordered_map<std::string, uint32_t> path_index;
+	std::unordered_map<uint16_t, uint32_t> table_clusters;
+
+	uint32_t addNode(uint32_t parent, uint32_t slot);
+	static std::string normalize(std::string_view path);
+};
@@ -0,0 +1,270 @@
+#include "FatCodec.h"
+#include "CpuFeatures.h"
+#include "Instrumentation.h"
+
+#include <cstring>
+
+// Each kernel converts a prefix of the table and returns how many entries it
+// handled (always even); the reference loop finishes the remainder.
+
+static void decodeReference(const uint8_t *packed, uint16_t *entries, size_t first, size_t count)
+{
+	for (size_t i = first; i < count; i += 2)
+	{
+		const uint8_t *group = packed + i / 2 * 3;
+		entries[i] = group[0] | ((group[1] & 0x0F) << 8);
+		if (i + 1 < count)
+			entries[i + 1] = ((group[1] & 0xF0) >> 4) | (group[2] << 4);
+	}
+}
+
+static void encodeReference(const uint16_t *entries, uint8_t *packed, size_t first, size_t count)
+{
+	for (size_t i = first; i < count; i += 2)
+	{
+		uint8_t *group = packed + i / 2 * 3;
+		uint16_t entry1 = entries[i] & 0xFFF;
+		group[0] = entry1 & 0xFF;
+		if (i + 1 < count)
+		{
+			uint16_t entry2 = entries[i + 1] & 0xFFF;
+			group[1] = ((entry1 >> 8) & 0x0F) | ((entry2 & 0x0F) << 4);
+			group[2] = (entry2 >> 4) & 0xFF;
+		}
+		else
+			group[1] = (group[1] & 0xF0) | ((entry1 >> 8) & 0x0F);
+	}
+}
+
+static size_t decodeScalar(const uint8_t *packed, size_t packed_size, uint16_t *entries, size_t count)
+{
+	size_t i = 0;
+	// Reads 8 bytes to consume 6, so stop while 2 bytes of slack remain
+	for (; i + 4 <= count && i / 2 * 3 + 8 <= packed_size; i += 4)
+	{
+		uint64_t word;
+		std::memcpy(&word, packed + i / 2 * 3, sizeof(word));
+		entries[i] = static_cast<uint16_t>(word & 0xFFF);
+		entries[i + 1] = static_cast<uint16_t>((word >> 12) & 0xFFF);
+		entries[i + 2] = static_cast<uint16_t>((word >> 24) & 0xFFF);
+		entries[i + 3] = static_cast<uint16_t>((word >> 36) & 0xFFF);
+	}
+	return i;
+}
+
+static size_t encodeScalar(const uint16_t *entries, uint8_t *packed, size_t count)
+{
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		uint64_t word = static_cast<uint64_t>(entries[i] & 0xFFF) |
+			(static_cast<uint64_t>(entries[i + 1] & 0xFFF) << 12) |
+			(static_cast<uint64_t>(entries[i + 2] & 0xFFF) << 24) |
+			(static_cast<uint64_t>(entries[i + 3] & 0xFFF) << 36);
+		std::memcpy(packed + i / 2 * 3, &word, 6);
+	}
+	return i;
+}
+
+#ifdef FAT12_X86
+
+// Spreads each 3-byte group over two 16-bit lanes: (b0, b1) and (b1, b2)
+#define FAT12_DECODE_SHUFFLE 0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11
+// Gathers the low 3 bytes of each 32-bit lane
+#define FAT12_ENCODE_SHUFFLE 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1
+
+FAT12_TARGET("ssse3")
+static size_t decodeSSSE3(const uint8_t *packed, size_t packed_size, uint16_t *entries, size_t count)
+{
+	const __m128i shuffle = _mm_setr_epi8(FAT12_DECODE_SHUFFLE);
+	const __m128i low_mask = _mm_set1_epi32(0x0000FFFF);
+	const __m128i entry_mask = _mm_set1_epi16(0x0FFF);
+
+	size_t i = 0;
+	// Reads 16 bytes to consume 12
+	for (; i + 8 <= count && i / 2 * 3 + 16 <= packed_size; i += 8)
+	{
+		__m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(packed + i / 2 * 3));
+		__m128i lanes = _mm_shuffle_epi8(bytes, shuffle);
+		__m128i even = _mm_and_si128(lanes, entry_mask);
+		__m128i odd = _mm_srli_epi16(lanes, 4);
+		__m128i result = _mm_or_si128(_mm_and_si128(low_mask, even), _mm_andnot_si128(low_mask, odd));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(entries + i), result);
+	}
+	return i;
+}
+
+FAT12_TARGET("ssse3")
+static size_t encodeSSSE3(const uint16_t *entries, uint8_t *packed, size_t count)
+{
+	const __m128i shuffle = _mm_setr_epi8(FAT12_ENCODE_SHUFFLE);
+	const __m128i entry_mask = _mm_set1_epi32(0x00000FFF);
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m128i pairs = _mm_loadu_si128(reinterpret_cast<const __m128i*>(entries + i));
+		__m128i first = _mm_and_si128(pairs, entry_mask);
+		__m128i second = _mm_and_si128(_mm_srli_epi32(pairs, 16), entry_mask);
+		__m128i merged = _mm_or_si128(first, _mm_slli_epi32(second, 12));
+		__m128i bytes = _mm_shuffle_epi8(merged, shuffle);
+
+		uint8_t *group = packed + i / 2 * 3;
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(group), bytes);
+		uint32_t tail = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(bytes, 8)));
+		std::memcpy(group + 8, &tail, sizeof(tail));
+	}
+	return i;
+}
+
+FAT12_TARGET("avx2")
+static size_t decodeAVX2(const uint8_t *packed, size_t packed_size, uint16_t *entries, size_t count)
+{
+	const __m256i shuffle = _mm256_setr_epi8(FAT12_DECODE_SHUFFLE, FAT12_DECODE_SHUFFLE);
+	const __m256i entry_mask = _mm256_set1_epi16(0x0FFF);
+
+	size_t i = 0;
+	// Each 128-bit lane reads 16 bytes to consume 12
+	for (; i + 16 <= count && i / 2 * 3 + 28 <= packed_size; i += 16)
+	{
+		const uint8_t *group = packed + i / 2 * 3;
+		__m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+		__m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group + 12));
+		__m256i bytes = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+		__m256i lanes = _mm256_shuffle_epi8(bytes, shuffle);
+		__m256i even = _mm256_and_si256(lanes, entry_mask);
+		__m256i odd = _mm256_srli_epi16(lanes, 4);
+		__m256i result = _mm256_blend_epi16(even, odd, 0xAA);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(entries + i), result);
+	}
+	return i;
+}
+
+FAT12_TARGET("avx2")
+static size_t encodeAVX2(const uint16_t *entries, uint8_t *packed, size_t count)
+{
+	const __m256i shuffle = _mm256_setr_epi8(FAT12_ENCODE_SHUFFLE, FAT12_ENCODE_SHUFFLE);
+	const __m256i entry_mask = _mm256_set1_epi32(0x00000FFF);
+
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		__m256i pairs = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(entries + i));
+		__m256i first = _mm256_and_si256(pairs, entry_mask);
+		__m256i second = _mm256_and_si256(_mm256_srli_epi32(pairs, 16), entry_mask);
+		__m256i merged = _mm256_or_si256(first, _mm256_slli_epi32(second, 12));
+		__m256i bytes = _mm256_shuffle_epi8(merged, shuffle);
+
+		uint8_t *group = packed + i / 2 * 3;
+		__m128i low = _mm256_castsi256_si128(bytes);
+		__m128i high = _mm256_extracti128_si256(bytes, 1);
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(group), low);
+		uint32_t low_tail = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(low, 8)));
+		std::memcpy(group + 8, &low_tail, sizeof(low_tail));
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(group + 12), high);
+		uint32_t high_tail = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(high, 8)));
+		std::memcpy(group + 20, &high_tail, sizeof(high_tail));
+	}
+	return i;
+}
+
+#endif
+
+bool FatCodec::isSupported(Kernel kernel)
+{
+	switch (kernel)
+	{
+	case Kernel::Reference:
+	case Kernel::Scalar:
+		return true;
+#ifdef FAT12_X86
+	case Kernel::SSSE3:
+		return CpuFeatures::ssse3();
+	case Kernel::AVX2:
+		return CpuFeatures::avx2();
+#endif
+	default:
+		return false;
+	}
+}
+
+const char *FatCodec::kernelName(Kernel kernel)
+{
+	switch (kernel)
+	{
+	case Kernel::Reference: return "reference";
+	case Kernel::Scalar: return "scalar";
+	case Kernel::SSSE3: return "ssse3";
+	case Kernel::AVX2: return "avx2";
+	}
+	return "unknown";
+}
+
+FatCodec::Kernel FatCodec::bestKernel()
+{
+	static const Kernel best = isSupported(Kernel::AVX2) ? Kernel::AVX2 :
+		isSupported(Kernel::SSSE3) ? Kernel::SSSE3 : Kernel::Scalar;
+	return best;
+}
+
+void FatCodec::decode(std::span<const std::byte> packed, std::span<uint16_t> entries, Kernel kernel)
+{
+	const uint8_t *packed_bytes = reinterpret_cast<const uint8_t*>(packed.data());
+	size_t count = entries.size();
+	size_t done = 0;
+
+	switch (kernel)
+	{
+	case Kernel::Scalar:
+		done = decodeScalar(packed_bytes, packed.size(), entries.data(), count);
+		break;
+#ifdef FAT12_X86
+	case Kernel::SSSE3:
+		done = decodeSSSE3(packed_bytes, packed.size(), entries.data(), count);
+		break;
+	case Kernel::AVX2:
+		done = decodeAVX2(packed_bytes, packed.size(), entries.data(), count);
+		break;
+#endif
+	default:
+		break;
+	}
+	decodeReference(packed_bytes, entries.data(), done, count);
+	FAT12_COUNT(fat_entries_decoded, count);
+}
+
+void FatCodec::decode(std::span<const std::byte> packed, std::span<uint16_t> entries)
+{
+	decode(packed, entries, bestKernel());
+}
+
+void FatCodec::encode(std::span<const uint16_t> entries, std::span<std::byte> packed, Kernel kernel)
+{
+	uint8_t *packed_bytes = reinterpret_cast<uint8_t*>(packed.data());
+	size_t count = entries.size();
+	size_t done = 0;
+
+	switch (kernel)
+	{
+	case Kernel::Scalar:
+		done = encodeScalar(entries.data(), packed_bytes, count);
+		break;
+#ifdef FAT12_X86
+	case Kernel::SSSE3:
+		done = encodeSSSE3(entries.data(), packed_bytes, count);
+		break;
+	case Kernel::AVX2:
+		done = encodeAVX2(entries.data(), packed_bytes, count);
+		break;
+#endif
+	default:
+		break;
+	}
+	encodeReference(entries.data(), packed_bytes, done, count);
+	FAT12_COUNT(fat_entries_encoded, count);
+}
+
+void FatCodec::encode(std::span<const uint16_t> entries, std::span<std::byte> packed)
+{
+	encode(entries, packed, bestKernel());
+}
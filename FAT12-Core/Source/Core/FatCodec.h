@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+// Bulk conversion between the packed on-disk FAT (two 12-bit entries per
+// three bytes) and one uint16_t per entry.
+namespace FatCodec
+{
+	enum class Kernel
+	{
+		Reference,	// One 3-byte group at a time, kept as the correctness oracle
+		Scalar,		// Four entries per 64-bit word
+		SSSE3,		// Eight entries per 128-bit shuffle
+		AVX2		// Sixteen entries per 256-bit shuffle
+	};
+
+	// Number of bytes needed to hold entry_count packed entries
+	constexpr size_t packedSize(size_t entry_count) { return (entry_count * 3 + 1) / 2; }
+
+	bool isSupported(Kernel kernel);
+	const char *kernelName(Kernel kernel);
+	// Fastest kernel supported by the running CPU, detected once
+	Kernel bestKernel();
+
+	// packed must hold at least packedSize(entries.size()) bytes
+	void decode(std::span<const std::byte> packed, std::span<uint16_t> entries, Kernel kernel);
+	void decode(std::span<const std::byte> packed, std::span<uint16_t> entries);
+
+	// Entries are truncated to 12 bits. With an odd entry count the high nibble
+	// of the last byte belongs to the next entry and is preserved.
+	void encode(std::span<const uint16_t> entries, std::span<std::byte> packed, Kernel kernel);
+	void encode(std::span<const uint16_t> entries, std::span<std::byte> packed);
+}
@@ -0,0 +1,356 @@
+#include "File.h"
+#include "Instrumentation.h"
+
+#include <algorithm>
+#include <utility>
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#ifdef __linux__
+		#include <sys/sendfile.h>
+	#endif
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+// Portable fallback for copyRangeTo
+static bool copyThroughBuffer(const File &input, uint64_t offset, uint64_t length, File &output, uint64_t output_offset)
+{
+	char buffer[64 * 1024];
+	while (length > 0)
+	{
+		size_t chunk = static_cast<size_t>(std::min<uint64_t>(length, sizeof(buffer)));
+		if (!input.readAt(offset, buffer, chunk) || !output.writeAt(output_offset, buffer, chunk))
+			return false;
+		offset += chunk;
+		output_offset += chunk;
+		length -= chunk;
+	}
+	return true;
+}
+
+File::File(File &&other) noexcept
+	: handle(std::exchange(other.handle, invalidHandle()))
+{
+}
+
+File &File::operator=(File &&other) noexcept
+{
+	if (this != &other)
+	{
+		close();
+		handle = std::exchange(other.handle, invalidHandle());
+	}
+	return *this;
+}
+
+File::~File()
+{
+	close();
+}
+
+bool File::isOpen() const
+{
+	return handle != invalidHandle();
+}
+
+#ifdef _WIN32
+
+File::NativeHandle File::invalidHandle()
+{
+	return INVALID_HANDLE_VALUE;
+}
+
+bool File::open(const std::string &path, Mode mode)
+{
+	close();
+	DWORD access = (mode == Mode::Read) ? GENERIC_READ : (GENERIC_READ | GENERIC_WRITE);
+	DWORD disposition = (mode == Mode::Create) ? CREATE_ALWAYS : OPEN_EXISTING;
+	FAT12_COUNT(syscalls, 1);
+	handle = CreateFileA(path.c_str(), access, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+		disposition, FILE_ATTRIBUTE_NORMAL, nullptr);
+	return isOpen();
+}
+
+void File::close()
+{
+	if (isOpen())
+		CloseHandle(handle);
+	handle = invalidHandle();
+}
+
+uint64_t File::size() const
+{
+	LARGE_INTEGER file_size{};
+	FAT12_COUNT(syscalls, 1);
+	if (!GetFileSizeEx(handle, &file_size))
+		return 0;
+	return static_cast<uint64_t>(file_size.QuadPart);
+}
+
+bool File::readAt(uint64_t offset, void *data, size_t length) const
+{
+	auto *cursor = static_cast<char*>(data);
+	while (length > 0)
+	{
+		OVERLAPPED overlapped{};
+		overlapped.Offset = static_cast<DWORD>(offset);
+		overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+		DWORD done = 0;
+		DWORD chunk = static_cast<DWORD>(std::min<size_t>(length, 1u << 30));
+		FAT12_COUNT(syscalls, 1);
+		if (!ReadFile(handle, cursor, chunk, &done, &overlapped) || done == 0)
+			return false;
+		FAT12_COUNT(bytes_read, done);
+		cursor += done;
+		offset += done;
+		length -= done;
+	}
+	return true;
+}
+
+bool File::writeAt(uint64_t offset, const void *data, size_t length)
+{
+	auto *cursor = static_cast<const char*>(data);
+	while (length > 0)
+	{
+		OVERLAPPED overlapped{};
+		overlapped.Offset = static_cast<DWORD>(offset);
+		overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+		DWORD done = 0;
+		DWORD chunk = static_cast<DWORD>(std::min<size_t>(length, 1u << 30));
+		FAT12_COUNT(syscalls, 1);
+		if (!WriteFile(handle, cursor, chunk, &done, &overlapped) || done == 0)
+			return false;
+		FAT12_COUNT(bytes_written, done);
+		cursor += done;
+		offset += done;
+		length -= done;
+	}
+	return true;
+}
+
+bool File::sync()
+{
+	FAT12_COUNT(syscalls, 1);
+	return FlushFileBuffers(handle) != 0;
+}
+
+bool File::resize(uint64_t length)
+{
+	LARGE_INTEGER position{};
+	position.QuadPart = static_cast<LONGLONG>(length);
+	FAT12_COUNT(syscalls, 2);
+	return SetFilePointerEx(handle, position, nullptr, FILE_BEGIN) && SetEndOfFile(handle);
+}
+
+bool File::copyRangeTo(uint64_t offset, uint64_t length, File &output, uint64_t output_offset) const
+{
+	return copyThroughBuffer(*this, offset, length, output, output_offset);
+}
+
+bool MappedRegion::map(const File &file, bool copy_on_write)
+{
+	unmap();
+	size_t file_length = static_cast<size_t>(file.size());
+	if (file_length == 0)
+		return false;
+
+	FAT12_COUNT(syscalls, 2);
+	HANDLE mapping = CreateFileMappingA(file.nativeHandle(), nullptr, copy_on_write ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr)
+		return false;
+
+	void *view = MapViewOfFile(mapping, copy_on_write ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+	if (view == nullptr)
+	{
+		CloseHandle(mapping);
+		return false;
+	}
+
+	address = view;
+	length = file_length;
+	mapping_handle = mapping;
+	return true;
+}
+
+void MappedRegion::unmap()
+{
+	if (address != nullptr)
+		UnmapViewOfFile(address);
+	if (mapping_handle != nullptr)
+		CloseHandle(mapping_handle);
+	address = nullptr;
+	length = 0;
+	mapping_handle = nullptr;
+}
+
+#else
+
+File::NativeHandle File::invalidHandle()
+{
+	return -1;
+}
+
+bool File::open(const std::string &path, Mode mode)
+{
+	close();
+	int flags = O_CLOEXEC;
+	if (mode == Mode::Read)
+		flags |= O_RDONLY;
+	else if (mode == Mode::ReadWrite)
+		flags |= O_RDWR;
+	else
+		flags |= O_RDWR | O_CREAT | O_TRUNC;
+
+	FAT12_COUNT(syscalls, 1);
+	handle = ::open(path.c_str(), flags, 0644);
+	return isOpen();
+}
+
+void File::close()
+{
+	if (isOpen())
+		::close(handle);
+	handle = invalidHandle();
+}
+
+uint64_t File::size() const
+{
+	struct stat file_stat{};
+	FAT12_COUNT(syscalls, 1);
+	if (fstat(handle, &file_stat) != 0)
+		return 0;
+	return static_cast<uint64_t>(file_stat.st_size);
+}
+
+bool File::readAt(uint64_t offset, void *data, size_t length) const
+{
+	auto *cursor = static_cast<char*>(data);
+	while (length > 0)
+	{
+		ssize_t done = pread(handle, cursor, length, static_cast<off_t>(offset));
+		FAT12_COUNT(syscalls, 1);
+		if (done <= 0)
+			return false;
+		FAT12_COUNT(bytes_read, done);
+		cursor += done;
+		offset += static_cast<uint64_t>(done);
+		length -= static_cast<size_t>(done);
+	}
+	return true;
+}
+
+bool File::writeAt(uint64_t offset, const void *data, size_t length)
+{
+	auto *cursor = static_cast<const char*>(data);
+	while (length > 0)
+	{
+		ssize_t done = pwrite(handle, cursor, length, static_cast<off_t>(offset));
+		FAT12_COUNT(syscalls, 1);
+		if (done <= 0)
+			return false;
+		FAT12_COUNT(bytes_written, done);
+		cursor += done;
+		offset += static_cast<uint64_t>(done);
+		length -= static_cast<size_t>(done);
+	}
+	return true;
+}
+
+bool File::sync()
+{
+	FAT12_COUNT(syscalls, 1);
+#ifdef __linux__
+	return fdatasync(handle) == 0;
+#else
+	return fsync(handle) == 0;
+#endif
+}
+
+bool File::resize(uint64_t length)
+{
+	FAT12_COUNT(syscalls, 1);
+	return ftruncate(handle, static_cast<off_t>(length)) == 0;
+}
+
+bool File::copyRangeTo(uint64_t offset, uint64_t length, File &output, uint64_t output_offset) const
+{
+#ifdef __linux__
+	// copy_file_range keeps the data in the kernel (and may reflink); sendfile
+	// is the older in-kernel path. Both fall through to pread/pwrite on failure.
+	loff_t in_offset = static_cast<loff_t>(offset);
+	loff_t out_offset = static_cast<loff_t>(output_offset);
+	uint64_t remaining = length;
+	while (remaining > 0)
+	{
+		ssize_t done = copy_file_range(handle, &in_offset, output.handle, &out_offset, remaining, 0);
+		FAT12_COUNT(syscalls, 1);
+		if (done <= 0)
+			break;
+		FAT12_COUNT(bytes_read, done);
+		FAT12_COUNT(bytes_written, done);
+		remaining -= static_cast<uint64_t>(done);
+	}
+
+	if (remaining > 0 && lseek(output.handle, out_offset, SEEK_SET) == out_offset)
+	{
+		off_t sendfile_offset = static_cast<off_t>(in_offset);
+		while (remaining > 0)
+		{
+			ssize_t done = sendfile(output.handle, handle, &sendfile_offset, remaining);
+			FAT12_COUNT(syscalls, 1);
+			if (done <= 0)
+				break;
+			FAT12_COUNT(bytes_read, done);
+			FAT12_COUNT(bytes_written, done);
+			remaining -= static_cast<uint64_t>(done);
+			out_offset += done;
+		}
+	}
+
+	uint64_t copied = length - remaining;
+	return copyThroughBuffer(*this, offset + copied, remaining, output, output_offset + copied);
+#else
+	return copyThroughBuffer(*this, offset, length, output, output_offset);
+#endif
+}
+
+bool MappedRegion::map(const File &file, bool copy_on_write)
+{
+	unmap();
+	size_t file_length = static_cast<size_t>(file.size());
+	if (file_length == 0)
+		return false;
+
+	FAT12_COUNT(syscalls, 1);
+	void *view = copy_on_write
+		? mmap(nullptr, file_length, PROT_READ | PROT_WRITE, MAP_PRIVATE, file.nativeHandle(), 0)
+		: mmap(nullptr, file_length, PROT_READ, MAP_SHARED, file.nativeHandle(), 0);
+	if (view == MAP_FAILED)
+		return false;
+
+	address = view;
+	length = file_length;
+	return true;
+}
+
+void MappedRegion::unmap()
+{
+	if (address != nullptr)
+		munmap(address, length);
+	address = nullptr;
+	length = 0;
+}
+
+#endif
+
+MappedRegion::~MappedRegion()
+{
+	unmap();
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+
+// Thin RAII wrapper over a native file handle with positional I/O, so callers
+// never share a stream cursor.
+class File
+{
+public:
+#ifdef _WIN32
+	using NativeHandle = void*;
+#else
+	using NativeHandle = int;
+#endif
+
+	enum class Mode
+	{
+		Read,
+		ReadWrite,
+		Create	// Read/write, truncating or creating the file
+	};
+
+	File() = default;
+	File(const File &) = delete;
+	File &operator=(const File &) = delete;
+	File(File &&other) noexcept;
+	File &operator=(File &&other) noexcept;
+	~File();
+
+	bool open(const std::string &path, Mode mode);
+	void close();
+	bool isOpen() const;
+	uint64_t size() const;
+	bool readAt(uint64_t offset, void *data, size_t length) const;
+	bool writeAt(uint64_t offset, const void *data, size_t length);
+	// Makes everything written so far durable
+	bool sync();
+	bool resize(uint64_t length);
+	// Copies a range into another file, in-kernel where the platform allows
+	bool copyRangeTo(uint64_t offset, uint64_t length, File &output, uint64_t output_offset) const;
+	NativeHandle nativeHandle() const { return handle; }
+
+private:
+	NativeHandle handle = invalidHandle();
+
+	static NativeHandle invalidHandle();
+};
+
+// Mapping of a whole file: read-only and shared, or private and copy-on-write,
+// in which case writes only touch this process's copy of the pages they hit.
+class MappedRegion
+{
+public:
+	MappedRegion() = default;
+	MappedRegion(const MappedRegion &) = delete;
+	MappedRegion &operator=(const MappedRegion &) = delete;
+	~MappedRegion();
+
+	bool map(const File &file, bool copy_on_write = false);
+	void unmap();
+	std::span<const std::byte> bytes() const { return { static_cast<const std::byte*>(address), length }; }
+	// Only valid for copy-on-write mappings
+	std::span<std::byte> writableBytes() { return { static_cast<std::byte*>(address), length }; }
+
+private:
+	void *address = nullptr;
+	size_t length = 0;
+	void *mapping_handle = nullptr;	// Only used on Windows
+};
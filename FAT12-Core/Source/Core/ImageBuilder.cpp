@@ -0,0 +1,311 @@
+#include "ImageBuilder.h"
+#include "FatCodec.h"
+#include "Instrumentation.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <unordered_set>
+
+// Bytes buffered before each write; the image is written front to back in pieces this size
+static constexpr size_t write_chunk = 256 * 1024;
+
+// Same 8.3 mapping as imports: everything after the first dot is the extension
+static DirectoryEntry makeEntry(const std::string &host_name, uint8_t attributes)
+{
+	std::string base_name = host_name, ext;
+	size_t dot_pos = host_name.find('.');
+	if (dot_pos != std::string::npos)
+	{
+		base_name = host_name.substr(0, dot_pos);
+		ext = host_name.substr(dot_pos + 1);
+	}
+
+	DirectoryEntry entry{};
+	entry.setName(base_name, ext);
+	entry.attributes = attributes;
+	return entry;
+}
+
+void ImageBuilder::writeBootSector(const BootSector &boot_sector, std::span<std::byte> sector)
+{
+	std::fill(sector.begin(), sector.end(), std::byte{ 0 });
+	auto put = [&](size_t offset, auto value) { std::memcpy(sector.data() + offset, &value, sizeof(value)); };
+	const uint8_t jump[] = { 0xEB, 0x3C, 0x90 };
+	std::memcpy(sector.data(), jump, sizeof(jump));
+	std::memcpy(sector.data() + 3, "FAT12   ", 8);
+	put(11, boot_sector.sector_size);
+	put(13, boot_sector.sectors_per_cluster);
+	put(14, boot_sector.num_reserved_sectors);
+	put(16, boot_sector.num_fats);
+	put(17, boot_sector.max_num_root_entries);
+	// Counts that do not fit 16 bits go in the 32-bit field
+	put(19, static_cast<uint16_t>(boot_sector.total_sector_count <= 0xFFFF ? boot_sector.total_sector_count : 0));
+	put(21, boot_sector.media);
+	put(22, boot_sector.sectors_per_fat);
+	put(24, boot_sector.sectors_per_track);
+	put(26, boot_sector.heads);
+	put(32, boot_sector.total_sector_count <= 0xFFFF ? uint32_t{ 0 } : boot_sector.total_sector_count);
+	// Extended BPB
+	put(38, uint8_t{ 0x29 });
+	std::memcpy(sector.data() + 43, "NO NAME    ", 11);
+	std::memcpy(sector.data() + 54, "FAT12   ", 8);
+	put(510, uint16_t{ 0xAA55 });
+}
+
+bool ImageBuilder::build(const std::string &host_directory, const std::string &image, const BootSector &boot_sector, Report &report)
+{
+	FAT12_TIME(build_image);
+	report = {};
+	layout = layoutFor(boot_sector);
+	if (!layout.valid() || layout.sector_size < 512)
+	{
+		std::cerr << "ERROR: Boot sector does not describe a FAT12 volume." << std::endl;
+		return false;
+	}
+
+	if (!scan(host_directory) || !allocate(boot_sector.media, report))
+		return false;
+	std::vector<std::byte> sector(layout.sector_size);
+	writeBootSector(boot_sector, sector);
+	directories.front().entries.resize(layout.root_entries);
+	buffered = 0;
+	if (!output.open(image, File::Mode::Create) || !output.resize(layout.volume_size) || !append(0, sector))
+	{
+		std::cerr << "ERROR: Failed to create disk image: " << image << std::endl;
+		output.close();
+		return false;
+	}
+	bool written = write(image);
+	output.close();
+	return written;
+}
+
+bool ImageBuilder::scan(const std::string &host_directory)
+{
+	directories.clear();
+	files.clear();
+	if (!std::filesystem::is_directory(host_directory))
+	{
+		std::cerr << "ERROR: Failed to open host directory: " << host_directory << std::endl;
+		return false;
+	}
+
+	// Breadth-first, each directory listed in name order so builds are reproducible
+	directories.push_back({ host_directory, 0, 0 });
+	std::vector<std::filesystem::directory_entry> children;
+	std::unordered_set<std::string> names;
+	for (size_t index = 0; index < directories.size(); index++)
+	{
+		std::error_code error;
+		children.clear();
+		for (std::filesystem::directory_iterator walker(directories[index].source, error), end; !error && walker != end; walker.increment(error))
+			children.push_back(*walker);
+		if (error)
+		{
+			std::cerr << "ERROR: Failed to read host directory: " << directories[index].source.string() << std::endl;
+			return false;
+		}
+		std::sort(children.begin(), children.end());
+
+		// "." and ".." lead every table below the root
+		if (index != 0)
+		{
+			DirectoryEntry dot{};
+			dot.setName(".", "");
+			dot.attributes = 0x10;
+			directories[index].entries.push_back(dot);
+			dot.setName("..", "");
+			directories[index].entries.push_back(dot);
+		}
+		directories[index].first_file = files.size();
+		names.clear();
+		// Types come from the listing itself where the platform reports them
+		for (const std::filesystem::directory_entry &child : children)
+		{
+			// Linked directories are skipped, as a recursive import would
+			bool is_directory = child.is_directory(error);
+			if (is_directory && child.is_symlink(error))
+				continue;
+			if (!is_directory && !child.is_regular_file(error))
+				continue;
+			DirectoryEntry entry = makeEntry(child.path().filename().string(), is_directory ? 0x10 : 0x20);
+			if (entry.nameString().empty() || !names.insert(entry.fullName()).second)
+			{
+				std::cerr << "ERROR: No unique 8.3 name for: " << child.path().string() << std::endl;
+				return false;
+			}
+
+			size_t slot = directories[index].entries.size();
+			if (is_directory)
+				directories.push_back({ child.path(), index, slot });
+			else
+			{
+				uint64_t size = child.file_size(error);
+				if (error || size > UINT32_MAX)
+				{
+					std::cerr << "ERROR: Input file is too large: " << child.path().string() << std::endl;
+					return false;
+				}
+				entry.file_size = static_cast<uint32_t>(size);
+				files.push_back({ child.path(), static_cast<uint32_t>(size), slot });
+			}
+			directories[index].entries.push_back(entry);
+		}
+		directories[index].file_count = files.size() - directories[index].first_file;
+	}
+
+	if (directories.front().entries.size() > layout.root_entries)
+	{
+		std::cerr << "ERROR: Too many entries for the root directory: " << directories.front().entries.size()
+			<< " of " << layout.root_entries << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool ImageBuilder::allocate(uint8_t media, Report &report)
+{
+	uint32_t cluster_size = layout.cluster_size;
+	fat.assign(layout.fat_entries, 0);
+	fat[0] = 0xF00 | media;
+	fat[1] = 0xFFF;
+
+	// Each directory's table is followed by its files, so the data area fills in
+	// the order the tree was scanned
+	uint32_t next_cluster = 2;
+	auto allocateRun = [&](uint64_t bytes, uint16_t &first_cluster)
+	{
+		uint32_t clusters = static_cast<uint32_t>((bytes + cluster_size - 1) / cluster_size);
+		first_cluster = clusters == 0 ? 0 : static_cast<uint16_t>(next_cluster);
+		if (clusters > layout.fat_entries - next_cluster)
+			return false;
+		for (uint32_t cluster = next_cluster; cluster < next_cluster + clusters; cluster++)
+			fat[cluster] = static_cast<uint16_t>(cluster + 1 < next_cluster + clusters ? cluster + 1 : 0xFFF);
+		next_cluster += clusters;
+		report.used_clusters += clusters;
+		return true;
+	};
+
+	for (size_t index = 0; index < directories.size(); index++)
+	{
+		PlannedDirectory &directory = directories[index];
+		bool fits = true;
+		if (index != 0)
+		{
+			fits = allocateRun(directory.entries.size() * sizeof(DirectoryEntry), directory.first_cluster);
+			if (fits)
+			{
+				directory.clusters = next_cluster - directory.first_cluster;
+				directory.entries.resize(directory.clusters * cluster_size / sizeof(DirectoryEntry));
+				directory.entries[0].first_logical_cluster = directory.first_cluster;
+				directory.entries[1].first_logical_cluster = directories[directory.parent].first_cluster;
+				directories[directory.parent].entries[directory.slot].first_logical_cluster = directory.first_cluster;
+				report.directories++;
+			}
+		}
+		for (size_t file = directory.first_file; fits && file < directory.first_file + directory.file_count; file++)
+		{
+			fits = allocateRun(files[file].size, directory.entries[files[file].slot].first_logical_cluster);
+			report.files++;
+			report.file_bytes += files[file].size;
+		}
+		if (!fits)
+		{
+			std::cerr << "ERROR: Not enough space on the disk image for " << directory.source.string() << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool ImageBuilder::write(const std::string &image)
+{
+	packed_fat.assign(layout.fat_size, std::byte{ 0 });
+	FatCodec::encode(fat, packed_fat);
+	for (uint32_t copy = 0; copy < layout.fat_count; copy++)
+	{
+		if (!append(layout.fatCopyOffset(copy), packed_fat))
+			return false;
+	}
+
+	bool written = append(layout.root_offset, std::as_bytes(std::span(directories.front().entries)));
+	for (size_t index = 0; written && index < directories.size(); index++)
+	{
+		const PlannedDirectory &directory = directories[index];
+		if (index != 0)
+			written = append(layout.clusterOffset(directory.first_cluster), std::as_bytes(std::span(directory.entries)));
+		for (size_t file = directory.first_file; written && file < directory.first_file + directory.file_count; file++)
+		{
+			uint16_t first_cluster = directory.entries[files[file].slot].first_logical_cluster;
+			written = first_cluster == 0 || appendFile(layout.clusterOffset(first_cluster), files[file]);
+		}
+	}
+	if (!written || !flush())
+	{
+		std::cerr << "ERROR: Failed to write disk image: " << image << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool ImageBuilder::reserve(uint64_t offset)
+{
+	if (buffer.size() < write_chunk)
+		buffer.resize(write_chunk);
+	if (buffered > 0 && (buffer_offset + buffered != offset || buffered == buffer.size()) && !flush())
+		return false;
+	if (buffered == 0)
+		buffer_offset = offset;
+	return true;
+}
+
+bool ImageBuilder::append(uint64_t offset, std::span<const std::byte> data)
+{
+	for (size_t done = 0; done < data.size();)
+	{
+		if (!reserve(offset + done))
+			return false;
+		size_t chunk = std::min(buffer.size() - buffered, data.size() - done);
+		std::memcpy(buffer.data() + buffered, data.data() + done, chunk);
+		buffered += chunk;
+		done += chunk;
+	}
+	return true;
+}
+
+bool ImageBuilder::appendFile(uint64_t offset, const PlannedFile &file)
+{
+	File input;
+	if (!input.open(file.source.string(), File::Mode::Read))
+	{
+		std::cerr << "ERROR: Failed to open input file: " << file.source.string() << std::endl;
+		return false;
+	}
+
+	// Read straight into the write buffer, zeroing the rest of the last cluster
+	uint64_t padded = (static_cast<uint64_t>(file.size) + layout.cluster_size - 1) / layout.cluster_size * layout.cluster_size;
+	for (uint64_t done = 0; done < padded;)
+	{
+		if (!reserve(offset + done))
+			return false;
+		size_t chunk = static_cast<size_t>(std::min<uint64_t>(buffer.size() - buffered, padded - done));
+		size_t data_bytes = static_cast<size_t>(std::min<uint64_t>(chunk, file.size - std::min<uint64_t>(done, file.size)));
+		if (!input.readAt(done, buffer.data() + buffered, data_bytes))
+		{
+			std::cerr << "ERROR: Failed to read input file: " << file.source.string() << std::endl;
+			return false;
+		}
+		std::fill(buffer.begin() + buffered + data_bytes, buffer.begin() + buffered + chunk, std::byte{ 0 });
+		buffered += chunk;
+		done += chunk;
+	}
+	return true;
+}
+
+bool ImageBuilder::flush()
+{
+	bool written = buffered == 0 || output.writeAt(buffer_offset, buffer.data(), buffered);
+	buffered = 0;
+	return written;
+}
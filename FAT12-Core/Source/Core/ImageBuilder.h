@@ -0,0 +1,71 @@
+#pragma once
+
+#include "DirectoryEntry.h"
+#include "File.h"
+#include "Layout.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <vector>
+
+// Formats a fresh image from a host directory tree in one pass. The whole tree is
+// planned from file sizes first, so every directory table and every file gets one
+// contiguous run, and the image is then written strictly in offset order: boot
+// sector, each FAT copy, the root directory, then the data area cluster by cluster.
+// Buffers are kept between builds.
+class ImageBuilder
+{
+public:
+	struct Report
+	{
+		uint32_t files = 0;
+		uint32_t directories = 0;	// Below the root
+		uint64_t file_bytes = 0;
+		uint32_t used_clusters = 0;	// File data and directory tables
+	};
+
+	bool build(const std::string &host_directory, const std::string &image, const BootSector &boot_sector, Report &report);
+
+	// Sector 0 of a freshly formatted volume; sector must hold at least 512 bytes
+	static void writeBootSector(const BootSector &boot_sector, std::span<std::byte> sector);
+
+private:
+	struct PlannedDirectory
+	{
+		std::filesystem::path source;
+		size_t parent;
+		size_t slot;	// Of its entry in the parent's table
+		uint16_t first_cluster = 0;
+		uint32_t clusters = 0;
+		size_t first_file = 0;	// Its files are files[first_file, first_file + file_count)
+		size_t file_count = 0;
+		std::vector<DirectoryEntry> entries{};
+	};
+	struct PlannedFile
+	{
+		std::filesystem::path source;
+		uint32_t size;
+		size_t slot;
+	};
+
+	Layout layout;
+	std::vector<PlannedDirectory> directories;	// Breadth-first, root first
+	std::vector<PlannedFile> files;
+	std::vector<uint16_t> fat;
+	std::vector<std::byte> packed_fat;
+	File output;
+	std::vector<std::byte> buffer;
+	uint64_t buffer_offset = 0;
+	size_t buffered = 0;
+
+	bool scan(const std::string &host_directory);
+	bool allocate(uint8_t media, Report &report);
+	bool write(const std::string &image);
+	bool reserve(uint64_t offset);
+	bool append(uint64_t offset, std::span<const std::byte> data);
+	bool appendFile(uint64_t offset, const PlannedFile &file);
+	bool flush();
+};
@@ -0,0 +1,118 @@
+#include "ImagePool.h"
+
+ImagePool::ImagePool(const Options &options) : options(options), snapshot_cache(options.snapshot_capacity)
+{
+	this->options.max_open = std::max<size_t>(this->options.max_open, 1);
+	this->options.mount.snapshots = &snapshot_cache;
+}
+
+ImagePool::~ImagePool()
+{
+	// Unmounting syncs each image
+	std::lock_guard lock(mutex);
+	mounts.clear();
+}
+
+ImagePool::Lease ImagePool::acquire(const std::string &path)
+{
+	std::unique_lock lock(mutex);
+	while (true)
+	{
+		auto found = mounts.find(path);
+		if (found != mounts.end())
+		{
+			if (found->second.image)
+				return lease(path, found->second);
+			changed.wait(lock);	// Another thread is mounting it
+			continue;
+		}
+		if (mounts.size() < options.max_open)
+			break;
+		if (idle_mounts.empty())
+		{
+			changed.wait(lock);
+			continue;
+		}
+
+		// Unmount outside the lock, since that may write metadata back
+		auto evicted = mounts.find(idle_mounts.back());
+		std::unique_ptr<FAT12> image = std::move(evicted->second.image);
+		idle_mounts.pop_back();
+		mounts.erase(evicted);
+		++evictions;
+		lock.unlock();
+		image.reset();
+		lock.lock();
+	}
+
+	// The placeholder holds the budget slot while the image mounts without the lock
+	mounts.emplace(path, Mount{});
+	lock.unlock();
+	auto image = std::make_unique<FAT12>(path, options.mount);
+	lock.lock();
+
+	auto placeholder = mounts.find(path);
+	changed.notify_all();
+	if (!image->isMounted())
+	{
+		mounts.erase(placeholder);
+		return nullptr;
+	}
+	placeholder->second.image = std::move(image);
+	return lease(path, placeholder->second);
+}
+
+ImagePool::Lease ImagePool::lease(const std::string &path, Mount &mount)
+{
+	if (mount.is_idle)
+		idle_mounts.erase(mount.idle);
+	mount.is_idle = false;
+	++mount.leases;
+	return Lease(mount.image.get(), [this, path](FAT12 *) { release(path); });
+}
+
+void ImagePool::release(const std::string &path)
+{
+	std::lock_guard lock(mutex);
+	Mount &mount = mounts.at(path);
+	if (--mount.leases == 0)
+	{
+		idle_mounts.push_front(path);
+		mount.idle = idle_mounts.begin();
+		mount.is_idle = true;
+		changed.notify_all();
+	}
+}
+
+size_t ImagePool::forEach(const std::vector<std::string> &paths, const std::function<void(const std::string &, FAT12 &)> &function,
+	size_t thread_count)
+{
+	std::atomic<size_t> failed{ 0 };
+	ThreadPool workers(std::min(thread_count != 0 ? thread_count : std::thread::hardware_concurrency(), std::max<size_t>(paths.size(), 1)));
+	for (const std::string &path : paths)
+	{
+		workers.submit([this, &path, &function, &failed]
+		{
+			// One lease per worker at a time, so a full budget frees up as workers finish
+			Lease image = acquire(path);
+			if (image)
+				function(path, *image);
+			else
+				++failed;
+		});
+	}
+	workers.wait();
+	return failed;
+}
+
+size_t ImagePool::openCount() const
+{
+	std::lock_guard lock(mutex);
+	return mounts.size();
+}
+
+size_t ImagePool::evictionCount() const
+{
+	std::lock_guard lock(mutex);
+	return evictions;
+}
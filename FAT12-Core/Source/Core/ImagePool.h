@@ -0,0 +1,67 @@
+#pragma once
+
+#include "Core.h"
+
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Mounts many images under a fixed budget of open images. Leases keep a mount
+// open; once its last lease is dropped it stays open but idle, and idle mounts
+// are unmounted least recently used first to make room. Mounts share one
+// SnapshotCache, so images with identical metadata are parsed once.
+// The pool must outlive every lease it hands out.
+class ImagePool
+{
+public:
+	struct Options
+	{
+		size_t max_open = 64;	// Images mounted at once, leased or idle
+		MountOptions mount;	// snapshots is replaced by the pool's own cache
+		size_t snapshot_capacity = 1024;
+	};
+	using Lease = std::shared_ptr<FAT12>;
+
+	explicit ImagePool(const Options &options);
+	ImagePool(const ImagePool &) = delete;
+	ImagePool &operator=(const ImagePool &) = delete;
+	~ImagePool();
+
+	// Mounted image, or nullptr if it cannot be mounted. Blocks while the budget
+	// is used up by leased mounts.
+	Lease acquire(const std::string &path);
+
+	// Calls function for every image that mounts, on thread_count workers (0 means
+	// one per hardware thread), and returns how many images failed to mount
+	size_t forEach(const std::vector<std::string> &paths, const std::function<void(const std::string &, FAT12 &)> &function,
+		size_t thread_count = 0);
+
+	size_t openCount() const;
+	size_t evictionCount() const;
+	const SnapshotCache &snapshots() const { return snapshot_cache; }
+
+private:
+	struct Mount
+	{
+		std::unique_ptr<FAT12> image;	// nullptr while another thread mounts it
+		size_t leases = 0;
+		std::list<std::string>::iterator idle;	// Position in idle_mounts, valid while is_idle
+		bool is_idle = false;
+	};
+
+	Options options;
+	SnapshotCache snapshot_cache;
+	mutable std::mutex mutex;
+	std::condition_variable changed;
+	std::unordered_map<std::string, Mount> mounts;
+	std::list<std::string> idle_mounts;	// Most recently released first
+	size_t evictions = 0;
+
+	Lease lease(const std::string &path, Mount &mount);
+	void release(const std::string &path);
+};
@@ -0,0 +1,235 @@
+#include "Instrumentation.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Instrumentation
+{
+	namespace
+	{
+		struct TraceEvent
+		{
+			Timer timer;
+			uint32_t thread_index;
+			int64_t start_ns;
+			uint64_t duration_ns;
+		};
+
+		// Events kept per trace; later ones are dropped
+		constexpr size_t max_trace_events = 1 << 20;
+
+		struct Registry
+		{
+			std::mutex mutex;
+			std::vector<std::unique_ptr<ThreadSlots>> slots;
+			std::vector<ThreadSlots*> free_slots;
+			Snapshot retired;	// Totals of threads that have exited
+			Snapshot baseline;	// Totals at the last reset
+			std::vector<TraceEvent> events;
+			std::chrono::steady_clock::time_point trace_start;
+		};
+
+		// Never destroyed, so threads and static destructors can still record at exit
+		Registry &registry()
+		{
+			static Registry *instance = new Registry;
+			return *instance;
+		}
+
+		void addSlots(const ThreadSlots &slots, Snapshot &totals)
+		{
+			for (size_t index = 0; index < counter_count; index++)
+				totals.counters[index] += slots.counters[index].load(std::memory_order_relaxed);
+			for (size_t index = 0; index < timer_count; index++)
+			{
+				TimerStats &timer = totals.timers[index];
+				timer.calls += slots.calls[index].load(std::memory_order_relaxed);
+				timer.total_ns += slots.total_ns[index].load(std::memory_order_relaxed);
+				timer.max_ns = std::max(timer.max_ns, slots.max_ns[index].load(std::memory_order_relaxed));
+			}
+		}
+
+		void clearSlots(ThreadSlots &slots)
+		{
+			for (std::atomic<uint64_t> &value : slots.counters)
+				value.store(0, std::memory_order_relaxed);
+			for (size_t index = 0; index < timer_count; index++)
+			{
+				slots.calls[index].store(0, std::memory_order_relaxed);
+				slots.total_ns[index].store(0, std::memory_order_relaxed);
+				slots.max_ns[index].store(0, std::memory_order_relaxed);
+			}
+		}
+
+		// Returns the thread's slots to the registry when the thread exits
+		struct SlotOwner
+		{
+			ThreadSlots *owned = nullptr;
+			~SlotOwner()
+			{
+				Registry &shared = registry();
+				std::lock_guard lock(shared.mutex);
+				addSlots(*owned, shared.retired);
+				clearSlots(*owned);
+				shared.free_slots.push_back(owned);
+				thread_slots = &orphanSlots();
+			}
+
+			// Shared by whatever still records on a thread after its slots were returned
+			static ThreadSlots &orphanSlots()
+			{
+				static ThreadSlots *orphans = new ThreadSlots;
+				return *orphans;
+			}
+		};
+	}
+
+	const char *name(Counter counter)
+	{
+		static const char *const names[] =
+		{
+			"syscalls", "bytes_read", "bytes_written", "seeks", "device_writes", "device_bytes_written", "clusters_walked",
+			"allocator_probes", "fat_entries_decoded", "fat_entries_encoded", "directory_entries_parsed"
+		};
+		static_assert(std::size(names) == counter_count);
+		return names[static_cast<size_t>(counter)];
+	}
+
+	const char *name(Timer timer)
+	{
+		static const char *const names[] =
+		{
+			"mount", "read_fat", "load_directory", "import", "export_tree", "copy_file", "flush_metadata",
+			"sync", "check", "defragment", "build_image", "hash_files"
+		};
+		static_assert(std::size(names) == timer_count);
+		return names[static_cast<size_t>(timer)];
+	}
+
+	ThreadSlots *registerThread()
+	{
+		thread_local SlotOwner owner;
+		Registry &shared = registry();
+		std::lock_guard lock(shared.mutex);
+		if (shared.free_slots.empty())
+		{
+			shared.slots.push_back(std::make_unique<ThreadSlots>());
+			shared.slots.back()->thread_index = static_cast<uint32_t>(shared.slots.size());
+			owner.owned = shared.slots.back().get();
+		}
+		else
+		{
+			owner.owned = shared.free_slots.back();
+			shared.free_slots.pop_back();
+		}
+		thread_slots = owner.owned;
+		return owner.owned;
+	}
+
+	Snapshot snapshot()
+	{
+		Registry &shared = registry();
+		std::lock_guard lock(shared.mutex);
+		Snapshot totals = shared.retired;
+		for (const std::unique_ptr<ThreadSlots> &slots : shared.slots)
+			addSlots(*slots, totals);
+
+		for (size_t index = 0; index < counter_count; index++)
+			totals.counters[index] -= shared.baseline.counters[index];
+		for (size_t index = 0; index < timer_count; index++)
+		{
+			totals.timers[index].calls -= shared.baseline.timers[index].calls;
+			totals.timers[index].total_ns -= shared.baseline.timers[index].total_ns;
+		}
+		return totals;
+	}
+
+	void reset()
+	{
+		// Sums restart from a baseline, so no thread's slots are written from here.
+		// Maxima cannot be rebased and are cleared, racing at most one update.
+		Snapshot current = snapshot();
+		Registry &shared = registry();
+		std::lock_guard lock(shared.mutex);
+		for (size_t index = 0; index < counter_count; index++)
+			shared.baseline.counters[index] += current.counters[index];
+		for (size_t index = 0; index < timer_count; index++)
+		{
+			shared.baseline.timers[index].calls += current.timers[index].calls;
+			shared.baseline.timers[index].total_ns += current.timers[index].total_ns;
+			shared.retired.timers[index].max_ns = 0;
+			for (const std::unique_ptr<ThreadSlots> &slots : shared.slots)
+				slots->max_ns[index].store(0, std::memory_order_relaxed);
+		}
+	}
+
+	void writeJson(const Snapshot &stats, std::ostream &out)
+	{
+		out << "{\"instrumentation\":" << (compiled_in ? "true" : "false") << ",\"counters\":{";
+		for (size_t index = 0; index < counter_count; index++)
+			out << (index ? "," : "") << "\"" << name(static_cast<Counter>(index)) << "\":" << stats.counters[index];
+		out << "},\"timers\":{";
+		for (size_t index = 0; index < timer_count; index++)
+		{
+			const TimerStats &timer = stats.timers[index];
+			out << (index ? "," : "") << "\"" << name(static_cast<Timer>(index)) << "\":{\"calls\":" << timer.calls
+				<< ",\"total_ns\":" << timer.total_ns << ",\"max_ns\":" << timer.max_ns << "}";
+		}
+		out << "}}\n";
+	}
+
+	void setTracing(bool enabled)
+	{
+		Registry &shared = registry();
+		std::lock_guard lock(shared.mutex);
+		if (enabled && !tracing.load(std::memory_order_relaxed))
+		{
+			shared.events.clear();
+			shared.trace_start = std::chrono::steady_clock::now();
+		}
+		tracing.store(enabled, std::memory_order_relaxed);
+	}
+
+	bool isTracing()
+	{
+		return tracing.load(std::memory_order_relaxed);
+	}
+
+	void recordEvent(Timer timer, std::chrono::steady_clock::time_point start, uint64_t duration_ns)
+	{
+		uint32_t thread_index = slots().thread_index;
+		Registry &shared = registry();
+		std::lock_guard lock(shared.mutex);
+		if (shared.events.size() < max_trace_events)
+			shared.events.push_back({ timer, thread_index, std::chrono::duration_cast<std::chrono::nanoseconds>(start - shared.trace_start).count(), duration_ns });
+	}
+
+	bool writeTrace(const std::string &path)
+	{
+		std::ofstream out(path, std::ios::trunc);
+		if (!out)
+		{
+			std::cerr << "ERROR: Failed to create trace file: " << path << std::endl;
+			return false;
+		}
+
+		// Complete ("X") events with microsecond timestamps, kept to the
+		// nanosecond: the default six significant digits lose it within a second
+		Registry &shared = registry();
+		std::lock_guard lock(shared.mutex);
+		out << std::fixed << std::setprecision(3) << "{\"traceEvents\":[";
+		for (size_t index = 0; index < shared.events.size(); index++)
+		{
+			const TraceEvent &event = shared.events[index];
+			out << (index ? ",\n" : "\n") << "{\"name\":\"" << name(event.timer) << "\",\"cat\":\"fat12\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+				<< event.thread_index << ",\"ts\":" << event.start_ns / 1000.0 << ",\"dur\":" << event.duration_ns / 1000.0 << "}";
+		}
+		out << "\n],\"displayTimeUnit\":\"ns\"}\n";
+		return static_cast<bool>(out);
+	}
+}
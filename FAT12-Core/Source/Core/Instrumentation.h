@@ -0,0 +1,154 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+// Process-wide counters and scoped timers for the hot paths. Each thread records
+// into its own slots with plain relaxed stores, so an event costs a few
+// nanoseconds and threads never share a cache line; readers sum every thread.
+// Compiled in when FAT12_INSTRUMENTATION is defined (Debug and Release); without
+// it FAT12_COUNT and FAT12_TIME expand to nothing and snapshots stay empty.
+namespace Instrumentation
+{
+	enum class Counter : uint8_t
+	{
+		syscalls,	// Host file calls that reach the kernel: open, stat, map, read, write, sync, resize, copy
+		bytes_read,	// Through those calls
+		bytes_written,
+		seeks,	// Stream repositioning; everything else uses positional I/O
+		device_writes,	// BlockDevice::write calls, whatever the backend
+		device_bytes_written,
+		clusters_walked,	// FAT links followed by chain walks
+		allocator_probes,	// Free-bitmap words examined looking for clusters
+		fat_entries_decoded,
+		fat_entries_encoded,
+		directory_entries_parsed,
+		count
+	};
+
+	enum class Timer : uint8_t
+	{
+		mount,
+		read_fat,
+		load_directory,
+		import,	// One import transaction, data and metadata
+		export_tree,
+		copy_file,	// One file out of the image
+		flush_metadata,
+		sync,
+		check,
+		defragment,
+		build_image,
+		hash_files,
+		count
+	};
+
+	constexpr size_t counter_count = static_cast<size_t>(Counter::count);
+	constexpr size_t timer_count = static_cast<size_t>(Timer::count);
+
+	struct TimerStats
+	{
+		uint64_t calls = 0;
+		uint64_t total_ns = 0;
+		uint64_t max_ns = 0;
+	};
+
+	struct Snapshot
+	{
+		std::array<uint64_t, counter_count> counters{};
+		std::array<TimerStats, timer_count> timers{};
+	};
+
+#ifdef FAT12_INSTRUMENTATION
+	inline constexpr bool compiled_in = true;
+#else
+	inline constexpr bool compiled_in = false;
+#endif
+
+	const char *name(Counter counter);
+	const char *name(Timer timer);
+
+	// Totals since start-up or the last reset, across every thread
+	Snapshot snapshot();
+	void reset();
+	void writeJson(const Snapshot &stats, std::ostream &out);
+
+	// While tracing, every timed scope is also kept as an event for writeTrace,
+	// in the Chrome trace format (chrome://tracing, Perfetto)
+	void setTracing(bool enabled);
+	bool isTracing();
+	bool writeTrace(const std::string &path);
+
+	// Per-thread slots; only the owning thread writes them. Slots of exited threads
+	// are folded into the totals and handed to the next new thread.
+	struct alignas(64) ThreadSlots
+	{
+		uint32_t thread_index = 0;	// tid in traces
+		std::array<std::atomic<uint64_t>, counter_count> counters{};
+		std::array<std::atomic<uint64_t>, timer_count> calls{};
+		std::array<std::atomic<uint64_t>, timer_count> total_ns{};
+		std::array<std::atomic<uint64_t>, timer_count> max_ns{};
+	};
+
+	ThreadSlots *registerThread();
+	void recordEvent(Timer timer, std::chrono::steady_clock::time_point start, uint64_t duration_ns);
+	inline std::atomic<bool> tracing{ false };
+	inline thread_local ThreadSlots *thread_slots = nullptr;
+
+	inline ThreadSlots &slots()
+	{
+		ThreadSlots *current = thread_slots;
+		return current ? *current : *registerThread();
+	}
+
+	// Single writer, so a relaxed load and store is enough and no locked instruction is needed
+	inline void bump(std::atomic<uint64_t> &slot, uint64_t amount)
+	{
+		slot.store(slot.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+	}
+
+	inline void count(Counter counter, uint64_t amount)
+	{
+		bump(slots().counters[static_cast<size_t>(counter)], amount);
+	}
+
+	class ScopedTimer
+	{
+	public:
+		explicit ScopedTimer(Timer timer) : timer(timer), start(std::chrono::steady_clock::now()) {}
+		ScopedTimer(const ScopedTimer &) = delete;
+		ScopedTimer &operator=(const ScopedTimer &) = delete;
+		~ScopedTimer()
+		{
+			uint64_t elapsed = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+			ThreadSlots &current = slots();
+			size_t index = static_cast<size_t>(timer);
+			bump(current.calls[index], 1);
+			bump(current.total_ns[index], elapsed);
+			if (elapsed > current.max_ns[index].load(std::memory_order_relaxed))
+				current.max_ns[index].store(elapsed, std::memory_order_relaxed);
+			if (tracing.load(std::memory_order_relaxed))
+				recordEvent(timer, start, elapsed);
+		}
+
+	private:
+		Timer timer;
+		std::chrono::steady_clock::time_point start;
+	};
+}
+
+#define FAT12_CONCAT_INNER(a, b) a##b
+#define FAT12_CONCAT(a, b) FAT12_CONCAT_INNER(a, b)
+
+#ifdef FAT12_INSTRUMENTATION
+	#define FAT12_COUNT(counter, amount) ::Instrumentation::count(::Instrumentation::Counter::counter, (amount))
+	#define FAT12_TIME(timer) ::Instrumentation::ScopedTimer FAT12_CONCAT(fat12_timer_, __LINE__)(::Instrumentation::Timer::timer)
+#else
+	#define FAT12_COUNT(counter, amount) ((void)0)
+	#define FAT12_TIME(timer) ((void)0)
+#endif
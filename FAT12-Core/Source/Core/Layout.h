@@ -0,0 +1,189 @@
+#pragma once
+
+#include "DirectoryEntry.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string_view>
+
+// BIOS parameter block fields the layout is derived from
+struct BootSector
+{
+	uint16_t sector_size;
+	uint8_t sectors_per_cluster;
+	uint16_t num_reserved_sectors;
+	uint8_t num_fats;
+	uint16_t max_num_root_entries;
+	uint32_t total_sector_count;	// The 32-bit count when the 16-bit field is 0
+	uint16_t sectors_per_fat;
+	uint8_t media = 0xF0;	// Also the low byte of FAT entry 0
+	uint16_t sectors_per_track = 0;	// Drive geometry, 0 where there is none
+	uint16_t heads = 0;
+};
+
+// Byte offset and size of every region of a FAT12 volume, derived once from
+// the BPB. Everything that turns a cluster or FAT copy into an image offset
+// goes through here.
+struct Layout
+{
+	uint32_t sector_size = 0;
+	uint32_t cluster_size = 0;
+	uint32_t fat_count = 0;
+	uint64_t fat_offset = 0;
+	uint32_t fat_size = 0;	// Bytes per FAT copy
+	uint64_t root_offset = 0;
+	uint32_t root_entries = 0;
+	uint64_t data_offset = 0;
+	uint32_t cluster_count = 0;	// Data clusters, numbered from 2
+	uint32_t fat_entries = 0;	// cluster_count + 2, the size of the unpacked FAT
+	uint64_t volume_size = 0;
+
+	// FAT12 stops at 4084 clusters; anything larger is FAT16
+	static constexpr uint32_t max_cluster_count = 4084;
+
+	constexpr bool valid() const { return cluster_count != 0; }
+	constexpr uint64_t clusterOffset(uint32_t cluster) const { return data_offset + static_cast<uint64_t>(cluster - 2) * cluster_size; }
+	constexpr uint64_t fatCopyOffset(uint32_t copy) const { return fat_offset + static_cast<uint64_t>(copy) * fat_size; }
+	constexpr uint32_t rootSize() const { return root_entries * static_cast<uint32_t>(sizeof(DirectoryEntry)); }
+
+	// Returns an invalid layout unless the BPB describes a FAT12 volume
+	static constexpr Layout derive(const BootSector &bpb)
+	{
+		auto isPowerOfTwo = [](uint32_t value) { return value != 0 && (value & (value - 1)) == 0; };
+		if (bpb.sector_size < 128 || bpb.sector_size > 4096 || !isPowerOfTwo(bpb.sector_size) ||
+			!isPowerOfTwo(bpb.sectors_per_cluster) || bpb.num_reserved_sectors == 0 || bpb.num_fats == 0 ||
+			bpb.sectors_per_fat == 0 || bpb.max_num_root_entries == 0)
+			return {};
+
+		Layout layout;
+		layout.sector_size = bpb.sector_size;
+		layout.cluster_size = bpb.sectors_per_cluster * layout.sector_size;
+		layout.fat_count = bpb.num_fats;
+		layout.fat_offset = static_cast<uint64_t>(bpb.num_reserved_sectors) * layout.sector_size;
+		layout.fat_size = bpb.sectors_per_fat * layout.sector_size;
+		layout.root_offset = layout.fat_offset + static_cast<uint64_t>(layout.fat_count) * layout.fat_size;
+		layout.root_entries = bpb.max_num_root_entries;
+		uint32_t root_sectors = (layout.rootSize() + layout.sector_size - 1) / layout.sector_size;
+		layout.data_offset = layout.root_offset + static_cast<uint64_t>(root_sectors) * layout.sector_size;
+		layout.volume_size = static_cast<uint64_t>(bpb.total_sector_count) * layout.sector_size;
+		if (layout.volume_size <= layout.data_offset)
+			return {};
+
+		// Clusters the FAT has no entry for are not part of the volume
+		uint32_t cluster_count = static_cast<uint32_t>((layout.volume_size - layout.data_offset) / layout.cluster_size);
+		uint32_t fat_capacity = layout.fat_size * 2 / 3;
+		cluster_count = std::min(cluster_count, fat_capacity > 2 ? fat_capacity - 2 : 0);
+		if (cluster_count == 0 || cluster_count > max_cluster_count)
+			return {};
+		layout.cluster_count = cluster_count;
+		layout.fat_entries = cluster_count + 2;
+		return layout;
+	}
+};
+
+// Standard floppy formats, their layouts computed at compile time
+struct StandardFormat
+{
+	std::string_view name;
+	BootSector boot_sector;
+	Layout layout;
+};
+
+inline constexpr BootSector standard_boot_sectors[] =
+{
+	{ 512, 1, 1, 2, 64, 320, 1, 0xFE, 8, 1 },	// 160 KB
+	{ 512, 1, 1, 2, 64, 360, 2, 0xFC, 9, 1 },	// 180 KB
+	{ 512, 2, 1, 2, 112, 640, 1, 0xFF, 8, 2 },	// 320 KB
+	{ 512, 2, 1, 2, 112, 720, 2, 0xFD, 9, 2 },	// 360 KB
+	{ 512, 2, 1, 2, 112, 1440, 3, 0xF9, 9, 2 },	// 720 KB
+	{ 512, 1, 1, 2, 224, 2400, 7, 0xF9, 15, 2 },	// 1.2 MB
+	{ 512, 1, 1, 2, 224, 2880, 9, 0xF0, 18, 2 },	// 1.44 MB
+	{ 512, 2, 1, 2, 240, 5760, 9, 0xF0, 36, 2 },	// 2.88 MB
+};
+
+// Indexes into standard_formats
+enum StandardFormatId : size_t
+{
+	format_160k,
+	format_180k,
+	format_320k,
+	format_360k,
+	format_720k,
+	format_1200k,
+	format_1440k,
+	format_2880k
+};
+
+inline constexpr StandardFormat standard_formats[] =
+{
+	{ "160 KB", standard_boot_sectors[0], Layout::derive(standard_boot_sectors[0]) },
+	{ "180 KB", standard_boot_sectors[1], Layout::derive(standard_boot_sectors[1]) },
+	{ "320 KB", standard_boot_sectors[2], Layout::derive(standard_boot_sectors[2]) },
+	{ "360 KB", standard_boot_sectors[3], Layout::derive(standard_boot_sectors[3]) },
+	{ "720 KB", standard_boot_sectors[4], Layout::derive(standard_boot_sectors[4]) },
+	{ "1.2 MB", standard_boot_sectors[5], Layout::derive(standard_boot_sectors[5]) },
+	{ "1.44 MB", standard_boot_sectors[6], Layout::derive(standard_boot_sectors[6]) },
+	{ "2.88 MB", standard_boot_sectors[7], Layout::derive(standard_boot_sectors[7]) },
+};
+
+static_assert(standard_formats[format_1440k].layout.data_offset == 33 * 512 && standard_formats[format_1440k].layout.cluster_count == 2847);
+static_assert(standard_formats[format_720k].layout.data_offset == 14 * 512 && standard_formats[format_720k].layout.cluster_count == 713);
+static_assert(standard_formats[format_2880k].layout.clusterOffset(2) == 34 * 512 && standard_formats[format_2880k].layout.cluster_count == 2863);
+
+// A standard format's layout is known at compile time; call sites that can be
+// written against a fixed format get every offset folded to a constant
+template <StandardFormatId Format>
+struct StandardLayout
+{
+	static constexpr Layout layout = standard_formats[Format].layout;
+	static constexpr uint64_t clusterOffset(uint32_t cluster) { return layout.clusterOffset(cluster); }
+};
+
+// Index into standard_formats of the format the BPB describes, or -1
+constexpr int findStandardFormat(const BootSector &bpb)
+{
+	for (size_t format = 0; format < std::size(standard_formats); ++format)
+	{
+		const BootSector &standard = standard_formats[format].boot_sector;
+		if (standard.sector_size == bpb.sector_size && standard.sectors_per_cluster == bpb.sectors_per_cluster &&
+			standard.num_reserved_sectors == bpb.num_reserved_sectors && standard.num_fats == bpb.num_fats &&
+			standard.max_num_root_entries == bpb.max_num_root_entries && standard.total_sector_count == bpb.total_sector_count &&
+			standard.sectors_per_fat == bpb.sectors_per_fat)
+			return static_cast<int>(format);
+	}
+	return -1;
+}
+
+// Index of the standard format with this name, e.g. "1.44 MB" or "1.44MB", or -1
+inline int findStandardFormat(std::string_view name)
+{
+	auto sameIgnoringSpaces = [](std::string_view a, std::string_view b)
+	{
+		for (size_t i = 0, j = 0;; ++i, ++j)
+		{
+			while (i < a.size() && a[i] == ' ')
+				++i;
+			while (j < b.size() && b[j] == ' ')
+				++j;
+			if (i == a.size() || j == b.size())
+				return i == a.size() && j == b.size();
+			if (a[i] != b[j])
+				return false;
+		}
+	};
+	for (size_t format = 0; format < std::size(standard_formats); ++format)
+	{
+		if (sameIgnoringSpaces(standard_formats[format].name, name))
+			return static_cast<int>(format);
+	}
+	return -1;
+}
+
+// Standard formats come from the compile-time table, anything else is derived
+inline Layout layoutFor(const BootSector &bpb)
+{
+	int format = findStandardFormat(bpb);
+	return format >= 0 ? standard_formats[format].layout : Layout::derive(bpb);
+}
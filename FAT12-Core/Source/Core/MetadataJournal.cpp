@@ -0,0 +1,167 @@
+#include "MetadataJournal.h"
+
+#include <filesystem>
+#include <iostream>
+
+// On-disk transaction: header, then record_count records of
+// { uint64_t offset, uint32_t length, length bytes }
+struct TransactionHeader
+{
+	uint32_t magic;
+	uint32_t record_count;
+	uint64_t sequence;
+	uint64_t payload_size;
+	uint64_t checksum;	// Of the payload
+};
+
+static constexpr uint32_t transaction_magic = 0x4C4E4A46;	// "FJNL"
+
+static uint64_t checksum(std::span<const std::byte> bytes)
+{
+	// FNV-1a
+	uint64_t hash = 0xCBF29CE484222325;
+	for (std::byte value : bytes)
+		hash = (hash ^ static_cast<uint8_t>(value)) * 0x100000001B3;
+	return hash;
+}
+
+template <typename T>
+static void append(std::vector<std::byte> &buffer, const T &value)
+{
+	const std::byte *bytes = reinterpret_cast<const std::byte*>(&value);
+	buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+bool MetadataJournal::recover(const std::string &path, BlockDevice &device, uint32_t &transactions)
+{
+	transactions = 0;
+	std::error_code error;
+	if (!std::filesystem::exists(path, error))
+		return true;
+
+	File journal;
+	if (!journal.open(path, File::Mode::Read))
+	{
+		std::cerr << "ERROR: Failed to open the metadata journal: " << path << std::endl;
+		return false;
+	}
+	std::vector<std::byte> contents(journal.size());
+	if (!contents.empty() && !journal.readAt(0, contents.data(), contents.size()))
+	{
+		std::cerr << "ERROR: Failed to read the metadata journal: " << path << std::endl;
+		return false;
+	}
+	journal.close();
+
+	// Transactions are only replayed whole, up to the first one that is torn or corrupt
+	std::span<const std::byte> remaining(contents);
+	uint64_t expected_sequence = 0;
+	while (remaining.size() >= sizeof(TransactionHeader))
+	{
+		TransactionHeader header = readField<TransactionHeader>(remaining, 0);
+		if (header.magic != transaction_magic || header.payload_size > remaining.size() - sizeof(TransactionHeader) ||
+			(transactions != 0 && header.sequence != expected_sequence))
+			break;
+		std::span<const std::byte> payload = remaining.subspan(sizeof(TransactionHeader), header.payload_size);
+		if (checksum(payload) != header.checksum)
+			break;
+
+		for (uint32_t record = 0; record < header.record_count; ++record)
+		{
+			if (payload.size() < sizeof(uint64_t) + sizeof(uint32_t))
+				break;
+			uint64_t offset = readField<uint64_t>(payload, 0);
+			uint32_t length = readField<uint32_t>(payload, sizeof(uint64_t));
+			payload = payload.subspan(sizeof(uint64_t) + sizeof(uint32_t));
+			if (length > payload.size() || !device.write(offset, payload.first(length)))
+			{
+				std::cerr << "ERROR: Failed to replay the metadata journal: " << path << std::endl;
+				return false;
+			}
+			payload = payload.subspan(length);
+		}
+		++transactions;
+		expected_sequence = header.sequence + 1;
+		remaining = remaining.subspan(sizeof(TransactionHeader) + header.payload_size);
+	}
+
+	if (!device.sync())
+	{
+		std::cerr << "ERROR: Failed to sync the replayed metadata journal: " << path << std::endl;
+		return false;
+	}
+	std::filesystem::remove(path, error);
+	return true;
+}
+
+void MetadataJournal::reset(const std::string &path)
+{
+	file.close();
+	journal_path = path;
+	journal_size = 0;
+	sequence = 0;
+}
+
+bool MetadataJournal::commit(const std::map<uint64_t, std::vector<std::byte>> &sectors, uint32_t sector_size)
+{
+	if (!file.isOpen() && !file.open(journal_path, File::Mode::Create))
+	{
+		std::cerr << "ERROR: Failed to create the metadata journal: " << journal_path << std::endl;
+		return false;
+	}
+
+	// Adjacent sectors become one record
+	buffer.assign(sizeof(TransactionHeader), std::byte{ 0 });
+	uint32_t record_count = 0;
+	size_t length_position = 0;
+	uint64_t next_sector = 0;
+	for (const auto &[sector, bytes] : sectors)
+	{
+		if (record_count == 0 || sector != next_sector)
+		{
+			append(buffer, sector * sector_size);
+			length_position = buffer.size();
+			append(buffer, uint32_t{ 0 });
+			++record_count;
+		}
+		uint32_t length = readField<uint32_t>(buffer, length_position) + static_cast<uint32_t>(bytes.size());
+		std::memcpy(buffer.data() + length_position, &length, sizeof(length));
+		buffer.insert(buffer.end(), bytes.begin(), bytes.end());
+		next_sector = sector + 1;
+	}
+
+	TransactionHeader header{ transaction_magic, record_count, sequence, buffer.size() - sizeof(TransactionHeader), 0 };
+	header.checksum = checksum(std::span(buffer).subspan(sizeof(TransactionHeader)));
+	std::memcpy(buffer.data(), &header, sizeof(header));
+
+	// The single sync of the transaction; nothing reaches the image before it returns
+	if (!file.writeAt(journal_size, buffer.data(), buffer.size()) || !file.sync())
+	{
+		std::cerr << "ERROR: Failed to write the metadata journal: " << journal_path << std::endl;
+		return false;
+	}
+	++sync_count;
+	++sequence;
+	journal_size += buffer.size();
+	return true;
+}
+
+bool MetadataJournal::truncate()
+{
+	if (!file.isOpen() || journal_size == 0)
+		return true;
+	if (!file.resize(0))
+		return false;
+	journal_size = 0;
+	return true;
+}
+
+void MetadataJournal::remove()
+{
+	if (!file.isOpen())
+		return;
+	file.close();
+	std::error_code error;
+	std::filesystem::remove(journal_path, error);
+	journal_size = 0;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "BlockDevice.h"
+#include "File.h"
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// Redo journal for metadata sectors, kept in a sidecar file next to the image.
+// Each transaction is appended with a checksum and made durable with a single
+// sync before any of its sectors is written to the image, so a crash leaves
+// either the old or the new metadata once recover() replays the journal.
+class MetadataJournal
+{
+public:
+	static std::string pathFor(const std::string &image) { return image + ".journal"; }
+
+	// Writes every complete transaction of a leftover journal into the device, syncs
+	// it and removes the journal. A torn transaction at the end is dropped.
+	static bool recover(const std::string &path, BlockDevice &device, uint32_t &transactions);
+
+	// The sidecar is only created by the first commit
+	void reset(const std::string &path);
+	// Appends the sectors, keyed by sector number, as one transaction
+	bool commit(const std::map<uint64_t, std::vector<std::byte>> &sectors, uint32_t sector_size);
+	// Drops every transaction; the device must be synced first
+	bool truncate();
+	// Removes the sidecar after a clean unmount; the device must be synced first
+	void remove();
+
+	bool isOpen() const { return file.isOpen(); }
+	uint64_t size() const { return journal_size; }
+	uint64_t syncCount() const { return sync_count; }
+
+private:
+	std::string journal_path;
+	File file;
+	uint64_t journal_size = 0;
+	uint64_t sync_count = 0;
+	uint64_t sequence = 0;
+	std::vector<std::byte> buffer;	// Reused for each transaction
+};
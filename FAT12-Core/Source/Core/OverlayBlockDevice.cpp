@@ -0,0 +1,193 @@
+#include "OverlayBlockDevice.h"
+#include "Instrumentation.h"
+#include "SnapshotCache.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+
+// Delta layout: header, then slots of { uint64_t sector, sector_size bytes }
+struct DeltaHeader
+{
+	uint32_t magic;
+	uint32_t sector_size;
+	uint64_t base_size;	// Deltas only apply to a base of the size they were made for
+	uint64_t base_identity;	// And of the metadata they were made against
+	uint64_t commit_identity;	// The base's identity once an interrupted commit lands, otherwise 0
+};
+
+static constexpr uint32_t delta_magic = 0x544C4446;	// "FDLT"
+static constexpr uint64_t slot_size = sizeof(uint64_t) + OverlayBlockDevice::sector_size;
+
+// Hash of the boot sector, FAT copies and root directory, the region every
+// change to a volume touches; an unreadable BPB falls back to the first sector
+static uint64_t identify(std::span<const std::byte> image)
+{
+	uint64_t metadata_size = std::min<uint64_t>(image.size(), OverlayBlockDevice::sector_size);
+	if (image.size() >= 24)
+	{
+		uint64_t bytes_per_sector = readField<uint16_t>(image, 11);
+		uint64_t sectors = readField<uint16_t>(image, 14) + static_cast<uint64_t>(readField<uint8_t>(image, 16)) * readField<uint16_t>(image, 22);
+		uint64_t root_size = static_cast<uint64_t>(readField<uint16_t>(image, 17)) * 32;
+		if (bytes_per_sector != 0)
+			metadata_size = std::clamp<uint64_t>(sectors * bytes_per_sector + root_size, metadata_size, image.size());
+	}
+	return SnapshotCache::hash(image.first(metadata_size));
+}
+
+bool OverlayBlockDevice::open(const std::string &base_image, const std::string &delta_file)
+{
+	base_path = base_image;
+	delta_path = delta_file;
+	if (!base.open(base_path, File::Mode::Read) || !region.map(base, true))
+	{
+		std::cerr << "ERROR: Failed to map the base image: " << base_path << std::endl;
+		return false;
+	}
+	base_identity = identify(bytes());
+
+	std::error_code error;
+	if (!std::filesystem::exists(delta_path, error))
+	{
+		if (!delta.open(delta_path, File::Mode::Create) || !resetDelta(false))
+		{
+			std::cerr << "ERROR: Failed to create the delta file: " << delta_path << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	DeltaHeader header{};
+	if (!delta.open(delta_path, File::Mode::ReadWrite) || !delta.readAt(0, &header, sizeof(header)) ||
+		header.magic != delta_magic || header.sector_size != sector_size || header.base_size != size() ||
+		(header.base_identity != base_identity && (header.commit_identity == 0 || header.commit_identity != base_identity)))
+	{
+		std::cerr << "ERROR: Delta file does not belong to this base image: " << delta_path << std::endl;
+		return false;
+	}
+
+	// A slot torn by a crash is dropped along with everything after it
+	uint64_t slot_count = (delta.size() - sizeof(DeltaHeader)) / slot_size;
+	std::vector<std::byte> contents(slot_count * slot_size);
+	if (!contents.empty() && !delta.readAt(sizeof(DeltaHeader), contents.data(), contents.size()))
+		return false;
+
+	std::span<std::byte> image = region.writableBytes();
+	for (uint64_t slot = 0; slot < slot_count; ++slot)
+	{
+		std::span<const std::byte> bytes = std::span<const std::byte>(contents).subspan(slot * slot_size, slot_size);
+		uint64_t sector = readField<uint64_t>(bytes, 0);
+		uint64_t offset = sector * sector_size;
+		if (offset >= image.size())
+			break;
+		std::copy_n(bytes.begin() + sizeof(uint64_t), std::min<uint64_t>(sector_size, image.size() - offset), image.begin() + offset);
+		slots[sector] = slot;
+	}
+	return delta.resize(sizeof(DeltaHeader) + slot_count * slot_size);
+}
+
+bool OverlayBlockDevice::write(uint64_t offset, std::span<const std::byte> data)
+{
+	std::span<std::byte> image = region.writableBytes();
+	if (data.empty() || offset + data.size() > image.size())
+		return false;
+	std::copy(data.begin(), data.end(), image.begin() + offset);
+
+	// Whole sectors go to the delta: rewritten in place if already there, otherwise appended together
+	uint64_t next_slot = slots.size();
+	buffer.clear();
+	std::vector<std::byte> slot(slot_size);
+	for (uint64_t sector = offset / sector_size; sector <= (offset + data.size() - 1) / sector_size; ++sector)
+	{
+		uint64_t sector_offset = sector * sector_size;
+		std::memcpy(slot.data(), &sector, sizeof(sector));
+		std::fill(slot.begin() + sizeof(uint64_t), slot.end(), std::byte{ 0 });
+		std::copy_n(image.begin() + sector_offset, std::min<uint64_t>(sector_size, image.size() - sector_offset), slot.begin() + sizeof(uint64_t));
+
+		auto existing = slots.find(sector);
+		if (existing != slots.end())
+		{
+			if (!delta.writeAt(sizeof(DeltaHeader) + existing->second * slot_size, slot.data(), slot.size()))
+				return false;
+			continue;
+		}
+		uint64_t index = slots.size();
+		buffer.insert(buffer.end(), slot.begin(), slot.end());
+		slots[sector] = index;
+	}
+	if (!buffer.empty() && !delta.writeAt(sizeof(DeltaHeader) + next_slot * slot_size, buffer.data(), buffer.size()))
+		return false;
+
+	++write_count;
+	FAT12_COUNT(device_writes, 1);
+	FAT12_COUNT(device_bytes_written, data.size());
+	return true;
+}
+
+bool OverlayBlockDevice::snapshot(const std::string &snapshot_file)
+{
+	std::error_code error;
+	if (!delta.sync() || std::filesystem::equivalent(snapshot_file, delta_path, error))
+		return false;
+	return std::filesystem::copy_file(delta_path, snapshot_file, std::filesystem::copy_options::overwrite_existing, error);
+}
+
+bool OverlayBlockDevice::commit()
+{
+	if (slots.empty())
+		return true;
+
+	File writable_base;
+	if (!writable_base.open(base_path, File::Mode::ReadWrite))
+	{
+		std::cerr << "ERROR: Failed to open the base image for writing: " << base_path << std::endl;
+		return false;
+	}
+
+	// The delta is only emptied once the base holds every sector durably; until
+	// then it also accepts the base it is being committed into, so a commit cut
+	// short by a crash is replayed on the next open
+	std::span<const std::byte> image = bytes();
+	uint64_t committed_identity = identify(image);
+	DeltaHeader header{ delta_magic, sector_size, size(), base_identity, committed_identity };
+	if (!delta.writeAt(0, &header, sizeof(header)) || !delta.sync())
+		return false;
+
+	std::vector<uint64_t> sectors;
+	for (const auto &[sector, slot] : slots)
+		sectors.push_back(sector);
+	std::sort(sectors.begin(), sectors.end());
+	for (uint64_t sector : sectors)
+	{
+		uint64_t sector_offset = sector * sector_size;
+		std::span<const std::byte> bytes = image.subspan(sector_offset, std::min<uint64_t>(sector_size, image.size() - sector_offset));
+		if (!writable_base.writeAt(sector_offset, bytes.data(), bytes.size()))
+			return false;
+	}
+	if (!writable_base.sync())
+		return false;
+	base_identity = committed_identity;
+	return resetDelta(true);
+}
+
+bool OverlayBlockDevice::discard()
+{
+	if (!resetDelta(true))
+		return false;
+	// Remapping drops every private page
+	if (!region.map(base, true))
+	{
+		std::cerr << "ERROR: Failed to map the base image: " << base_path << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool OverlayBlockDevice::resetDelta(bool durable)
+{
+	DeltaHeader header{ delta_magic, sector_size, size(), base_identity, 0 };
+	if (!delta.resize(0) || !delta.writeAt(0, &header, sizeof(header)) || (durable && !delta.sync()))
+		return false;
+	slots.clear();
+	return true;
+}
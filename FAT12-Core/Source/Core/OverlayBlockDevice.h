@@ -0,0 +1,44 @@
+#pragma once
+
+#include "BlockDevice.h"
+
+#include <string>
+#include <unordered_map>
+
+// A base image that is only ever read, combined with a sparse delta file that
+// holds a copy of every sector written in this session. The base is mapped
+// privately, so sessions sharing it only pay memory for the pages they change.
+class OverlayBlockDevice : public BlockDevice
+{
+public:
+	static constexpr uint32_t sector_size = 512;
+
+	// Creates the delta if it does not exist, otherwise applies its sectors
+	bool open(const std::string &base_image, const std::string &delta_file);
+
+	Backend backend() const override { return Backend::Overlay; }
+	std::span<const std::byte> bytes() const override { return region.bytes(); }
+	bool write(uint64_t offset, std::span<const std::byte> data) override;
+	bool sync() override { return delta.sync(); }
+
+	size_t changedSectors() const { return slots.size(); }
+	// Copies the delta, so another session can branch off the current state
+	bool snapshot(const std::string &snapshot_file);
+	// Writes every changed sector into the base image and empties the delta
+	bool commit();
+	// Empties the delta and returns to the base image
+	bool discard();
+
+private:
+	std::string base_path;
+	std::string delta_path;
+	File base;
+	File delta;
+	MappedRegion region;	// Copy-on-write view of the base with the delta applied
+	uint64_t base_identity = 0;	// Metadata hash of the base as it is on disk
+	std::unordered_map<uint64_t, uint64_t> slots;	// Sector number to its slot in the delta
+	std::vector<std::byte> buffer;	// Slots appended by one write
+
+	// A fresh delta holds nothing worth a sync; emptying one after commit or discard does
+	bool resetDelta(bool durable);
+};
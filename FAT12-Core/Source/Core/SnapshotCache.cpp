@@ -0,0 +1,80 @@
+#include "SnapshotCache.h"
+
+#include <cstring>
+
+uint64_t SnapshotCache::hash(std::span<const std::byte> metadata)
+{
+	// FNV-1a style over four interleaved lanes of 64-bit words, so the multiplies
+	// do not wait on each other; the length is mixed in so regions that differ
+	// only in trailing zeros get different keys
+	const uint64_t prime = 0x100000001B3ull;
+	uint64_t lanes[4] = { 0xCBF29CE484222325ull, 0x84222325CBF29CE4ull, 0x9E3779B97F4A7C15ull, 0xC2B2AE3D27D4EB4Full };
+	size_t position = 0;
+	for (; position + sizeof(lanes) <= metadata.size(); position += sizeof(lanes))
+	{
+		uint64_t words[4];
+		std::memcpy(words, metadata.data() + position, sizeof(words));
+		for (size_t lane = 0; lane < 4; ++lane)
+		{
+			lanes[lane] = (lanes[lane] ^ words[lane]) * prime;
+			lanes[lane] ^= lanes[lane] >> 29;
+		}
+	}
+
+	uint64_t value = metadata.size();
+	for (uint64_t lane : lanes)
+		value = (value ^ lane) * prime;
+	for (; position < metadata.size(); ++position)
+		value = (value ^ std::to_integer<uint64_t>(metadata[position])) * prime;
+	return value ^ (value >> 32);
+}
+
+SnapshotCache::SnapshotRef SnapshotCache::find(uint64_t key)
+{
+	std::lock_guard lock(mutex);
+	auto found = snapshots.find(key);
+	if (found == snapshots.end())
+	{
+		++miss_count;
+		return nullptr;
+	}
+
+	++hit_count;
+	recently_used.splice(recently_used.begin(), recently_used, found->second.recent);
+	return found->second.snapshot;
+}
+
+void SnapshotCache::insert(uint64_t key, SnapshotRef snapshot)
+{
+	if (capacity == 0)
+		return;
+
+	std::lock_guard lock(mutex);
+	auto found = snapshots.find(key);
+	if (found != snapshots.end())
+	{
+		// Two mounts of the same metadata raced; either snapshot will do
+		recently_used.splice(recently_used.begin(), recently_used, found->second.recent);
+		return;
+	}
+
+	if (snapshots.size() == capacity)
+	{
+		snapshots.erase(recently_used.back());
+		recently_used.pop_back();
+	}
+	recently_used.push_front(key);
+	snapshots.emplace(key, Slot{ std::move(snapshot), recently_used.begin() });
+}
+
+size_t SnapshotCache::hits() const
+{
+	std::lock_guard lock(mutex);
+	return hit_count;
+}
+
+size_t SnapshotCache::misses() const
+{
+	std::lock_guard lock(mutex);
+	return miss_count;
+}
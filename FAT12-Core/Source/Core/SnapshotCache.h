@@ -0,0 +1,56 @@
+#pragma once
+
+#include "DirectoryEntry.h"
+#include "Layout.h"
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+// Everything a mount parses before touching the data area
+struct MountSnapshot
+{
+	BootSector boot_sector;
+	std::vector<uint16_t> fat_table;
+	std::vector<DirectoryEntry> root_entries;
+	std::vector<std::byte> metadata;	// The hashed region, compared on a hit so a hash collision is never trusted
+};
+
+// Parsed metadata shared between mounts of images with identical boot sector,
+// FAT and root directory bytes, keyed by a hash of that region. Callers compare
+// the region against the snapshot's copy before using it. Bounded, least
+// recently used snapshots are dropped first. Safe to share between threads.
+class SnapshotCache
+{
+public:
+	using SnapshotRef = std::shared_ptr<const MountSnapshot>;
+
+	explicit SnapshotCache(size_t capacity = 1024) : capacity(capacity) {}
+
+	static uint64_t hash(std::span<const std::byte> metadata);
+
+	// nullptr if no image with this metadata was parsed yet
+	SnapshotRef find(uint64_t key);
+	void insert(uint64_t key, SnapshotRef snapshot);
+
+	size_t hits() const;
+	size_t misses() const;
+
+private:
+	struct Slot
+	{
+		SnapshotRef snapshot;
+		std::list<uint64_t>::iterator recent;
+	};
+
+	size_t capacity;
+	mutable std::mutex mutex;
+	std::unordered_map<uint64_t, Slot> snapshots;
+	std::list<uint64_t> recently_used;	// Most recent first
+	size_t hit_count = 0;
+	size_t miss_count = 0;
+};
@@ -0,0 +1,30 @@
+#include "SpaceAccounting.h"
+
+#include <algorithm>
+
+void SpaceAccounting::reset(std::span<const uint16_t> fat_table, uint32_t cluster_count)
+{
+	cluster_counts = {};
+	end_cluster = std::min<uint32_t>(cluster_count + 2, static_cast<uint32_t>(fat_table.size()));
+	for (uint32_t cluster = 2; cluster < end_cluster; ++cluster)
+		++counterFor(fat_table[cluster]);
+}
+
+void SpaceAccounting::update(uint16_t cluster, uint16_t old_value, uint16_t new_value)
+{
+	if (cluster < 2 || cluster >= end_cluster)
+		return;
+	--counterFor(old_value);
+	++counterFor(new_value);
+}
+
+uint32_t &SpaceAccounting::counterFor(uint16_t value)
+{
+	if (value == 0x000)
+		return cluster_counts.free;
+	if (value == 0xFF7)
+		return cluster_counts.bad;
+	if (value >= 0xFF0 && value <= 0xFF6)
+		return cluster_counts.reserved;
+	return cluster_counts.used;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+// Data-area clusters counted by the kind of their FAT entry. The owner reports
+// every FAT change through update(), so the counts are always current and
+// reading them never scans the table.
+class SpaceAccounting
+{
+public:
+	struct Counts
+	{
+		uint32_t free = 0;
+		uint32_t used = 0;	// Chain links and end-of-chain marks
+		uint32_t bad = 0;
+		uint32_t reserved = 0;	// 0xFF0-0xFF6, never handed out or part of a chain
+	};
+
+	// Counts clusters 2..cluster_count+1, as far as the table reaches
+	void reset(std::span<const uint16_t> fat_table, uint32_t cluster_count);
+	void update(uint16_t cluster, uint16_t old_value, uint16_t new_value);
+	const Counts &counts() const { return cluster_counts; }
+	// Clusters the counts cover
+	uint32_t trackedCount() const { return end_cluster > 2 ? end_cluster - 2 : 0; }
+
+private:
+	Counts cluster_counts;
+	uint32_t end_cluster = 0;	// One past the last counted cluster
+
+	uint32_t &counterFor(uint16_t value);
+};
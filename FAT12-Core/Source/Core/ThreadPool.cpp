@@ -0,0 +1,96 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t thread_count)
+{
+	if (thread_count == 0)
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+	for (size_t i = 0; i < thread_count; ++i)
+		queues.push_back(std::make_unique<Queue>());
+	for (size_t i = 0; i < thread_count; ++i)
+		workers.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard lock(state_mutex);
+		stopping = true;
+	}
+	work_available.notify_all();
+	for (std::thread &worker : workers)
+		worker.join();
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+	Queue &queue = *queues[next_queue++ % queues.size()];
+	{
+		std::lock_guard lock(queue.mutex);
+		queue.tasks.push_back(std::move(task));
+	}
+	{
+		std::lock_guard lock(state_mutex);
+		++queued;
+		++unfinished;
+	}
+	work_available.notify_one();
+}
+
+void ThreadPool::wait()
+{
+	std::unique_lock lock(state_mutex);
+	all_done.wait(lock, [this] { return unfinished == 0; });
+}
+
+bool ThreadPool::takeTask(size_t worker, std::function<void()> &task)
+{
+	// Own deque from the front, so tasks run in the order they were submitted,
+	// then the others from the back, where their owners will get to last
+	for (size_t i = 0; i < queues.size(); ++i)
+	{
+		Queue &queue = *queues[(worker + i) % queues.size()];
+		std::lock_guard lock(queue.mutex);
+		if (queue.tasks.empty())
+			continue;
+
+		if (i == 0)
+		{
+			task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+		}
+		else
+		{
+			task = std::move(queue.tasks.back());
+			queue.tasks.pop_back();
+		}
+		return true;
+	}
+	return false;
+}
+
+void ThreadPool::workerLoop(size_t worker)
+{
+	while (true)
+	{
+		{
+			std::unique_lock lock(state_mutex);
+			work_available.wait(lock, [this] { return stopping || queued > 0; });
+			if (queued == 0)
+				return;
+			--queued;
+		}
+
+		// The claim above guarantees a task is sitting in some deque
+		std::function<void()> task;
+		while (!takeTask(worker, task))
+			std::this_thread::yield();
+		task();
+
+		std::lock_guard lock(state_mutex);
+		if (--unfinished == 0)
+			all_done.notify_all();
+	}
+}
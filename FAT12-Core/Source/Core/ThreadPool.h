@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of workers, each with its own task deque. Tasks are dealt out
+// round-robin; a worker runs the oldest task of its own deque and, when that
+// is empty, steals the newest task of another worker. Tasks submitted in
+// order of decreasing cost therefore start in roughly that order.
+class ThreadPool
+{
+public:
+	// 0 threads means one per hardware thread
+	explicit ThreadPool(size_t thread_count = 0);
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool &operator=(const ThreadPool &) = delete;
+	~ThreadPool();
+
+	void submit(std::function<void()> task);
+	// Blocks until every submitted task has finished
+	void wait();
+	size_t threadCount() const { return workers.size(); }
+
+private:
+	struct Queue
+	{
+		std::mutex mutex;
+		std::deque<std::function<void()>> tasks;
+	};
+
+	std::vector<std::unique_ptr<Queue>> queues;
+	std::vector<std::thread> workers;
+	std::atomic<size_t> next_queue{ 0 };
+
+	std::mutex state_mutex;
+	std::condition_variable work_available;
+	std::condition_variable all_done;
+	size_t queued = 0;	// Submitted but not yet claimed by a worker
+	size_t unfinished = 0;	// Submitted but not yet finished
+	bool stopping = false;
+
+	bool takeTask(size_t worker, std::function<void()> &task);
+	void workerLoop(size_t worker);
+};
@@ -0,0 +1,96 @@
+#include "WriteBackCache.h"
+
+#include <algorithm>
+
+// Journals grow until data forces a checkpoint; past this size one is forced
+static constexpr uint64_t journal_checkpoint_size = 4 * 1024 * 1024;
+
+void WriteBackCache::reset(BlockDevice *block_device, uint32_t bytes_per_sector, MetadataJournal *metadata_journal)
+{
+	device = block_device;
+	journal = metadata_journal;
+	flushed_write_count = device ? device->writeCount() : 0;
+	sector_size = bytes_per_sector != 0 ? bytes_per_sector : 512;
+	dirty_sectors.clear();
+}
+
+bool WriteBackCache::stage(uint64_t offset, std::span<const std::byte> data)
+{
+	if (!device)
+		return false;
+
+	while (!data.empty())
+	{
+		uint64_t sector = offset / sector_size;
+		size_t offset_in_sector = static_cast<size_t>(offset % sector_size);
+		size_t count = std::min<size_t>(sector_size - offset_in_sector, data.size());
+
+		auto staged = dirty_sectors.find(sector);
+		if (staged == dirty_sectors.end())
+		{
+			std::span<const std::byte> current = device->bytes(sector * sector_size, sector_size);
+			if (current.empty())
+				return false;
+			staged = dirty_sectors.emplace(sector, std::vector<std::byte>(current.begin(), current.end())).first;
+		}
+		std::copy_n(data.begin(), count, staged->second.begin() + offset_in_sector);
+
+		offset += count;
+		data = data.subspan(count);
+	}
+	return true;
+}
+
+bool WriteBackCache::flush()
+{
+	if (dirty_sectors.empty())
+		return true;
+
+	if (journal)
+	{
+		// File data written since the last flush must be durable before metadata
+		// points at it. That sync also makes every journaled sector durable in the
+		// image, so the journal starts over.
+		if ((device->writeCount() != flushed_write_count || journal->size() > journal_checkpoint_size) && !checkpoint())
+			return false;
+		if (!journal->commit(dirty_sectors, sector_size))
+			return false;
+	}
+
+	// Runs of consecutive sectors go out as a single write
+	std::vector<std::byte> run;
+	uint64_t run_sector = 0;
+	auto writeRun = [&]()
+	{
+		if (run.empty())
+			return true;
+		flushed_bytes += run.size();
+		bool written = device->write(run_sector * sector_size, run);
+		run.clear();
+		return written;
+	};
+
+	bool success = true;
+	for (const auto &[sector, bytes] : dirty_sectors)
+	{
+		if (!run.empty() && sector != run_sector + run.size() / sector_size)
+			success = writeRun() && success;
+		if (run.empty())
+			run_sector = sector;
+		run.insert(run.end(), bytes.begin(), bytes.end());
+	}
+	success = writeRun() && success;
+
+	// Failed sectors stay dirty so a later flush can retry them
+	if (success)
+		dirty_sectors.clear();
+	flushed_write_count = device->writeCount();
+	return success;
+}
+
+bool WriteBackCache::checkpoint()
+{
+	if (!device->sync())
+		return false;
+	return !journal || journal->truncate();
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "BlockDevice.h"
+#include "MetadataJournal.h"
+
+#include <cstdint>
+#include <map>
+#include <span>
+#include <vector>
+
+// Sector-granular write-back cache over a block device. Metadata updates are
+// staged into whole sectors and only reach the device on flush(), in address
+// order with adjacent sectors merged into one write. With a journal attached,
+// every flush is committed to the journal before the image is touched.
+class WriteBackCache
+{
+public:
+	void reset(BlockDevice *block_device, uint32_t bytes_per_sector, MetadataJournal *metadata_journal = nullptr);
+
+	// Stages bytes at an image offset; sectors not staged yet are first read from the device
+	bool stage(uint64_t offset, std::span<const std::byte> data);
+	bool flush();
+
+	size_t dirtySectorCount() const { return dirty_sectors.size(); }
+	// Staged sectors, so a transaction that fails part way can put them back
+	using Staged = std::map<uint64_t, std::vector<std::byte>>;
+	const Staged &staged() const { return dirty_sectors; }
+	void restore(Staged sectors) { dirty_sectors = std::move(sectors); }
+	uint64_t flushedBytes() const { return flushed_bytes; }	// Written by every flush() so far
+	// Syncs the device so the journal can be dropped
+	bool checkpoint();
+
+private:
+	BlockDevice *device = nullptr;
+	uint32_t sector_size = 512;
+	MetadataJournal *journal = nullptr;
+	uint64_t flushed_write_count = 0;	// Device writes after the last flush; more means data was written since
+	Staged dirty_sectors;	// Keyed by sector number
+	uint64_t flushed_bytes = 0;
+};